@@ -0,0 +1,940 @@
+/* * * * * * * * *
+ * Utility program that drives a hash table with an open-loop load at a
+ * series of fixed rates, reporting latency percentiles at each offered load,
+ * or sweeps tables through sizes from cache-resident to memory-bound
+ *
+ * usage:
+ *   make bench
+ *   ./bench -t type [-s size] [-r rates] [-d seconds] [-l percent]
+ *           [-k keyspace] [-f cachekeys] [-b bufferkeys] [capturefile]
+ *   ./bench -t type|all [-s size] -w maxkeys
+ *   ./bench -t type|all [-s size] -g nkeys
+ *   ./bench -t type|all [-s size] [-k keyspace] -n reps [-o store] [-L label]
+ *           [-B baseline] [-T percent]
+ *       type:        which hash table to drive (as for a2), or with -w or -g,
+ *                    'all' to run every type in turn
+ *       size:        initial size of the hash table
+ *       rates:       comma-separated operations per second to offer, one
+ *                    step of the sweep each (default 250000,500000,1000000,
+ *                    2000000)
+ *       seconds:     how long to offer each rate for (default 1)
+ *       percent:     how many of the generated operations are lookups, the
+ *                    rest being inserts (default 90)
+ *       keyspace:    how many distinct keys to generate (default 1000000),
+ *                    or with -n, how many keys the suite's tables hold
+ *                    (default SUITE_KEYS)
+ *       cachekeys:   put a front cache with room for this many keys in
+ *                    front of the table (see hash_table_front)
+ *       bufferkeys:  buffer this many inserts before merging them into the
+ *                    table (see hash_table_set_buffer; xtndbln only)
+ *       capturefile: operations captured by a2 -w to issue instead of
+ *                    generated ones (their timestamps are ignored, and they
+ *                    are repeated if a step needs more)
+ *       maxkeys:     sweep table sizes instead, from 1024 keys up to this
+ *                    many, doubling each time
+ *       nkeys:       time the growth of a table instead, from empty to this
+ *                    many keys
+ *       reps:        run the regression suite instead, this many times over
+ *       store:       CSV file to append the suite's results to
+ *       label:       what to call this run in the store (default: the date
+ *                    and time it started)
+ *       baseline:    CSV file of earlier results (e.g. a store) to compare
+ *                    the suite's results against
+ *       percent:     smallest change in a mean to flag (default 5)
+ *
+ * each step starts from a fresh table (preloaded with half of the keyspace
+ * when generating operations) and schedules operation i for i / rate
+ * seconds after the step starts. an operation's latency is measured from
+ * that intended start time rather than from when it actually started, so
+ * time spent queued behind slow operations is counted instead of hidden
+ * (coordinated omission). the service time (from actual start) is reported
+ * alongside for comparison
+ *
+ * a sweep fills a fresh table with each number of random keys in turn,
+ * timing the inserts, and then times random lookups of keys that are there
+ * (hits) and keys that aren't (misses): one at a time, one at a time with
+ * hash_table_lookup_branchless (blhit and blmiss), and a round of
+ * SWEEP_ROUND at a time with hash_table_lookup_mask (mhit and mmiss). as
+ * the table outgrows each level of cache (and the TLB's reach), the cost
+ * per operation steps up
+ *
+ * a growth run inserts random keys into an empty table, timing every
+ * insert. it prints the throughput and slowest insert of each window of
+ * GROWTH_WINDOW inserts as a time series (where resizes show up as
+ * stalls), followed by a summary of the worst stall of each type
+ *
+ * the regression suite measures each type like a single point of a sweep,
+ * 'reps' times over, interleaving the types (so that drift in the machine's
+ * speed hits each of them alike) and running each repetition in a child
+ * process of its own. the results are keyed by machine (host name and
+ * number of CPUs) and config (keys and initial size), so that a baseline
+ * only ever compares like with like. a regression is flagged when a mean
+ * gets worse by more than 'percent' and Welch's t-test says the change is
+ * bigger than the noise in the repetitions; bench then exits with status 2
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+
+#include "inthash.h"
+#include "hashtbl.h"
+#include "capture.h"
+#include "results.h"
+
+#define DEFAULT_SIZE 4
+#define DEFAULT_RATES "250000,500000,1000000,2000000"
+#define MAX_RATES 32
+// waits shorter than this (in nanoseconds) are spun through, not slept
+#define SPIN_NS 200000
+// the smallest number of keys a sweep starts from
+#define SWEEP_MIN_KEYS 1024
+// the most lookups (of each kind) to time at each point of a sweep, and the
+// most time to spend on them (a full linear table's misses are very slow)
+#define SWEEP_LOOKUPS (1 << 20)
+#define SWEEP_SECONDS 0.25
+// how many lookups to do between checks of the time
+#define SWEEP_ROUND 1024
+// how many inserts make up each window of a growth run
+#define GROWTH_WINDOW 1024
+// inserts slower than this (in nanoseconds) count as stalls
+#define STALL_NS 100000
+// how many keys the regression suite's tables hold by default (small enough
+// that every type of table can hold them)
+#define SUITE_KEYS 4096
+// the default smallest change in a mean for the suite to flag, in percent
+#define DEFAULT_THRESHOLD 5
+// bench's exit status when the suite finds a regression
+#define EXIT_REGRESSION 2
+
+// the workloads a sweep point (or the regression suite) measures
+typedef enum workload {
+	INSERTS,	// filling the table
+	HITS,		// looking up keys that are there
+	MISSES,		// looking up keys that aren't
+	MASK_HITS,	// hits, a round at a time, with hash_table_lookup_mask
+	MASK_MISSES,// misses, likewise
+	BL_HITS,	// hits, with hash_table_lookup_branchless
+	BL_MISSES,	// misses, likewise
+	NWORKLOADS
+} Workload;
+static const char *workload_names[] = { "insert", "hit", "miss", "maskhit",
+	"maskmiss", "blhit", "blmiss" };
+
+typedef struct options {
+	TableType type;
+	int initial_size;
+	long rates[MAX_RATES];	// operations per second to offer at each step
+	int nrates;
+	double seconds;			// how long each step lasts
+	int lookups;			// percentage of generated operations to look up
+	long keyspace;			// how many distinct keys to generate
+	char *capture;			// operations to issue instead, or NULL
+	int front;				// front cache keys for rate steps, or 0 for none
+	int buffer;				// write buffer keys for rate steps, or 0 for none
+	long sweep;				// most keys to sweep up to, or 0 for no sweep
+	long growth;			// how many keys to grow to, or 0 for no growth run
+	bool all;				// sweep (or grow) every type of table?
+	bool keys_given;		// was the keyspace set on the command line?
+	int reps;				// regression suite repetitions, or 0 for no suite
+	char *store;			// where to append the suite's results, or NULL
+	char *label;			// what to call this run in the store, or NULL
+	char *baseline;			// results to compare the suite against, or NULL
+	double threshold;		// smallest change in a mean to flag, in percent
+} Options;
+Options get_options(int argc, char **argv);
+
+// the results of one step of the sweep
+typedef struct step {
+	long rate;				// operations per second offered
+	double achieved;		// operations per second completed
+	long long *latencies;	// from intended start to completion, sorted
+	long long *services;	// from actual start to completion, sorted
+	long n;
+} Step;
+
+// a summary of one growth run
+typedef struct growth {
+	double seconds;		// how long every insert took in total
+	long long worst;	// the longest any one insert took, in nanoseconds
+	long worst_at;		// how many keys were in the table when it happened
+	long nstalls;		// how many inserts took longer than STALL_NS
+	long long stalled;	// how many nanoseconds those inserts took in total
+} Growth;
+
+// the name of each type of table
+static const char *type_names[] = { "linear", "xtndbl1", "cuckoo", "xtndbln",
+	"xuckoo", "xuckoon" };
+
+// nanoseconds elapsed on a monotonic clock since some fixed point
+long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// xorshift64* pseudo-random number generator
+uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+// read every operation captured in the file 'name' into a newly allocated
+// array, storing the number of operations in *n
+CaptureRecord *read_capture(char *name, long *n) {
+	FILE *file = fopen(name, "rb");
+	if (file == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	CaptureReader *reader = new_capture_reader(file);
+	if (reader == NULL) {
+		fprintf(stderr, "%s is not a capture file\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	long size = 1024, i = 0;
+	CaptureRecord *ops = malloc(sizeof(CaptureRecord) * size);
+	assert(ops);
+	while (capture_read(reader, &ops[i])) {
+		i++;
+		if (i == size) {
+			size *= 2;
+			ops = realloc(ops, sizeof(CaptureRecord) * size);
+			assert(ops);
+		}
+	}
+	free_capture_reader(reader);
+	fclose(file);
+	*n = i;
+	return ops;
+}
+
+// fill 'ops' with 'n' random inserts and lookups of keys from 'keyspace',
+// 'lookups' percent of them lookups
+void generate_ops(CaptureRecord *ops, long n, long keyspace, int lookups,
+		uint64_t *state) {
+	long i;
+	for (i = 0; i < n; i++) {
+		ops[i].op = (long)(next_random(state) % 100) < lookups
+			? CAPTURE_LOOKUP : CAPTURE_INSERT;
+		ops[i].key = next_random(state) % keyspace;
+		ops[i].arg = 0;
+	}
+}
+
+// perform operation 'op' on 'table'
+void perform(HashTable *table, const CaptureRecord *op) {
+	switch (op->op) {
+		case CAPTURE_INSERT:
+			hash_table_insert(table, op->key);
+			break;
+		case CAPTURE_LOOKUP:
+			hash_table_lookup(table, op->key);
+			break;
+		case CAPTURE_INCREMENT:
+			hash_table_increment(table, op->key, op->arg);
+			break;
+		case CAPTURE_ADVANCE:
+			hash_table_advance(table, op->key);
+			break;
+	}
+}
+
+int compare_ns(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+// issue the 'n' operations in 'ops' to 'table' at 'rate' per second,
+// recording how long each one took
+void run_step(HashTable *table, const CaptureRecord *ops, long n, long rate,
+		Step *step) {
+	step->rate = rate;
+	step->n = n;
+	step->latencies = malloc(sizeof(long long) * (n > 0 ? n : 1));
+	step->services = malloc(sizeof(long long) * (n > 0 ? n : 1));
+	assert(step->latencies && step->services);
+
+	double interval = 1e9 / rate;
+	long long start = now_ns();
+	long long end = start;
+	long i;
+	for (i = 0; i < n; i++) {
+		long long due = start + (long long)(i * interval);
+
+		// wait until this operation is due: sleep through most of a long
+		// wait, but spin through short ones, since sleeps overshoot
+		long long now, wait;
+		while ((wait = due - (now = now_ns())) > 0) {
+			if (wait > SPIN_NS) {
+				wait -= SPIN_NS / 2;
+				struct timespec ts = { wait / 1000000000LL,
+					wait % 1000000000LL };
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		perform(table, &ops[i]);
+		end = now_ns();
+		step->latencies[i] = end - due;
+		step->services[i] = end - now;
+	}
+
+	double seconds = (end - start) * 1e-9;
+	step->achieved = seconds > 0 ? n / seconds : 0;
+	qsort(step->latencies, n, sizeof(long long), compare_ns);
+	qsort(step->services, n, sizeof(long long), compare_ns);
+}
+
+// the 'q'th quantile of the 'n' sorted values in 'values', in microseconds
+double quantile_us(const long long *values, long n, double q) {
+	if (n == 0) {
+		return 0;
+	}
+	return values[(long)(q * (n - 1))] / 1000.0;
+}
+
+// the average nanoseconds per operation since 'start', over 'n' operations
+double ns_per_op(long long start, long n) {
+	return n > 0 ? (double)(now_ns() - start) / n : 0;
+}
+
+// look up keys from 'probes' in 'table' with 'lookup' until SWEEP_LOOKUPS
+// of them have been looked up or SWEEP_SECONDS have passed, storing how many
+// were looked up in *n and how many of those were found in *found
+// returns the average nanoseconds per lookup
+double time_lookups(HashTable *table, bool (*lookup)(HashTable *, int64),
+		const int64 *probes, long *n, long *found) {
+	long long start = now_ns();
+	long long limit = start + SWEEP_SECONDS * 1e9;
+	*found = 0;
+	long i = 0;
+	do {
+		// only check the clock once per round of lookups
+		long end = i + SWEEP_ROUND;
+		for (; i < end; i++) {
+			*found += lookup(table, probes[i]);
+		}
+	} while (i < SWEEP_LOOKUPS && now_ns() < limit);
+	*n = i;
+	return ns_per_op(start, i);
+}
+
+// as time_lookups, but looking up a round of keys at a time with
+// hash_table_lookup_mask
+double time_mask_lookups(HashTable *table, const int64 *probes, long *n,
+		long *found) {
+	uint64_t words[SWEEP_ROUND / 64];
+	long long start = now_ns();
+	long long limit = start + SWEEP_SECONDS * 1e9;
+	*found = 0;
+	long i = 0;
+	do {
+		hash_table_lookup_mask(table, probes + i, SWEEP_ROUND, words);
+		int w;
+		for (w = 0; w < SWEEP_ROUND / 64; w++) {
+			*found += __builtin_popcountll(words[w]);
+		}
+		i += SWEEP_ROUND;
+	} while (i < SWEEP_LOOKUPS && now_ns() < limit);
+	*n = i;
+	return ns_per_op(start, i);
+}
+
+// time inserts, hits and misses (one at a time, branchlessly, and a round at
+// a time as bitmasks) in a table of type 'type' holding 'nkeys' keys,
+// storing the average nanoseconds per operation of each workload in 'ns'
+// (indexed by Workload)
+void measure(TableType type, int size, long nkeys, double ns[NWORKLOADS]) {
+	const char *name = type_names[type];
+	int64 *keys = malloc(sizeof(int64) * nkeys);
+	int64 *probes = malloc(sizeof(int64) * SWEEP_LOOKUPS);
+	assert(keys && probes);
+	uint64_t state = 0x9e3779b97f4a7c15ULL ^ nkeys;
+
+	// random keys are distinct with overwhelming probability
+	long i;
+	for (i = 0; i < nkeys; i++) {
+		keys[i] = next_random(&state);
+	}
+	HashTable *table = new_hash_table(type, size);
+	assert(table);
+	long long start = now_ns();
+	for (i = 0; i < nkeys; i++) {
+		hash_table_insert(table, keys[i]);
+	}
+	ns[INSERTS] = ns_per_op(start, nkeys);
+
+	// hits: keys chosen at random from those inserted
+	for (i = 0; i < SWEEP_LOOKUPS; i++) {
+		probes[i] = keys[next_random(&state) % nkeys];
+	}
+	long nhits, nfound;
+	ns[HITS] = time_lookups(table, hash_table_lookup, probes, &nhits,
+		&nfound);
+	if (nfound != nhits) {
+		fprintf(stderr, "%s: only %ld of %ld hits were found\n", name,
+			nfound, nhits);
+	}
+	ns[BL_HITS] = time_lookups(table, hash_table_lookup_branchless, probes,
+		&nhits, &nfound);
+	if (nfound != nhits) {
+		fprintf(stderr, "%s: only %ld of %ld branchless hits were found\n",
+			name, nfound, nhits);
+	}
+	ns[MASK_HITS] = time_mask_lookups(table, probes, &nhits, &nfound);
+	if (nfound != nhits) {
+		fprintf(stderr, "%s: only %ld of %ld mask hits were found\n", name,
+			nfound, nhits);
+	}
+
+	// misses: fresh random keys
+	for (i = 0; i < SWEEP_LOOKUPS; i++) {
+		probes[i] = next_random(&state);
+	}
+	long nmisses;
+	ns[MISSES] = time_lookups(table, hash_table_lookup, probes, &nmisses,
+		&nfound);
+	if (nfound != 0) {
+		fprintf(stderr, "%s: %ld of %ld misses were found\n", name,
+			nfound, nmisses);
+	}
+	ns[BL_MISSES] = time_lookups(table, hash_table_lookup_branchless, probes,
+		&nmisses, &nfound);
+	if (nfound != 0) {
+		fprintf(stderr, "%s: %ld of %ld branchless misses were found\n",
+			name, nfound, nmisses);
+	}
+	ns[MASK_MISSES] = time_mask_lookups(table, probes, &nmisses, &nfound);
+	if (nfound != 0) {
+		fprintf(stderr, "%s: %ld of %ld mask misses were found\n", name,
+			nfound, nmisses);
+	}
+
+	free_hash_table(table);
+	free(keys);
+	free(probes);
+}
+
+// time a table of type 'type' holding 'nkeys' keys, printing a row of
+// results
+void sweep_point(TableType type, int size, long nkeys) {
+	double ns[NWORKLOADS];
+	measure(type, size, nkeys, ns);
+	printf("%8s %10ld %10ld %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f "
+		"%10.1f\n", type_names[type], nkeys,
+		nkeys * (long)sizeof(int64) / 1024, ns[INSERTS], ns[HITS], ns[MISSES],
+		ns[BL_HITS], ns[BL_MISSES], ns[MASK_HITS], ns[MASK_MISSES]);
+	fflush(stdout);
+}
+
+// sweep a table of type 'type' through each number of keys from
+// SWEEP_MIN_KEYS to 'maxkeys'. each point runs in a child process of its
+// own, so that a table giving up (e.g. an extendible table whose directory
+// hits its size limit) ends only its own part of the sweep, and every point
+// starts with a fresh heap
+void run_sweep(TableType type, int size, long maxkeys) {
+	long nkeys;
+	for (nkeys = SWEEP_MIN_KEYS; nkeys <= maxkeys; nkeys *= 2) {
+		fflush(stdout);
+		pid_t child = fork();
+		if (child < 0) {
+			perror("fork");
+			exit(EXIT_FAILURE);
+		}
+		if (child == 0) {
+			sweep_point(type, size, nkeys);
+			exit(EXIT_SUCCESS);
+		}
+
+		int status;
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+			printf("%8s %10ld %10ld %10s %10s %10s %10s %10s %10s %10s\n",
+				type_names[type], nkeys, nkeys * (long)sizeof(int64) / 1024,
+				"failed", "-", "-", "-", "-", "-", "-");
+			return;
+		}
+	}
+}
+
+// insert 'nkeys' random keys into an empty table of type 'type', printing
+// the throughput and slowest insert of each window, and storing a summary
+// in *growth
+void grow(TableType type, int size, long nkeys, Growth *growth) {
+	HashTable *table = new_hash_table(type, size);
+	assert(table);
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	growth->worst = 0;
+	growth->worst_at = 0;
+	growth->nstalls = 0;
+	growth->stalled = 0;
+
+	long long total = 0, window = 0, window_worst = 0;
+	long i;
+	for (i = 0; i < nkeys; i++) {
+		int64 key = next_random(&state);
+		long long start = now_ns();
+		hash_table_insert(table, key);
+		long long took = now_ns() - start;
+
+		total += took;
+		window += took;
+		if (took > window_worst) {
+			window_worst = took;
+		}
+		if (took > growth->worst) {
+			growth->worst = took;
+			growth->worst_at = i;
+		}
+		if (took > STALL_NS) {
+			growth->nstalls++;
+			growth->stalled += took;
+		}
+
+		// print a row at the end of each window (and of the run)
+		if ((i + 1) % GROWTH_WINDOW == 0 || i + 1 == nkeys) {
+			long ninserts = i % GROWTH_WINDOW + 1;
+			printf("%8s %10ld %12.3f %12.0f %12.1f\n", type_names[type], i + 1,
+				total / 1e6, window > 0 ? ninserts * 1e9 / window : 0,
+				window_worst / 1e3);
+			window = 0;
+			window_worst = 0;
+		}
+	}
+	growth->seconds = total / 1e9;
+	free_hash_table(table);
+}
+
+// run growths of 'nkeys' keys for table type 'type' (or every type, if it is
+// NOTYPE), printing their time series and then a summary of each. each runs
+// in a child process of its own, which passes its summary back through a
+// pipe, so that a table giving up ends only its own run
+void run_growths(TableType only, int size, long nkeys) {
+	Growth growths[XUCKOON + 1];
+	bool finished[XUCKOON + 1] = { false };
+
+	printf("%8s %10s %12s %12s %12s\n", "type", "keys", "elapsed ms",
+		"inserts/s", "slowest us");
+	TableType type;
+	for (type = LINEAR; type <= XUCKOON; type++) {
+		if (only != NOTYPE && type != only) {
+			continue;
+		}
+		int fds[2];
+		if (pipe(fds) != 0) {
+			perror("pipe");
+			exit(EXIT_FAILURE);
+		}
+		fflush(stdout);
+		pid_t child = fork();
+		if (child < 0) {
+			perror("fork");
+			exit(EXIT_FAILURE);
+		}
+		if (child == 0) {
+			close(fds[0]);
+			Growth growth;
+			grow(type, size, nkeys, &growth);
+			fflush(stdout);
+			bool sent = write(fds[1], &growth, sizeof growth) == sizeof growth;
+			exit(sent ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+
+		close(fds[1]);
+		finished[type] = read(fds[0], &growths[type], sizeof(Growth))
+			== sizeof(Growth);
+		close(fds[0]);
+		waitpid(child, NULL, 0);
+	}
+
+	printf("\n%8s %10s %12s %12s %12s %10s %12s\n", "type", "keys",
+		"total ms", "inserts/s", "worst us", "worst at", "stalled ms");
+	for (type = LINEAR; type <= XUCKOON; type++) {
+		if (only != NOTYPE && type != only) {
+			continue;
+		}
+		if (!finished[type]) {
+			printf("%8s %10ld %12s\n", type_names[type], nkeys, "failed");
+			continue;
+		}
+		Growth *growth = &growths[type];
+		printf("%8s %10ld %12.3f %12.0f %12.1f %10ld %12.3f\n",
+			type_names[type], nkeys, growth->seconds * 1e3,
+			growth->seconds > 0 ? nkeys / growth->seconds : 0,
+			growth->worst / 1e3, growth->worst_at, growth->stalled / 1e6);
+	}
+}
+
+// store a description of this machine in 'machine': its host name and how
+// many CPUs it has online
+void describe_machine(char *machine) {
+	struct utsname host;
+	const char *hostname = uname(&host) == 0 ? host.nodename : "unknown";
+	snprintf(machine, RESULT_FIELD_LEN, "%.40s/%ldcpu", hostname,
+		sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+// run the regression suite: measure each type of table (or just 'only', if
+// it isn't NOTYPE) 'reps' times over, adding a result for each workload of
+// each repetition to 'results'. each repetition of each type runs in a child
+// process of its own, which passes its measurements back through a pipe, so
+// that a table giving up loses only that repetition
+void run_suite(TableType only, int size, long nkeys, int reps,
+		const char *label, ResultSet *results) {
+	Result result;
+	snprintf(result.label, RESULT_FIELD_LEN, "%s", label);
+	describe_machine(result.machine);
+	snprintf(result.config, RESULT_FIELD_LEN, "keys=%ld;size=%d", nkeys, size);
+
+	int rep;
+	for (rep = 0; rep < reps; rep++) {
+		TableType type;
+		for (type = LINEAR; type <= XUCKOON; type++) {
+			if (only != NOTYPE && type != only) {
+				continue;
+			}
+			int fds[2];
+			if (pipe(fds) != 0) {
+				perror("pipe");
+				exit(EXIT_FAILURE);
+			}
+			fflush(stdout);
+			pid_t child = fork();
+			if (child < 0) {
+				perror("fork");
+				exit(EXIT_FAILURE);
+			}
+			if (child == 0) {
+				close(fds[0]);
+				double ns[NWORKLOADS];
+				measure(type, size, nkeys, ns);
+				bool sent = write(fds[1], ns, sizeof ns) == sizeof ns;
+				exit(sent ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+
+			close(fds[1]);
+			double ns[NWORKLOADS];
+			bool finished = read(fds[0], ns, sizeof ns) == sizeof ns;
+			close(fds[0]);
+			waitpid(child, NULL, 0);
+			if (!finished) {
+				fprintf(stderr, "%s: repetition %d failed\n", type_names[type],
+					rep);
+				continue;
+			}
+
+			snprintf(result.type, RESULT_FIELD_LEN, "%s", type_names[type]);
+			result.rep = rep;
+			Workload workload;
+			for (workload = 0; workload < NWORKLOADS; workload++) {
+				snprintf(result.workload, RESULT_FIELD_LEN, "%s",
+					workload_names[workload]);
+				result.value = ns[workload];
+				result_set_add(results, &result);
+			}
+		}
+	}
+}
+
+// run the regression suite as 'options' says, storing and comparing its
+// results
+// returns bench's exit status: EXIT_REGRESSION if anything got worse
+int suite(Options *options) {
+	char label[RESULT_FIELD_LEN];
+	if (options->label) {
+		snprintf(label, sizeof label, "%s", options->label);
+	} else {
+		time_t now = time(NULL);
+		strftime(label, sizeof label, "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	}
+
+	ResultSet results;
+	result_set_init(&results);
+	run_suite(options->all ? NOTYPE : options->type, options->initial_size,
+		options->keys_given ? options->keyspace : SUITE_KEYS, options->reps,
+		label, &results);
+
+	// read the baseline before storing this run, since the store may well
+	// be the baseline too. it is compared against as it was the last time
+	// this suite ran on this machine with this config (or if there is no
+	// baseline, this run is just summarised)
+	ResultSet baseline;
+	result_set_init(&baseline);
+	if (options->baseline) {
+		FILE *file = fopen(options->baseline, "r");
+		if (file == NULL) {
+			perror(options->baseline);
+			exit(EXIT_FAILURE);
+		}
+		result_set_read_csv(&baseline, file);
+		fclose(file);
+		const char *last = results.nresults > 0
+			? result_set_last_label(&baseline, &results.results[0]) : NULL;
+		result_set_keep_label(&baseline, last ? last : "");
+		if (last) {
+			printf("baseline: %s\n", baseline.results[0].label);
+		}
+	}
+
+	if (options->store) {
+		FILE *store = fopen(options->store, "a");
+		if (store == NULL) {
+			perror(options->store);
+			exit(EXIT_FAILURE);
+		}
+		// only a new store needs a header
+		result_set_write_csv(&results, store, ftell(store) == 0);
+		fclose(store);
+	}
+
+	int nworse = result_set_compare(&baseline, &results,
+		options->threshold / 100, stdout);
+	if (nworse > 0) {
+		printf("%d regression%s\n", nworse, nworse == 1 ? "" : "s");
+	}
+
+	result_set_free(&baseline);
+	result_set_free(&results);
+	return nworse > 0 ? EXIT_REGRESSION : 0;
+}
+
+int main(int argc, char **argv) {
+	Options options = get_options(argc, argv);
+
+	if (options.reps > 0) {
+		return suite(&options);
+	}
+
+	if (options.sweep > 0) {
+		printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "type",
+			"keys", "key KB", "insert ns", "hit ns", "miss ns", "blhit ns",
+			"blmiss ns", "mhit ns", "mmiss ns");
+		TableType type;
+		for (type = LINEAR; type <= XUCKOON; type++) {
+			if (options.all || type == options.type) {
+				run_sweep(type, options.initial_size, options.sweep);
+			}
+		}
+		return 0;
+	}
+
+	if (options.growth > 0) {
+		run_growths(options.all ? NOTYPE : options.type,
+			options.initial_size, options.growth);
+		return 0;
+	}
+
+	long ncaptured = 0;
+	CaptureRecord *captured = NULL;
+	if (options.capture) {
+		captured = read_capture(options.capture, &ncaptured);
+		if (ncaptured == 0) {
+			fprintf(stderr, "%s holds no operations\n", options.capture);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("%12s %12s %10s %10s %10s %10s %10s\n", "offered/s", "achieved/s",
+		"p50 us", "p99 us", "p99.9 us", "max us", "svc p99 us");
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	int r;
+	for (r = 0; r < options.nrates; r++) {
+		long rate = options.rates[r];
+		long n = rate * options.seconds;
+		CaptureRecord *ops = malloc(sizeof(CaptureRecord) * (n > 0 ? n : 1));
+		assert(ops);
+
+		// prepare this step's table and operations before timing anything
+		HashTable *table = new_hash_table(options.type, options.initial_size);
+		assert(table);
+		if (options.front > 0) {
+			hash_table_front(table, options.front);
+		}
+		if (options.buffer > 0 && !hash_table_set_buffer(table,
+				options.buffer)) {
+			fprintf(stderr, "this table type does not support -b\n");
+			exit(EXIT_FAILURE);
+		}
+		long i;
+		if (captured) {
+			for (i = 0; i < n; i++) {
+				ops[i] = captured[i % ncaptured];
+			}
+		} else {
+			for (i = 0; i < options.keyspace / 2; i++) {
+				hash_table_insert(table, next_random(&state) % options.keyspace);
+			}
+			generate_ops(ops, n, options.keyspace, options.lookups, &state);
+		}
+
+		Step step;
+		run_step(table, ops, n, rate, &step);
+		printf("%12ld %12.0f %10.2f %10.2f %10.2f %10.2f %10.2f\n", step.rate,
+			step.achieved, quantile_us(step.latencies, n, 0.5),
+			quantile_us(step.latencies, n, 0.99),
+			quantile_us(step.latencies, n, 0.999),
+			quantile_us(step.latencies, n, 1),
+			quantile_us(step.services, n, 0.99));
+		fflush(stdout);
+
+		free(step.latencies);
+		free(step.services);
+		free_hash_table(table);
+		free(ops);
+	}
+
+	free(captured);
+	return 0;
+}
+
+// parse a comma-separated list of rates from 'list' into 'options'
+// returns false if any of them is invalid
+bool parse_rates(char *list, Options *options) {
+	options->nrates = 0;
+	char *rate = strtok(list, ",");
+	while (rate != NULL) {
+		if (options->nrates == MAX_RATES || atol(rate) <= 0) {
+			return false;
+		}
+		options->rates[options->nrates++] = atol(rate);
+		rate = strtok(NULL, ",");
+	}
+	return options->nrates > 0;
+}
+
+// scans command line arguments for program options,
+// prints usage info and exits if commands are missing or otherwise invalid
+Options get_options(int argc, char **argv) {
+	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE,
+		.nrates = 0, .seconds = 1, .lookups = 90, .keyspace = 1000000,
+		.capture = NULL, .front = 0, .buffer = 0, .sweep = 0, .growth = 0,
+		.all = false, .keys_given = false, .reps = 0, .store = NULL,
+		.label = NULL, .baseline = NULL, .threshold = DEFAULT_THRESHOLD };
+	static char default_rates[] = DEFAULT_RATES;
+	char *rates = default_rates;
+
+	int option;
+	while ((option = getopt(argc, argv, "t:s:r:d:l:k:f:b:w:g:n:o:L:B:T:")) != -1) {
+		switch (option) {
+			case 't': // set hash table type
+				options.type = strtotype(optarg);
+				options.all = strcmp(optarg, "all") == 0;
+				break;
+			case 's': // set hash table size
+				options.initial_size = atoi(optarg);
+				break;
+			case 'r': // set rates to sweep through
+				rates = optarg;
+				break;
+			case 'd': // set duration of each step
+				options.seconds = atof(optarg);
+				break;
+			case 'l': // set percentage of lookups
+				options.lookups = atoi(optarg);
+				break;
+			case 'k': // set size of keyspace
+				options.keyspace = atol(optarg);
+				options.keys_given = true;
+				break;
+			case 'f': // put a front cache in front of the table
+				options.front = atoi(optarg);
+				break;
+			case 'b': // buffer inserts into the table
+				options.buffer = atoi(optarg);
+				break;
+			case 'w': // sweep table sizes up to this many keys
+				options.sweep = atol(optarg);
+				break;
+			case 'g': // time the growth of a table to this many keys
+				options.growth = atol(optarg);
+				break;
+			case 'n': // run the regression suite this many times over
+				options.reps = atoi(optarg);
+				break;
+			case 'o': // append the suite's results to this store
+				options.store = optarg;
+				break;
+			case 'L': // label this run in the store
+				options.label = optarg;
+				break;
+			case 'B': // compare the suite's results against this baseline
+				options.baseline = optarg;
+				break;
+			case 'T': // set smallest change to flag
+				options.threshold = atof(optarg);
+				break;
+			default:
+				break;
+		}
+	}
+	if (optind < argc) {
+		options.capture = argv[optind++];
+	}
+
+	bool valid = parse_rates(rates, &options);
+	valid = valid && (options.type != NOTYPE
+		|| (options.all && (options.sweep > 0 || options.growth > 0
+			|| options.reps > 0)));
+	valid = valid && (options.sweep == 0 || options.sweep >= SWEEP_MIN_KEYS);
+	valid = valid && options.growth >= 0;
+	valid = valid && options.reps >= 0 && options.threshold >= 0;
+	// the label is a CSV field, so mustn't contain a comma
+	valid = valid && (options.label == NULL
+		|| strchr(options.label, ',') == NULL);
+	if (!valid || options.initial_size <= 0
+			|| options.seconds <= 0 || options.lookups < 0
+			|| options.lookups > 100 || options.keyspace <= 0
+			|| options.front < 0 || options.buffer < 0) {
+		fprintf(stderr, "usage: %s -t type [-s size] [-r rates] [-d seconds] "
+			"[-l percent] [-k keyspace] [-f cachekeys] [-b bufferkeys] "
+			"[capturefile]\n", argv[0]);
+		fprintf(stderr, "   or: %s -t type|all [-s size] -w maxkeys\n",
+			argv[0]);
+		fprintf(stderr, "   or: %s -t type|all [-s size] -g nkeys\n",
+			argv[0]);
+		fprintf(stderr, "   or: %s -t type|all [-s size] [-k keyspace] -n reps "
+			"[-o store] [-L label] [-B baseline] [-T percent]\n", argv[0]);
+		fprintf(stderr, " type: linear, xtndbl1, cuckoo, xtndbln, xuckoo "
+			"or xuckoon\n");
+		fprintf(stderr, " size: initial table size (>0)\n");
+		fprintf(stderr, " rates: comma-separated operations per second to "
+			"offer\n");
+		fprintf(stderr, " seconds: how long to offer each rate for\n");
+		fprintf(stderr, " percent: percentage of operations that are lookups\n");
+		fprintf(stderr, " keyspace: how many distinct keys to use (with -n, "
+			"default %d)\n", SUITE_KEYS);
+		fprintf(stderr, " cachekeys: keys in a front cache before the table\n");
+		fprintf(stderr, " bufferkeys: inserts to buffer before merging them "
+			"(xtndbln)\n");
+		fprintf(stderr, " capturefile: operations captured by a2 -w to issue "
+			"instead\n");
+		fprintf(stderr, " maxkeys: sweep table sizes from %d keys up to this "
+			"many\n", SWEEP_MIN_KEYS);
+		fprintf(stderr, " nkeys: time the growth of a table to this many "
+			"keys\n");
+		fprintf(stderr, " reps: run the regression suite this many times "
+			"over\n");
+		fprintf(stderr, " store: CSV file to append the suite's results to\n");
+		fprintf(stderr, " label: what to call this run in the store (no "
+			"commas)\n");
+		fprintf(stderr, " baseline: CSV file of results to compare against\n");
+		fprintf(stderr, " percent: smallest change in a mean to flag "
+			"(default %d)\n", DEFAULT_THRESHOLD);
+		exit(EXIT_FAILURE);
+	}
+
+	return options;
+}
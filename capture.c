@@ -0,0 +1,329 @@
+/* * * * * * * * *
+ * Capture and replay of the operations performed on a hash table
+ *
+ * a capture file starts with an 8 byte magic string and a byte of flags,
+ * followed by one record per operation:
+ *   - a tag byte: the operation in its low 2 bits, and the result plus 1 in
+ *     its high 6 bits (or 0 there if the result is too big, in which case it
+ *     follows as a varint)
+ *   - the zigzag-encoded difference between this key and the last, as a
+ *     varint (so runs of nearby keys take a byte or two each)
+ *   - the argument, as a varint (increments only)
+ *   - the nanoseconds since the previous record, as a varint (timed
+ *     captures only)
+ * where a varint is 7 bits per byte, least significant first, with the top
+ * bit set on every byte but the last
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "capture.h"
+
+// the magic string every capture file starts with
+#define CAPTURE_MAGIC "HTCAPT01"
+#define MAGIC_LEN 8
+// flags in the header
+#define FLAG_TIMED 1
+// how many bytes of records to gather before handing them off to be written
+#define CAPTURE_BUFFER (1 << 20)
+// the most bytes a single record can take up
+#define MAX_RECORD 32
+// results up to this size fit in the tag byte
+#define MAX_INLINE_RESULT 62
+
+struct capture {
+	FILE *file;
+	bool timed;
+	unsigned char *buffers[2];	// one filling up while the other is written
+	int current;				// which buffer is filling up
+	size_t used;				// how many bytes of it are used
+	int64 last_key;				// the key of the previous record
+	long long epoch;			// when the capture began
+	long long last_time;		// the time of the previous record
+	long long nrecords;			// how many records have been made
+
+	// handing full buffers to the flusher thread
+	pthread_t flusher;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;		// signalled when 'pending' changes
+	unsigned char *pending;		// a full buffer waiting to be written
+	size_t npending;			// how many bytes of it to write
+	bool stopping;				// should the flusher exit once idle?
+};
+
+struct capture_reader {
+	FILE *file;
+	bool timed;
+	int64 last_key;
+	long long last_time;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// nanoseconds elapsed on a monotonic clock since some fixed point
+static long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// write 'value' as a varint at 'out'
+// returns the number of bytes written
+static int put_varint(unsigned char *out, uint64_t value) {
+	int n = 0;
+	while (value >= 0x80) {
+		out[n++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	out[n++] = value;
+	return n;
+}
+
+// read a varint from 'file' into *value
+// returns false if the file ends first
+static bool get_varint(FILE *file, uint64_t *value) {
+	*value = 0;
+	int shift;
+	for (shift = 0; shift < 64; shift += 7) {
+		int byte = getc(file);
+		if (byte == EOF) {
+			return false;
+		}
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// flusher thread: write out each buffer handed over until told to stop
+static void *flush_buffers(void *arg) {
+	Capture *capture = arg;
+	pthread_mutex_lock(&capture->lock);
+	while (true) {
+		while (capture->pending == NULL && !capture->stopping) {
+			pthread_cond_wait(&capture->changed, &capture->lock);
+		}
+		if (capture->pending == NULL) {
+			break;
+		}
+
+		// write without holding the lock, so that recording can carry on
+		unsigned char *buffer = capture->pending;
+		size_t nbytes = capture->npending;
+		pthread_mutex_unlock(&capture->lock);
+		fwrite(buffer, 1, nbytes, capture->file);
+		pthread_mutex_lock(&capture->lock);
+
+		capture->pending = NULL;
+		pthread_cond_signal(&capture->changed);
+	}
+	pthread_mutex_unlock(&capture->lock);
+	return NULL;
+}
+
+// hand the current buffer of 'capture' to the flusher thread (waiting for it
+// to finish with the previous one, if need be) and start on the other one
+static void hand_off(Capture *capture) {
+	pthread_mutex_lock(&capture->lock);
+	while (capture->pending != NULL) {
+		pthread_cond_wait(&capture->changed, &capture->lock);
+	}
+	capture->pending = capture->buffers[capture->current];
+	capture->npending = capture->used;
+	pthread_cond_signal(&capture->changed);
+	pthread_mutex_unlock(&capture->lock);
+
+	capture->current = 1 - capture->current;
+	capture->used = 0;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// start capturing operations to 'file', recording when each one happened if
+// 'timestamps' is true
+Capture *new_capture(FILE *file, bool timestamps) {
+	assert(file);
+	Capture *capture = malloc(sizeof *capture);
+	assert(capture);
+	capture->file = file;
+	capture->timed = timestamps;
+	capture->buffers[0] = malloc(CAPTURE_BUFFER);
+	capture->buffers[1] = malloc(CAPTURE_BUFFER);
+	assert(capture->buffers[0] && capture->buffers[1]);
+	capture->current = 0;
+	capture->used = 0;
+	capture->last_key = 0;
+	capture->epoch = now_ns();
+	capture->last_time = 0;
+	capture->nrecords = 0;
+
+	capture->pending = NULL;
+	capture->npending = 0;
+	capture->stopping = false;
+	pthread_mutex_init(&capture->lock, NULL);
+	pthread_cond_init(&capture->changed, NULL);
+	int error = pthread_create(&capture->flusher, NULL, flush_buffers,
+		capture);
+	assert(error == 0 && "error: couldn't start capture flusher");
+
+	// the header goes at the start of the first buffer
+	memcpy(capture->buffers[0], CAPTURE_MAGIC, MAGIC_LEN);
+	capture->buffers[0][MAGIC_LEN] = timestamps ? FLAG_TIMED : 0;
+	capture->used = MAGIC_LEN + 1;
+	return capture;
+}
+
+// write out any operations still buffered, and free all memory associated
+// with 'capture' (but leave its file open)
+void free_capture(Capture *capture) {
+	assert(capture);
+	if (capture->used > 0) {
+		hand_off(capture);
+	}
+
+	// let the flusher finish writing, then stop it
+	pthread_mutex_lock(&capture->lock);
+	capture->stopping = true;
+	pthread_cond_signal(&capture->changed);
+	pthread_mutex_unlock(&capture->lock);
+	pthread_join(capture->flusher, NULL);
+	fflush(capture->file);
+
+	pthread_mutex_destroy(&capture->lock);
+	pthread_cond_destroy(&capture->changed);
+	free(capture->buffers[0]);
+	free(capture->buffers[1]);
+	free(capture);
+}
+
+// record operation 'op' on 'key' with argument 'arg' and result 'result'
+void capture_record(Capture *capture, CaptureOp op, int64 key, uint32_t arg,
+		uint32_t result) {
+	assert(capture);
+	if (capture->used + MAX_RECORD > CAPTURE_BUFFER) {
+		hand_off(capture);
+	}
+	unsigned char *out = capture->buffers[capture->current] + capture->used;
+	int n = 0;
+
+	// tag, with the result inline if it's small enough
+	if (result <= MAX_INLINE_RESULT) {
+		out[n++] = op | (result + 1) << 2;
+	} else {
+		out[n++] = op;
+		n += put_varint(out + n, result);
+	}
+
+	// key, as a zigzag-encoded difference from the last key
+	uint64_t diff = key - capture->last_key;
+	n += put_varint(out + n, diff << 1 ^ (uint64_t)((int64_t)diff >> 63));
+	capture->last_key = key;
+
+	if (op == CAPTURE_INCREMENT) {
+		n += put_varint(out + n, arg);
+	}
+	if (capture->timed) {
+		long long time = now_ns() - capture->epoch;
+		n += put_varint(out + n, time - capture->last_time);
+		capture->last_time = time;
+	}
+
+	capture->used += n;
+	capture->nrecords++;
+}
+
+// how many operations have been recorded by 'capture'
+long long capture_count(Capture *capture) {
+	assert(capture);
+	return capture->nrecords;
+}
+
+// start reading the operations captured in 'file'
+// returns NULL if 'file' doesn't start with a capture header
+CaptureReader *new_capture_reader(FILE *file) {
+	assert(file);
+	char header[MAGIC_LEN + 1];
+	if (fread(header, 1, MAGIC_LEN + 1, file) != MAGIC_LEN + 1
+			|| memcmp(header, CAPTURE_MAGIC, MAGIC_LEN) != 0) {
+		return NULL;
+	}
+	CaptureReader *reader = malloc(sizeof *reader);
+	assert(reader);
+	reader->file = file;
+	reader->timed = header[MAGIC_LEN] & FLAG_TIMED;
+	reader->last_key = 0;
+	reader->last_time = 0;
+	return reader;
+}
+
+// free all memory associated with 'reader' (but leave its file open)
+void free_capture_reader(CaptureReader *reader) {
+	assert(reader);
+	free(reader);
+}
+
+// does the capture being read by 'reader' have timestamps?
+bool capture_reader_timed(CaptureReader *reader) {
+	assert(reader);
+	return reader->timed;
+}
+
+// read the next operation from 'reader' into *record
+// returns false at the end of the capture
+bool capture_read(CaptureReader *reader, CaptureRecord *record) {
+	assert(reader);
+	int tag = getc(reader->file);
+	if (tag == EOF) {
+		return false;
+	}
+	record->op = tag & 3;
+
+	uint64_t value;
+	if (tag >> 2 == 0) {
+		if (!get_varint(reader->file, &value)) {
+			return false;
+		}
+		record->result = value;
+	} else {
+		record->result = (tag >> 2) - 1;
+	}
+
+	if (!get_varint(reader->file, &value)) {
+		return false;
+	}
+	uint64_t diff = value >> 1 ^ -(value & 1);
+	reader->last_key += diff;
+	record->key = reader->last_key;
+
+	record->arg = 0;
+	if (record->op == CAPTURE_INCREMENT) {
+		if (!get_varint(reader->file, &value)) {
+			return false;
+		}
+		record->arg = value;
+	}
+
+	record->time = 0;
+	if (reader->timed) {
+		if (!get_varint(reader->file, &value)) {
+			return false;
+		}
+		reader->last_time += value;
+		record->time = reader->last_time;
+	}
+	return true;
+}
@@ -0,0 +1,72 @@
+/* * * * * * * * *
+ * Capture and replay of the operations performed on a hash table
+ *
+ * a capture logs each operation (what it was, its key and argument, the
+ * result the table gave, and optionally when it happened) to a compact
+ * binary file: keys are stored as the difference from the previous key and
+ * every number is a variable-length integer, so most records take only a
+ * few bytes. records are gathered in a buffer, and full buffers are written
+ * out by a background thread while the next one fills up
+ *
+ * a capture is not shared between threads: each table being captured (and
+ * so each thread using a table) has a capture and buffers of its own
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "inthash.h"
+
+// the operations a capture can record
+typedef enum capture_op {
+	CAPTURE_INSERT,		// insert 'key' (result: was it newly inserted)
+	CAPTURE_LOOKUP,		// look up 'key' (result: was it found)
+	CAPTURE_INCREMENT,	// add 'arg' to the count of 'key' (result: new count)
+	CAPTURE_ADVANCE		// advance the clock to tick 'key' (result: unused)
+} CaptureOp;
+
+// a single recorded operation
+typedef struct capture_record {
+	CaptureOp op;
+	int64 key;
+	uint32_t arg;		// the operation's argument, if it has one (else 0)
+	uint32_t result;	// what the table returned
+	long long time;		// nanoseconds since capture began (0 if untimed)
+} CaptureRecord;
+
+typedef struct capture Capture;
+typedef struct capture_reader CaptureReader;
+
+// start capturing operations to 'file', recording when each one happened if
+// 'timestamps' is true
+Capture *new_capture(FILE *file, bool timestamps);
+
+// write out any operations still buffered, and free all memory associated
+// with 'capture' (but leave its file open)
+void free_capture(Capture *capture);
+
+// record operation 'op' on 'key' with argument 'arg' and result 'result'
+void capture_record(Capture *capture, CaptureOp op, int64 key, uint32_t arg,
+	uint32_t result);
+
+// how many operations have been recorded by 'capture'
+long long capture_count(Capture *capture);
+
+// start reading the operations captured in 'file'
+// returns NULL if 'file' doesn't start with a capture header
+CaptureReader *new_capture_reader(FILE *file);
+
+// free all memory associated with 'reader' (but leave its file open)
+void free_capture_reader(CaptureReader *reader);
+
+// does the capture being read by 'reader' have timestamps?
+bool capture_reader_timed(CaptureReader *reader);
+
+// read the next operation from 'reader' into *record
+// returns false at the end of the capture
+bool capture_read(CaptureReader *reader, CaptureRecord *record);
+
+#endif
@@ -0,0 +1,162 @@
+/* * * * * * * * *
+ * Compact arrays of key counters, which start out 8 bits wide and are
+ * promoted to 16 and then 32 bits as soon as any counter overflows, along
+ * with a helper for collecting the most frequent keys
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "counts.h"
+
+
+/* * * *
+ * count arrays
+ */
+
+// the largest count that fits in a counter 'width' bytes wide
+static uint32_t max_count(int width) {
+	return width == 4 ? UINT32_MAX : (1u << (8 * width)) - 1;
+}
+
+// widen every counter in 'array' to 'width' bytes
+static void widen(CountArray *array, int width) {
+	void *counts = malloc((size_t)width * array->size);
+	assert(counts);
+
+	int i;
+	for (i = 0; i < array->size; i++) {
+		uint32_t count = count_array_get(array, i);
+		if (width == 2) {
+			((uint16_t *)counts)[i] = count;
+		} else {
+			((uint32_t *)counts)[i] = count;
+		}
+	}
+
+	free(array->counts);
+	array->counts = counts;
+	array->width = width;
+}
+
+// set up 'array' to hold 'size' zeroed 8-bit counters
+void count_array_init(CountArray *array, int size) {
+	array->counts = calloc(size > 0 ? size : 1, sizeof(uint8_t));
+	assert(array->counts);
+	array->width = 1;
+	array->size = size;
+}
+
+// free the counters held by 'array'
+void count_array_free(CountArray *array) {
+	free(array->counts);
+	array->counts = NULL;
+}
+
+// get the value of counter 'i'
+uint32_t count_array_get(CountArray *array, int i) {
+	switch (array->width) {
+		case 1:
+			return ((uint8_t *)array->counts)[i];
+		case 2:
+			return ((uint16_t *)array->counts)[i];
+		default:
+			return ((uint32_t *)array->counts)[i];
+	}
+}
+
+// set counter 'i' to 'count', widening every counter first if it won't fit
+void count_array_set(CountArray *array, int i, uint32_t count) {
+	if (count > max_count(array->width)) {
+		widen(array, count > max_count(2) ? 4 : 2);
+	}
+	switch (array->width) {
+		case 1:
+			((uint8_t *)array->counts)[i] = count;
+			break;
+		case 2:
+			((uint16_t *)array->counts)[i] = count;
+			break;
+		default:
+			((uint32_t *)array->counts)[i] = count;
+			break;
+	}
+}
+
+// add 'delta' to counter 'i', saturating rather than overflowing 32 bits
+// returns the new value of the counter
+uint32_t count_array_add(CountArray *array, int i, uint32_t delta) {
+	uint32_t count = count_array_get(array, i);
+	count = delta > UINT32_MAX - count ? UINT32_MAX : count + delta;
+	count_array_set(array, i, count);
+	return count;
+}
+
+
+/* * * *
+ * top counts
+ */
+
+// swap entries 'i' and 'j' of 'top'
+static void swap(TopCounts *top, int i, int j) {
+	int64 key = top->keys[i];
+	uint32_t count = top->counts[i];
+	top->keys[i] = top->keys[j];
+	top->counts[i] = top->counts[j];
+	top->keys[j] = key;
+	top->counts[j] = count;
+}
+
+// restore the min-heap property below entry 'i' of the first 'n' entries
+static void sift_down(TopCounts *top, int i, int n) {
+	while (2 * i + 1 < n) {
+		int child = 2 * i + 1;
+		if (child + 1 < n && top->counts[child + 1] < top->counts[child]) {
+			child++;
+		}
+		if (top->counts[i] <= top->counts[child]) {
+			return;
+		}
+		swap(top, i, child);
+		i = child;
+	}
+}
+
+// set up 'top' to keep up to 'k' keys in the caller-provided arrays
+void top_counts_init(TopCounts *top, int64 *keys, uint32_t *counts, int k) {
+	top->keys = keys;
+	top->counts = counts;
+	top->n = 0;
+	top->k = k;
+}
+
+// consider 'key', with count 'count', for a place in 'top'
+void top_counts_offer(TopCounts *top, int64 key, uint32_t count) {
+	if (top->n < top->k) {
+		// still room: add it at the bottom and sift it up into place
+		int i = top->n++;
+		top->keys[i] = key;
+		top->counts[i] = count;
+		while (i > 0 && top->counts[(i - 1) / 2] > top->counts[i]) {
+			swap(top, i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+	} else if (top->k > 0 && count > top->counts[0]) {
+		// beats the smallest count kept: replace it
+		top->keys[0] = key;
+		top->counts[0] = count;
+		sift_down(top, 0, top->n);
+	}
+}
+
+// sort the keys kept by 'top' into descending order of count
+// returns the number of keys kept
+int top_counts_finish(TopCounts *top) {
+	// heapsort: repeatedly move the smallest remaining count to the back
+	int n;
+	for (n = top->n; n > 1; n--) {
+		swap(top, 0, n - 1);
+		sift_down(top, 0, n - 1);
+	}
+	return top->n;
+}
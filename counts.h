@@ -0,0 +1,55 @@
+/* * * * * * * * *
+ * Compact arrays of key counters, which start out 8 bits wide and are
+ * promoted to 16 and then 32 bits as soon as any counter overflows, along
+ * with a helper for collecting the most frequent keys
+ */
+
+#ifndef COUNTS_H
+#define COUNTS_H
+
+#include <stdint.h>
+#include "inthash.h"
+
+// an array of 'size' counters, each 'width' bytes wide
+typedef struct count_array {
+	void *counts;	// the counters themselves
+	int width;		// how many bytes each counter uses right now (1, 2 or 4)
+	int size;		// how many counters there are
+} CountArray;
+
+// set up 'array' to hold 'size' zeroed 8-bit counters
+void count_array_init(CountArray *array, int size);
+
+// free the counters held by 'array'
+void count_array_free(CountArray *array);
+
+// get the value of counter 'i'
+uint32_t count_array_get(CountArray *array, int i);
+
+// set counter 'i' to 'count', widening every counter first if it won't fit
+void count_array_set(CountArray *array, int i, uint32_t count);
+
+// add 'delta' to counter 'i', saturating rather than overflowing 32 bits
+// returns the new value of the counter
+uint32_t count_array_add(CountArray *array, int i, uint32_t delta);
+
+
+// a bounded min-heap keeping the 'k' keys with the highest counts offered
+typedef struct top_counts {
+	int64 *keys;		// caller-provided space for k keys
+	uint32_t *counts;	// caller-provided space for k counts
+	int n;				// how many keys are being kept so far
+	int k;				// how many keys to keep at most
+} TopCounts;
+
+// set up 'top' to keep up to 'k' keys in the caller-provided arrays
+void top_counts_init(TopCounts *top, int64 *keys, uint32_t *counts, int k);
+
+// consider 'key', with count 'count', for a place in 'top'
+void top_counts_offer(TopCounts *top, int64 key, uint32_t count);
+
+// sort the keys kept by 'top' into descending order of count
+// returns the number of keys kept
+int top_counts_finish(TopCounts *top);
+
+#endif
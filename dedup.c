@@ -0,0 +1,516 @@
+/* * * * * * * * *
+ * Utility program that streams a large number of keys through a hash table,
+ * writing out each key only the first time it is seen
+ *
+ * usage:
+ *   make dedup
+ *   ./dedup -t type [-s size] [-c capacity | -m budget] [-b] [-j statsfile]
+ *           [input [output]]
+ *       type:     which hash table to deduplicate with (as for a2)
+ *       size:     initial size of the hash table
+ *       capacity: bound the table to this many keys, evicting old ones
+ *                 (so a key may be written again once it has been evicted)
+ *       budget:   hold at most this many keys in memory, spilling the rest
+ *                 to temporary run files which are deduplicated at the end
+ *       -b:       keys are raw 8 byte binary integers rather than text
+ *       statsfile: file to keep a JSON snapshot of the table's stats in,
+ *                 refreshed every few blocks so that it can be polled while
+ *                 the run is still going (not used with -m budget)
+ *       input:    file to read keys from (default, or '-': stdin)
+ *       output:   file to write unique keys to (default, or '-': stdout)
+ *
+ * text keys are unsigned decimal integers separated by anything else.
+ * the input is read, deduplicated and written by three threads, which pass
+ * blocks of keys along a pipeline so that reading, inserting and writing all
+ * happen at once. rates are reported to stderr at the end.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "inthash.h"
+#include "hashtbl.h"
+#include "spill.h"
+
+#define DEFAULT_SIZE 4
+#define BLOCK_KEYS 65536	// how many keys are passed between stages at once
+#define NBLOCKS 8			// how many blocks are in flight in the pipeline
+#define IO_SIZE (1 << 20)	// how many bytes to read or write at once
+#define STATS_BLOCKS 16		// how many blocks to insert between stats snapshots
+
+// a block of keys passing through the pipeline
+typedef struct block {
+	int64 *keys;	// the keys read
+	bool *inserted;	// was each key newly inserted (i.e. is it unique)?
+	int nkeys;		// how many keys are in this block
+	bool last;		// is this the (possibly empty) final block?
+} Block;
+
+// a bounded queue of blocks waiting to be passed to the next stage
+typedef struct queue {
+	Block *blocks[NBLOCKS];
+	int head;				// index of the oldest block
+	int count;				// how many blocks are waiting
+	pthread_mutex_t lock;
+	pthread_cond_t changed;	// signalled whenever a block is added or taken
+} Queue;
+
+// everything shared between the pipeline stages
+typedef struct pipeline {
+	FILE *in;
+	FILE *out;
+	bool binary;
+	HashTable *table;
+	SpillSet *spill;	// used instead of 'table' when there is a budget
+	Block *emitting;	// block being filled with keys found by the spill set
+	Queue empty;	// blocks waiting to be filled by the reader
+	Queue read;		// blocks waiting to be deduplicated by the inserter
+	Queue done;		// blocks waiting to be written out by the writer
+	long long nread;		// how many keys were read
+	long long nunique;		// how many keys were written
+	long long nbytes;		// how many bytes were read
+	char *statsfile;	// file to write stats snapshots to, or NULL
+} Pipeline;
+
+typedef struct options {
+	TableType type;
+	int initial_size;
+	int capacity;
+	int budget;
+	bool binary;
+	char *statsfile;
+	char *input;
+	char *output;
+} Options;
+Options get_options(int argc, char **argv);
+
+
+/* * * *
+ * queues
+ */
+
+void queue_init(Queue *queue) {
+	queue->head = 0;
+	queue->count = 0;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->changed, NULL);
+}
+
+void queue_destroy(Queue *queue) {
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->changed);
+}
+
+// add 'block' to the back of 'queue' (there is always room, since there are
+// only NBLOCKS blocks in total)
+void queue_push(Queue *queue, Block *block) {
+	pthread_mutex_lock(&queue->lock);
+	assert(queue->count < NBLOCKS);
+	queue->blocks[(queue->head + queue->count) % NBLOCKS] = block;
+	queue->count++;
+	pthread_cond_signal(&queue->changed);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+// take the block from the front of 'queue', waiting for one if necessary
+Block *queue_pop(Queue *queue) {
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0) {
+		pthread_cond_wait(&queue->changed, &queue->lock);
+	}
+	Block *block = queue->blocks[queue->head];
+	queue->head = (queue->head + 1) % NBLOCKS;
+	queue->count--;
+	pthread_mutex_unlock(&queue->lock);
+	return block;
+}
+
+
+/* * * *
+ * pipeline stages
+ */
+
+// first stage: read keys from the input into blocks
+void *read_keys(void *arg) {
+	Pipeline *pipeline = arg;
+
+	// text parsing state, carried across reads so numbers may span them
+	unsigned char *buffer = malloc(IO_SIZE);
+	assert(buffer);
+	int64 number = 0;
+	bool innumber = false;
+	size_t nbytes = 0, pos = 0;
+	bool eof = false;
+
+	while (true) {
+		Block *block = queue_pop(&pipeline->empty);
+		block->nkeys = 0;
+
+		if (pipeline->binary) {
+			// binary keys can be read straight into the block
+			size_t n = fread(block->keys, sizeof(int64), BLOCK_KEYS,
+				pipeline->in);
+			block->nkeys = n;
+			pipeline->nbytes += n * sizeof(int64);
+			eof = n < BLOCK_KEYS;
+
+		} else {
+			// text keys are parsed one digit at a time until the block fills
+			while (block->nkeys < BLOCK_KEYS) {
+				if (pos == nbytes) {
+					nbytes = eof ? 0 : fread(buffer, 1, IO_SIZE, pipeline->in);
+					pos = 0;
+					pipeline->nbytes += nbytes;
+					if (nbytes == 0) {
+						// end of input: finish off any number in progress
+						eof = true;
+						if (innumber) {
+							block->keys[block->nkeys++] = number;
+							innumber = false;
+						}
+						break;
+					}
+				}
+				unsigned char c = buffer[pos++];
+				if (c >= '0' && c <= '9') {
+					number = innumber ? number * 10 + (c - '0') : c - '0';
+					innumber = true;
+				} else if (innumber) {
+					block->keys[block->nkeys++] = number;
+					innumber = false;
+				}
+			}
+		}
+
+		pipeline->nread += block->nkeys;
+		block->last = eof;
+		queue_push(&pipeline->read, block);
+		if (eof) {
+			break;
+		}
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+// pass a unique key found while finishing the spill set on to the writer
+void emit_key(void *arg, int64 key) {
+	Pipeline *pipeline = arg;
+	Block *block = pipeline->emitting;
+	if (block->nkeys == BLOCK_KEYS) {
+		queue_push(&pipeline->done, block);
+		block = pipeline->emitting = queue_pop(&pipeline->empty);
+		block->nkeys = 0;
+		block->last = false;
+	}
+	block->keys[block->nkeys] = key;
+	block->inserted[block->nkeys] = true;
+	block->nkeys++;
+	pipeline->nunique++;
+}
+
+// write a JSON snapshot of the table's stats to the stats file. only the
+// inserter touches the table, so it takes the snapshot itself, and writes it
+// to a temporary file first so that readers never see half a snapshot
+void write_stats(Pipeline *pipeline) {
+	StatsReport *report = malloc(sizeof(*report));
+	assert(report);
+	hash_table_report(pipeline->table, report);
+
+	char temp[FILENAME_MAX];
+	snprintf(temp, sizeof temp, "%s.tmp", pipeline->statsfile);
+	FILE *file = fopen(temp, "w");
+	if (file == NULL) {
+		perror(temp);
+	} else {
+		stats_report_write_json(report, file);
+		fclose(file);
+		if (rename(temp, pipeline->statsfile) != 0) {
+			perror(pipeline->statsfile);
+		}
+	}
+	free(report);
+}
+
+// second stage: insert each block of keys into the table, marking which
+// were seen for the first time
+void *insert_keys(void *arg) {
+	Pipeline *pipeline = arg;
+	bool last = false;
+	int nblocks = 0;
+	while (!last) {
+		Block *block = queue_pop(&pipeline->read);
+		last = block->last;
+
+		if (pipeline->spill == NULL) {
+			pipeline->nunique += hash_table_insert_batch(pipeline->table,
+				block->keys, block->nkeys, block->inserted);
+			queue_push(&pipeline->done, block);
+			nblocks++;
+			if (pipeline->statsfile && (last || nblocks % STATS_BLOCKS == 0)) {
+				write_stats(pipeline);
+			}
+			continue;
+		}
+
+		int i;
+		for (i = 0; i < block->nkeys; i++) {
+			block->inserted[i] = spill_set_add(pipeline->spill, block->keys[i]);
+			pipeline->nunique += block->inserted[i];
+		}
+		if (!last) {
+			queue_push(&pipeline->done, block);
+			continue;
+		}
+
+		// that's all the input: the keys that were spilled can now be
+		// deduplicated, and sent on to the writer in blocks of their own
+		block->last = false;
+		queue_push(&pipeline->done, block);
+		pipeline->emitting = queue_pop(&pipeline->empty);
+		pipeline->emitting->nkeys = 0;
+		pipeline->emitting->last = false;
+		spill_set_finish(pipeline->spill);
+		pipeline->emitting->last = true;
+		queue_push(&pipeline->done, pipeline->emitting);
+	}
+	return NULL;
+}
+
+// write the decimal representation of 'key' and a newline into 'buffer'
+// returns the number of characters written
+int format_key(char *buffer, int64 key) {
+	char digits[20];
+	int ndigits = 0;
+	do {
+		digits[ndigits++] = '0' + key % 10;
+		key /= 10;
+	} while (key > 0);
+
+	int i;
+	for (i = 0; i < ndigits; i++) {
+		buffer[i] = digits[ndigits - 1 - i];
+	}
+	buffer[ndigits] = '\n';
+	return ndigits + 1;
+}
+
+// third stage: write the unique keys from each block to the output
+void *write_keys(void *arg) {
+	Pipeline *pipeline = arg;
+
+	// longest key is 20 digits, plus a newline
+	char *buffer = malloc(IO_SIZE + 21);
+	assert(buffer);
+	size_t nbytes = 0;
+
+	bool last = false;
+	while (!last) {
+		Block *block = queue_pop(&pipeline->done);
+		int i;
+		for (i = 0; i < block->nkeys; i++) {
+			if (!block->inserted[i]) {
+				continue;
+			}
+			if (pipeline->binary) {
+				memcpy(buffer + nbytes, &block->keys[i], sizeof(int64));
+				nbytes += sizeof(int64);
+			} else {
+				nbytes += format_key(buffer + nbytes, block->keys[i]);
+			}
+			if (nbytes >= IO_SIZE) {
+				fwrite(buffer, 1, nbytes, pipeline->out);
+				nbytes = 0;
+			}
+		}
+		last = block->last;
+		queue_push(&pipeline->empty, block);
+	}
+
+	fwrite(buffer, 1, nbytes, pipeline->out);
+	fflush(pipeline->out);
+	free(buffer);
+	return NULL;
+}
+
+
+/* * * *
+ * main program
+ */
+
+// open 'name' in 'mode', or return 'standard' if 'name' is NULL or "-"
+FILE *open_file(char *name, char *mode, FILE *standard) {
+	if (name == NULL || strcmp(name, "-") == 0) {
+		return standard;
+	}
+	FILE *file = fopen(name, mode);
+	if (file == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	return file;
+}
+
+// seconds elapsed on a monotonic clock since some fixed point
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	Options options = get_options(argc, argv);
+
+	Pipeline pipeline = { .binary = options.binary,
+		.statsfile = options.statsfile };
+	pipeline.in = open_file(options.input, "rb", stdin);
+	pipeline.out = open_file(options.output, "wb", stdout);
+	if (options.budget > 0) {
+		pipeline.spill = new_spill_set(options.type, options.initial_size,
+			options.budget, emit_key, &pipeline);
+	} else {
+		pipeline.table = new_hash_table(options.type, options.initial_size);
+		if (options.capacity > 0) {
+			int min_capacity = hash_table_min_capacity(pipeline.table);
+			if (min_capacity == 0) {
+				fprintf(stderr,
+					"this table type does not support -c capacity\n");
+				exit(EXIT_FAILURE);
+			}
+			if (options.capacity < min_capacity) {
+				fprintf(stderr, "please specify capacity (>=%d) with -c\n",
+					min_capacity);
+				exit(EXIT_FAILURE);
+			}
+			hash_table_set_capacity(pipeline.table, options.capacity);
+		}
+	}
+
+	// set up the pipeline with all of its blocks empty
+	queue_init(&pipeline.empty);
+	queue_init(&pipeline.read);
+	queue_init(&pipeline.done);
+	Block blocks[NBLOCKS];
+	int i;
+	for (i = 0; i < NBLOCKS; i++) {
+		blocks[i].keys = malloc(sizeof(int64) * BLOCK_KEYS);
+		blocks[i].inserted = malloc(sizeof(bool) * BLOCK_KEYS);
+		assert(blocks[i].keys && blocks[i].inserted);
+		queue_push(&pipeline.empty, &blocks[i]);
+	}
+
+	// run the three stages at once, and wait for them all to finish
+	double start = now_seconds();
+	pthread_t reader, inserter, writer;
+	pthread_create(&reader, NULL, read_keys, &pipeline);
+	pthread_create(&inserter, NULL, insert_keys, &pipeline);
+	pthread_create(&writer, NULL, write_keys, &pipeline);
+	pthread_join(reader, NULL);
+	pthread_join(inserter, NULL);
+	pthread_join(writer, NULL);
+	double seconds = now_seconds() - start;
+
+	// report rates
+	if (seconds <= 0) {
+		seconds = 1e-9;
+	}
+	fprintf(stderr, "read %lld keys (%.1f MB), wrote %lld unique keys\n",
+		pipeline.nread, pipeline.nbytes / 1e6, pipeline.nunique);
+	fprintf(stderr, "%.3f sec: %.0f keys/sec, %.1f MB/sec\n", seconds,
+		pipeline.nread / seconds, pipeline.nbytes / 1e6 / seconds);
+	if (pipeline.spill) {
+		SpillStats stats = spill_set_stats(pipeline.spill);
+		fprintf(stderr, "spilled %lld keys into %d runs, %d levels deep\n",
+			stats.nspilled, stats.nruns, stats.maxlevel);
+	}
+
+	// clean up
+	for (i = 0; i < NBLOCKS; i++) {
+		free(blocks[i].keys);
+		free(blocks[i].inserted);
+	}
+	queue_destroy(&pipeline.empty);
+	queue_destroy(&pipeline.read);
+	queue_destroy(&pipeline.done);
+	if (pipeline.spill) {
+		free_spill_set(pipeline.spill);
+	} else {
+		free_hash_table(pipeline.table);
+	}
+	if (pipeline.in != stdin) {
+		fclose(pipeline.in);
+	}
+	if (pipeline.out != stdout) {
+		fclose(pipeline.out);
+	}
+	return 0;
+}
+
+// scans command line arguments for program options,
+// prints usage info and exits if commands are missing or otherwise invalid
+Options get_options(int argc, char **argv) {
+	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE,
+		.capacity = 0, .budget = 0, .binary = false, .statsfile = NULL,
+		.input = NULL, .output = NULL };
+
+	int option;
+	while ((option = getopt(argc, argv, "t:s:c:m:bj:")) != -1) {
+		switch (option) {
+			case 't': // set hash table type
+				options.type = strtotype(optarg);
+				break;
+			case 's': // set hash table size
+				options.initial_size = atoi(optarg);
+				break;
+			case 'c': // set hash table capacity
+				options.capacity = atoi(optarg);
+				break;
+			case 'm': // set in-memory key budget
+				options.budget = atoi(optarg);
+				break;
+			case 'b': // read and write binary keys
+				options.binary = true;
+				break;
+			case 'j': // keep a snapshot of the table's stats in a file
+				options.statsfile = optarg;
+				break;
+			default:
+				break;
+		}
+	}
+	if (optind < argc) {
+		options.input = argv[optind++];
+	}
+	if (optind < argc) {
+		options.output = argv[optind++];
+	}
+
+	if (options.type == NOTYPE || options.initial_size <= 0
+			|| options.capacity < 0 || options.budget < 0
+			|| (options.capacity > 0 && options.budget > 0)
+			|| (options.statsfile && options.budget > 0)) {
+		fprintf(stderr, "usage: %s -t type [-s size] [-c capacity | -m budget]"
+			" [-b] [-j statsfile] [input [output]]\n", argv[0]);
+		fprintf(stderr, " type: linear, xtndbl1, cuckoo, xtndbln, xuckoo "
+			"or xuckoon\n");
+		fprintf(stderr, " size: initial table size (>0)\n");
+		fprintf(stderr, " capacity: maximum number of keys to remember\n");
+		fprintf(stderr, " budget: maximum number of keys to hold in memory "
+			"before spilling to disk\n");
+		fprintf(stderr, " -b: keys are 8 byte binary integers, not text\n");
+		fprintf(stderr, " statsfile: file to keep a JSON snapshot of the "
+			"table's stats in (not with -m)\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return options;
+}
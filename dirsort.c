@@ -0,0 +1,67 @@
+/* * * * * * * * *
+ * Sorting batches of keys into the directory order of an extendible hash
+ * table, so that the keys bound for each bucket can be dealt with together
+ *
+ * the sort is a radix sort over only as many bits as the directory uses, 8
+ * bits a pass, so sorting a batch for a table of depth 20 takes three
+ * counting passes over it
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "dirsort.h"
+
+// how many bits each pass of the radix sort sorts on
+#define RADIX_BITS 8
+#define RADIX (1 << RADIX_BITS)
+
+// the 31 bits of 'hash' in reverse order, to sort keys on
+int dirsort_order(int hash) {
+	// swap halves, then quarters, and so on down to single bits
+	uint32_t x = hash;
+	x = (x >> 16) | (x << 16);
+	x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+	x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	// hashes have 31 bits, so the top bit of 'hash' was clear
+	return x >> 1;
+}
+
+// sort the 'n' keys in 'keys' by the low 'depth' bits of their hashes, read
+// in reverse (that is, by the top 'depth' bits of their orders), using
+// 'scratch' (which must have room for 'n' keys) as working space
+void dirsort(SortKey *keys, SortKey *scratch, int n, int depth) {
+	SortKey *from = keys;
+	SortKey *to = scratch;
+	int shift;
+	for (shift = 31 - depth; shift < 31; shift += RADIX_BITS) {
+		// count the keys with each digit, and from that, where each digit's
+		// keys start
+		int starts[RADIX] = {0};
+		int i;
+		for (i = 0; i < n; i++) {
+			starts[from[i].order >> shift & (RADIX - 1)]++;
+		}
+		int start = 0;
+		for (i = 0; i < RADIX; i++) {
+			int count = starts[i];
+			starts[i] = start;
+			start += count;
+		}
+
+		// then deal the keys out in order of their digits
+		for (i = 0; i < n; i++) {
+			to[starts[from[i].order >> shift & (RADIX - 1)]++] = from[i];
+		}
+		SortKey *swap = from;
+		from = to;
+		to = swap;
+	}
+
+	// after an odd number of passes, the keys are in the scratch space
+	if (from != keys) {
+		memcpy(keys, from, sizeof(SortKey) * n);
+	}
+}
@@ -0,0 +1,34 @@
+/* * * * * * * * *
+ * Sorting batches of keys into the directory order of an extendible hash
+ * table, so that the keys bound for each bucket can be dealt with together
+ *
+ * an extendible table addresses a key by the low bits of its hash, and a
+ * bucket of depth d holds every key whose hash ends in its d bits. reading
+ * those bits in reverse, from the lowest up, makes them a prefix, so keys
+ * sorted on their reversed hashes come out with every bucket's keys next to
+ * one another, whatever the depth of the bucket
+ */
+
+#ifndef DIRSORT_H
+#define DIRSORT_H
+
+#include "inthash.h"
+
+// a key in a batch being sorted, along with its hash
+typedef struct sort_key {
+	int order;		// the key's hash with its 31 bits reversed
+	int hash;		// the key's hash
+	int index;		// where the key came from in its batch
+	int64 key;
+} SortKey;
+
+// the 31 bits of 'hash' in reverse order, to sort keys on
+int dirsort_order(int hash);
+
+// sort the 'n' keys in 'keys' by the low 'depth' bits of their hashes, read
+// in reverse (that is, by the top 'depth' bits of their orders), using
+// 'scratch' (which must have room for 'n' keys) as working space
+// this is a least significant digit radix sort, so it is stable
+void dirsort(SortKey *keys, SortKey *scratch, int n, int depth);
+
+#endif
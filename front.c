@@ -0,0 +1,289 @@
+/* * * * * * * * *
+ * Small front cache of recent lookup results, to sit in front of a large
+ * hash table
+ *
+ * each bucket is one cache line: 7 keys and a byte of state for each. the
+ * frequency sketch has 4 rows of 8-bit counters, updated conservatively
+ * (only the smallest of a key's counters are incremented), and every counter
+ * is halved after a while so that it tracks recent frequency
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "front.h"
+
+// the size of a cache line, which each bucket fills
+#define CACHE_LINE 64
+// how many keys fit in a bucket, alongside a byte of state for each
+#define FRONT_WAYS 7
+// how many rows of counters the frequency sketch has
+#define SKETCH_ROWS 4
+// how many counters each sketch row has for each key the cache can hold
+#define SKETCH_WIDTH 2
+// how many lookups (for each key the cache can hold) the sketch counts
+// before it halves every counter
+#define SKETCH_AGE 10
+
+// a bucket holds up to FRONT_WAYS keys and what the table said about each
+typedef struct front_bucket {
+	int64 keys[FRONT_WAYS];
+	uint8_t states[FRONT_WAYS];	// FrontResult of each key (FRONT_MISS if
+								// the place is empty)
+	uint8_t spare;
+} FrontBucket;
+
+typedef struct stats {
+	long long lookups;		// how many keys have been looked up
+	long long hits;			// how many of those were cached as present
+	long long absent_hits;	// how many were cached as absent
+	long long admitted;		// how many keys have been admitted
+	long long rejected;		// how many were turned away as too infrequent
+} Stats;
+
+struct front_cache {
+	void *memory;			// the allocation the buckets are aligned within
+	FrontBucket *buckets;	// array of buckets, each on its own cache line
+	int nbuckets;			// how many buckets (a power of 2)
+	uint8_t *sketch;		// SKETCH_ROWS rows of 'width' counters
+	int width;				// how many counters in each row (a power of 2)
+	int additions;			// lookups counted since the counters were halved
+	int age;				// how many lookups to count before halving them
+	Stats stats;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// the smallest power of 2 that's at least 'n'
+static int power_of_2_above(int n) {
+	int power = 1;
+	while (power < n) {
+		power *= 2;
+	}
+	return power;
+}
+
+// the bucket 'key' belongs in
+static FrontBucket *bucket_of(FrontCache *cache, int64 key) {
+	return &cache->buckets[mix1(key) & (cache->nbuckets - 1)];
+}
+
+// find the counters for 'key', one in each row of the sketch
+static void sketch_counters(FrontCache *cache, int64 key,
+		uint8_t *counters[SKETCH_ROWS]) {
+	// the rows use a + row * b, for two hashes of the key (as in double
+	// hashing); b takes mix1's high bits, since the bucket takes its low ones
+	unsigned a = mix2(key);
+	unsigned b = (unsigned)mix1(key) >> 12 | 1;
+	int row;
+	for (row = 0; row < SKETCH_ROWS; row++) {
+		counters[row] = &cache->sketch[row * cache->width
+			+ ((a + row * b) & (cache->width - 1))];
+	}
+}
+
+// how many times 'key' has been looked up recently, according to the sketch
+static int sketch_estimate(FrontCache *cache, int64 key) {
+	uint8_t *counters[SKETCH_ROWS];
+	sketch_counters(cache, key, counters);
+	int min = *counters[0];
+	int row;
+	for (row = 1; row < SKETCH_ROWS; row++) {
+		if (*counters[row] < min) {
+			min = *counters[row];
+		}
+	}
+	return min;
+}
+
+// count another lookup of 'key' in the sketch, halving every counter if
+// enough lookups have been counted since they last were
+static void sketch_add(FrontCache *cache, int64 key) {
+	uint8_t *counters[SKETCH_ROWS];
+	sketch_counters(cache, key, counters);
+	int min = *counters[0];
+	int row;
+	for (row = 1; row < SKETCH_ROWS; row++) {
+		if (*counters[row] < min) {
+			min = *counters[row];
+		}
+	}
+	// only the smallest counters are incremented, since the others are
+	// already overestimates
+	if (min < UINT8_MAX) {
+		for (row = 0; row < SKETCH_ROWS; row++) {
+			if (*counters[row] == min) {
+				(*counters[row])++;
+			}
+		}
+	}
+
+	cache->additions++;
+	if (cache->additions >= cache->age) {
+		int i;
+		for (i = 0; i < SKETCH_ROWS * cache->width; i++) {
+			cache->sketch[i] /= 2;
+		}
+		cache->additions = 0;
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// create a front cache with room for about 'nkeys' keys
+FrontCache *new_front_cache(int nkeys) {
+	assert(nkeys > 0);
+	FrontCache *cache = malloc(sizeof *cache);
+	assert(cache);
+
+	cache->nbuckets = power_of_2_above((nkeys + FRONT_WAYS - 1) / FRONT_WAYS);
+	// allocate an extra line, so that the buckets can start on a line boundary
+	cache->memory = calloc(cache->nbuckets + 1, sizeof(FrontBucket));
+	assert(cache->memory);
+	uintptr_t start = (uintptr_t)cache->memory;
+	start = (start + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+	cache->buckets = (FrontBucket *)start;
+
+	int capacity = cache->nbuckets * FRONT_WAYS;
+	cache->width = power_of_2_above(capacity * SKETCH_WIDTH);
+	cache->sketch = calloc(SKETCH_ROWS * cache->width, sizeof(uint8_t));
+	assert(cache->sketch);
+	cache->additions = 0;
+	cache->age = capacity * SKETCH_AGE;
+
+	cache->stats.lookups = 0;
+	cache->stats.hits = 0;
+	cache->stats.absent_hits = 0;
+	cache->stats.admitted = 0;
+	cache->stats.rejected = 0;
+	return cache;
+}
+
+// free all memory associated with 'cache'
+void free_front_cache(FrontCache *cache) {
+	assert(cache != NULL);
+	free(cache->memory);
+	free(cache->sketch);
+	free(cache);
+}
+
+// look up what 'cache' knows about 'key', counting the lookup towards the
+// key's frequency
+FrontResult front_cache_lookup(FrontCache *cache, int64 key) {
+	assert(cache != NULL);
+	cache->stats.lookups++;
+	sketch_add(cache, key);
+
+	FrontBucket *bucket = bucket_of(cache, key);
+	int i;
+	for (i = 0; i < FRONT_WAYS; i++) {
+		if (bucket->states[i] != FRONT_MISS && bucket->keys[i] == key) {
+			if (bucket->states[i] == FRONT_PRESENT) {
+				cache->stats.hits++;
+			} else {
+				cache->stats.absent_hits++;
+			}
+			return bucket->states[i];
+		}
+	}
+	return FRONT_MISS;
+}
+
+// offer the result of looking 'key' up in the table ('present') to 'cache',
+// after front_cache_lookup missed. it's kept if there's room, or if 'key' is
+// looked up more often than the least frequent key in its bucket
+void front_cache_admit(FrontCache *cache, int64 key, bool present) {
+	assert(cache != NULL);
+	FrontBucket *bucket = bucket_of(cache, key);
+
+	// find an empty place, or else the key with the lowest frequency
+	int victim = 0;
+	int victim_freq = 0;
+	int i;
+	for (i = 0; i < FRONT_WAYS; i++) {
+		if (bucket->states[i] == FRONT_MISS) {
+			victim = i;
+			victim_freq = -1;
+			break;
+		}
+		int freq = sketch_estimate(cache, bucket->keys[i]);
+		if (i == 0 || freq < victim_freq) {
+			victim = i;
+			victim_freq = freq;
+		}
+	}
+
+	// only replace a key that has been looked up less often
+	if (victim_freq >= sketch_estimate(cache, key)) {
+		cache->stats.rejected++;
+		return;
+	}
+	bucket->keys[victim] = key;
+	bucket->states[victim] = present ? FRONT_PRESENT : FRONT_ABSENT;
+	cache->stats.admitted++;
+}
+
+// tell 'cache' that 'key' has been inserted into the table, so that it's no
+// longer cached as absent
+// if 'keep' is true and the key is cached, it's marked present instead
+void front_cache_inserted(FrontCache *cache, int64 key, bool keep) {
+	assert(cache != NULL);
+	FrontBucket *bucket = bucket_of(cache, key);
+	int i;
+	for (i = 0; i < FRONT_WAYS; i++) {
+		if (bucket->states[i] != FRONT_MISS && bucket->keys[i] == key) {
+			bucket->states[i] = keep ? FRONT_PRESENT : FRONT_MISS;
+			return;
+		}
+	}
+}
+
+// forget every key in 'cache' (but not their frequencies)
+void front_cache_clear(FrontCache *cache) {
+	assert(cache != NULL);
+	int i, j;
+	for (i = 0; i < cache->nbuckets; i++) {
+		for (j = 0; j < FRONT_WAYS; j++) {
+			cache->buckets[i].states[j] = FRONT_MISS;
+		}
+	}
+}
+
+// print some statistics about 'cache' to stdout
+void front_cache_stats(FrontCache *cache) {
+	assert(cache != NULL);
+	printf("--- front cache stats ---\n");
+	printf("  capacity: %d keys in %d buckets\n",
+		cache->nbuckets * FRONT_WAYS, cache->nbuckets);
+	printf("   lookups: %lld\n", cache->stats.lookups);
+	if (cache->stats.lookups > 0) {
+		printf("      hits: %lld (%.1f%%) present, %lld (%.1f%%) absent\n",
+			cache->stats.hits,
+			cache->stats.hits * 100.0 / cache->stats.lookups,
+			cache->stats.absent_hits,
+			cache->stats.absent_hits * 100.0 / cache->stats.lookups);
+	}
+	printf("  admitted: %lld\n", cache->stats.admitted);
+	printf("  rejected: %lld\n", cache->stats.rejected);
+	printf("--- end stats ---\n");
+}
+
+// add the statistics of 'cache' to 'report'
+void front_cache_report(FrontCache *cache, StatsReport *report) {
+	assert(cache != NULL);
+	stats_report_counter(report, "front_capacity_keys",
+		cache->nbuckets * FRONT_WAYS);
+	stats_report_counter(report, "front_lookups", cache->stats.lookups);
+	stats_report_counter(report, "front_hits", cache->stats.hits);
+	stats_report_counter(report, "front_absent_hits", cache->stats.absent_hits);
+	stats_report_counter(report, "front_admitted", cache->stats.admitted);
+	stats_report_counter(report, "front_rejected", cache->stats.rejected);
+}
@@ -0,0 +1,58 @@
+/* * * * * * * * *
+ * Small front cache of recent lookup results, to sit in front of a large
+ * hash table
+ *
+ * the cache is an array of cache-line-sized buckets, each holding a few keys
+ * and whether the table behind it has them, so a repeated lookup of a hot
+ * key (present or absent) costs one cache line instead of a walk through the
+ * whole table. a key is only admitted in place of another if a count-min
+ * sketch says it has been looked up more often recently (TinyLFU), so a
+ * scan of cold keys can't flush out the hot ones
+ */
+
+#ifndef FRONT_H
+#define FRONT_H
+
+#include <stdbool.h>
+#include "inthash.h"
+#include "report.h"
+
+// what the front cache knows about a key
+typedef enum front_result {
+	FRONT_MISS,		// nothing: ask the table
+	FRONT_PRESENT,	// the table has it
+	FRONT_ABSENT	// the table doesn't have it
+} FrontResult;
+
+typedef struct front_cache FrontCache;
+
+// create a front cache with room for about 'nkeys' keys
+FrontCache *new_front_cache(int nkeys);
+
+// free all memory associated with 'cache'
+void free_front_cache(FrontCache *cache);
+
+// look up what 'cache' knows about 'key', counting the lookup towards the
+// key's frequency
+FrontResult front_cache_lookup(FrontCache *cache, int64 key);
+
+// offer the result of looking 'key' up in the table ('present') to 'cache',
+// after front_cache_lookup missed. it's kept if there's room, or if 'key' is
+// looked up more often than the least frequent key in its bucket
+void front_cache_admit(FrontCache *cache, int64 key, bool present);
+
+// tell 'cache' that 'key' has been inserted into the table, so that it's no
+// longer cached as absent
+// if 'keep' is true and the key is cached, it's marked present instead
+void front_cache_inserted(FrontCache *cache, int64 key, bool keep);
+
+// forget every key in 'cache' (but not their frequencies)
+void front_cache_clear(FrontCache *cache);
+
+// print some statistics about 'cache' to stdout
+void front_cache_stats(FrontCache *cache);
+
+// add the statistics of 'cache' to 'report'
+void front_cache_report(FrontCache *cache, StatsReport *report);
+
+#endif
@@ -0,0 +1,159 @@
+/* * * * * * * * *
+ * Vector kernels for probing tables in which each key has exactly one
+ * candidate slot in each of two arrays (as in a cuckoo hash table)
+ *
+ * the vectors have no integer division, so hashes are reduced modulo the
+ * array size by multiplying by its reciprocal in double precision. a hash is
+ * below 2^31, so the quotient this gives is at most one away from the true
+ * one, and a conditional add or subtract of the size fixes the remainder
+ */
+
+#include <assert.h>
+
+#include "gather.h"
+
+// the vector kernels need x86 intrinsics, and GCC-style target attributes
+// so that they can be compiled without assuming every CPU has them
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_VECTOR_KERNELS
+#include <immintrin.h>
+#endif
+
+
+/* * * *
+ * kernels
+ */
+
+// match keys 'from' to 'n' one at a time
+static uint64_t match_scalar(const int64 *slots1, const int64 *slots2,
+		int size, const int *hashes1, const int *hashes2, const int64 *keys,
+		int from, int n) {
+	uint64_t found = 0;
+	int i;
+	for (i = from; i < n; i++) {
+		uint64_t match = (slots1[hashes1[i] % size] == keys[i])
+			| (slots2[hashes2[i] % size] == keys[i]);
+		found |= match << i;
+	}
+	return found;
+}
+
+#ifdef HAVE_VECTOR_KERNELS
+
+// each of the 4 hashes in 'hashes' modulo 'size' ('inverse' is 1.0 / size)
+__attribute__((target("avx2")))
+static __m128i mod_size_avx2(__m128i hashes, __m256d inverse, __m128i size) {
+	__m128i quotient = _mm256_cvttpd_epi32(
+		_mm256_mul_pd(_mm256_cvtepi32_pd(hashes), inverse));
+	__m128i r = _mm_sub_epi32(hashes, _mm_mullo_epi32(quotient, size));
+	// fix remainders from a quotient that was one too big or too small
+	r = _mm_add_epi32(r,
+		_mm_and_si128(_mm_cmpgt_epi32(_mm_setzero_si128(), r), size));
+	return _mm_sub_epi32(r, _mm_andnot_si128(_mm_cmpgt_epi32(size, r), size));
+}
+
+// match as many of the 'n' keys as fill whole vectors of 4, storing how many
+// that was in *done
+__attribute__((target("avx2")))
+static uint64_t match_avx2(const int64 *slots1, const int64 *slots2,
+		int size, const int *hashes1, const int *hashes2, const int64 *keys,
+		int n, int *done) {
+	__m256d inverse = _mm256_set1_pd(1.0 / size);
+	__m128i vsize = _mm_set1_epi32(size);
+	uint64_t found = 0;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i pos1 = mod_size_avx2(
+			_mm_loadu_si128((const __m128i *)(hashes1 + i)), inverse, vsize);
+		__m128i pos2 = mod_size_avx2(
+			_mm_loadu_si128((const __m128i *)(hashes2 + i)), inverse, vsize);
+		__m256i key = _mm256_loadu_si256((const __m256i *)(keys + i));
+		__m256i match = _mm256_or_si256(
+			_mm256_cmpeq_epi64(key, _mm256_i32gather_epi64(
+				(const long long *)slots1, pos1, 8)),
+			_mm256_cmpeq_epi64(key, _mm256_i32gather_epi64(
+				(const long long *)slots2, pos2, 8)));
+		uint64_t bits = _mm256_movemask_pd(_mm256_castsi256_pd(match));
+		found |= bits << i;
+	}
+	*done = i;
+	return found;
+}
+
+// each of the 8 hashes in 'hashes' modulo 'size' ('inverse' is 1.0 / size)
+__attribute__((target("avx512f,avx2")))
+static __m256i mod_size_avx512(__m256i hashes, __m512d inverse,
+		__m256i size) {
+	__m256i quotient = _mm512_cvttpd_epi32(
+		_mm512_mul_pd(_mm512_cvtepi32_pd(hashes), inverse));
+	__m256i r = _mm256_sub_epi32(hashes, _mm256_mullo_epi32(quotient, size));
+	// fix remainders from a quotient that was one too big or too small
+	r = _mm256_add_epi32(r, _mm256_and_si256(
+		_mm256_cmpgt_epi32(_mm256_setzero_si256(), r), size));
+	return _mm256_sub_epi32(r,
+		_mm256_andnot_si256(_mm256_cmpgt_epi32(size, r), size));
+}
+
+// match as many of the 'n' keys as fill whole vectors of 8, storing how many
+// that was in *done
+__attribute__((target("avx512f,avx2")))
+static uint64_t match_avx512(const int64 *slots1, const int64 *slots2,
+		int size, const int *hashes1, const int *hashes2, const int64 *keys,
+		int n, int *done) {
+	__m512d inverse = _mm512_set1_pd(1.0 / size);
+	__m256i vsize = _mm256_set1_epi32(size);
+	uint64_t found = 0;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i pos1 = mod_size_avx512(
+			_mm256_loadu_si256((const __m256i *)(hashes1 + i)), inverse, vsize);
+		__m256i pos2 = mod_size_avx512(
+			_mm256_loadu_si256((const __m256i *)(hashes2 + i)), inverse, vsize);
+		__m512i key = _mm512_loadu_si512(keys + i);
+		__mmask8 match = _mm512_cmpeq_epi64_mask(key,
+				_mm512_i32gather_epi64(pos1, slots1, 8))
+			| _mm512_cmpeq_epi64_mask(key,
+				_mm512_i32gather_epi64(pos2, slots2, 8));
+		found |= (uint64_t)match << i;
+	}
+	*done = i;
+	return found;
+}
+
+#endif
+
+
+/* * * *
+ * all functions
+ */
+
+// for each of the 'n' (at most GATHER_MAX) keys in 'keys', check whether
+// either slots1[hashes1[i] % size] or slots2[hashes2[i] % size] holds it
+// returns a bitmask with bit i set if keys[i] was found
+uint64_t gather_match2(const int64 *slots1, const int64 *slots2, int size,
+		const int *hashes1, const int *hashes2, const int64 *keys, int n) {
+	return gather_match2_with(hash_kernel_best(), slots1, slots2, size,
+		hashes1, hashes2, keys, n);
+}
+
+// as gather_match2, but using kernel 'kernel', which this CPU must support
+uint64_t gather_match2_with(HashKernel kernel, const int64 *slots1,
+		const int64 *slots2, int size, const int *hashes1, const int *hashes2,
+		const int64 *keys, int n) {
+	assert(n <= GATHER_MAX && size > 0);
+	assert(hash_kernel_supported(kernel));
+	uint64_t found = 0;
+	int done = 0;
+#ifdef HAVE_VECTOR_KERNELS
+	if (kernel == HASH_KERNEL_AVX512) {
+		found = match_avx512(slots1, slots2, size, hashes1, hashes2, keys, n,
+			&done);
+	} else if (kernel == HASH_KERNEL_AVX2) {
+		found = match_avx2(slots1, slots2, size, hashes1, hashes2, keys, n,
+			&done);
+	}
+#endif
+	// the scalar kernel, and the keys left over from the vector kernels
+	return found | match_scalar(slots1, slots2, size, hashes1, hashes2, keys,
+		done, n);
+}
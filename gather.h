@@ -0,0 +1,32 @@
+/* * * * * * * * *
+ * Vector kernels for probing tables in which each key has exactly one
+ * candidate slot in each of two arrays (as in a cuckoo hash table)
+ *
+ * a batch of keys' candidate slots are found by reducing their hashes modulo
+ * the array size, loaded with gather instructions, and compared with the
+ * keys, giving a bitmask of which keys were found. as for the batch hash
+ * kernels in inthash.h, the widest kernel the CPU supports is used, with a
+ * scalar loop as the fallback
+ */
+
+#ifndef GATHER_H
+#define GATHER_H
+
+#include <stdint.h>
+#include "inthash.h"
+
+// the most keys a single call can match
+#define GATHER_MAX 64
+
+// for each of the 'n' (at most GATHER_MAX) keys in 'keys', check whether
+// either slots1[hashes1[i] % size] or slots2[hashes2[i] % size] holds it
+// returns a bitmask with bit i set if keys[i] was found
+uint64_t gather_match2(const int64 *slots1, const int64 *slots2, int size,
+	const int *hashes1, const int *hashes2, const int64 *keys, int n);
+
+// as gather_match2, but using kernel 'kernel', which this CPU must support
+uint64_t gather_match2_with(HashKernel kernel, const int64 *slots1,
+	const int64 *slots2, int size, const int *hashes1, const int *hashes2,
+	const int64 *keys, int n);
+
+#endif
@@ -0,0 +1,574 @@
+/* * * * * * * * *
+ * Hash group-by aggregation: the count, sum, minimum and maximum of the
+ * values seen with each distinct key
+ *
+ * each group's running aggregate is stored directly in its table slot,
+ * using either the linear probing layout (one group per slot) or the
+ * extendible hashing layout (buckets of groups, split as they fill up).
+ * once 'budget' groups are held in memory, values for any new groups are
+ * partitioned into run files just as spill.c does with keys, and each run is
+ * aggregated separately once the input ends
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "groupby.h"
+#include "spill.h"
+
+#define NRUNS (1 << SPILL_BITS)
+// bytes of buffering for each run file
+#define RUN_BUFFER_SIZE 65536
+// how many aggregates to read back from a run file at once
+#define RUN_BATCH 4096
+// how many values to hash and prefetch ahead of updating their groups
+#define GROUP_BATCH 64
+
+// macro to calculate the rightmost n bits of a number x
+#define rightmostnbits(n, x) ((x) & ((1 << (n)) - 1))
+
+// a bucket of the extendible hashing layout, holding up to 'bucketsize'
+// groups which share their rightmost 'depth' hash bits
+typedef struct group_bucket {
+	int id;				// the first directory address pointing to this bucket
+	int depth;			// how many hash value bits this bucket is using
+	int ngroups;		// how many groups are in this bucket
+	Aggregate *groups;	// the groups themselves
+} GroupBucket;
+
+struct group_by {
+	TableType type;		// which layout the groups are stored in
+	int size;			// the initial size, for the group bys of run files
+
+	// linear probing layout: a slot with a count of 0 is empty
+	Aggregate *slots;	// the slots
+	int nslots;			// how many slots there are
+
+	// extendible hashing layout
+	GroupBucket **buckets;	// directory of pointers to buckets
+	int dirsize;			// how many pointers are in the directory
+	int depth;				// how many hash bits address the directory
+	int bucketsize;			// how many groups fit in each bucket
+
+	int ngroups;		// how many groups are held in memory
+	int budget;			// how many groups may be held in memory, or 0
+	int level;			// how many times values have been partitioned already
+	FILE *runs[NRUNS];	// the run files aggregates spill into, as needed
+	GroupByStats stats;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// create a new bucket first referenced from 'first_address', based on 'depth'
+// bits of its groups' hash values
+static GroupBucket *new_group_bucket(int first_address, int depth,
+		int bucketsize) {
+	GroupBucket *bucket = malloc(sizeof *bucket);
+	assert(bucket);
+	bucket->groups = malloc(sizeof(Aggregate) * bucketsize);
+	assert(bucket->groups);
+	bucket->id = first_address;
+	bucket->depth = depth;
+	bucket->ngroups = 0;
+	return bucket;
+}
+
+// create a group by at partitioning depth 'level'
+static GroupBy *new_group_level(TableType type, int size, int budget,
+		int level) {
+	assert((type == LINEAR || type == XTNDBLN) && size > 0 && budget >= 0);
+	GroupBy *group = malloc(sizeof *group);
+	assert(group);
+
+	group->type = type;
+	group->size = size;
+	group->slots = NULL;
+	group->nslots = 0;
+	group->buckets = NULL;
+	group->dirsize = 0;
+	group->depth = 0;
+	group->bucketsize = 0;
+	if (type == LINEAR) {
+		group->slots = calloc(size, sizeof(Aggregate));
+		assert(group->slots);
+		group->nslots = size;
+	} else {
+		group->buckets = malloc(sizeof *group->buckets);
+		assert(group->buckets);
+		group->buckets[0] = new_group_bucket(0, 0, size);
+		group->dirsize = 1;
+		group->bucketsize = size;
+	}
+
+	group->ngroups = 0;
+	group->budget = budget;
+	group->level = level;
+	int i;
+	for (i = 0; i < NRUNS; i++) {
+		group->runs[i] = NULL;
+	}
+	group->stats.ngroups = 0;
+	group->stats.nspilled = 0;
+	group->stats.nruns = 0;
+	group->stats.maxlevel = level;
+	return group;
+}
+
+// free the groups held in memory by 'group' (but not its run files)
+static void free_groups(GroupBy *group) {
+	free(group->slots);
+	group->slots = NULL;
+	if (group->buckets) {
+		// free buckets only at their first reference, looping backwards
+		int i;
+		for (i = group->dirsize - 1; i >= 0; i--) {
+			if (group->buckets[i]->id == i) {
+				free(group->buckets[i]->groups);
+				free(group->buckets[i]);
+			}
+		}
+		free(group->buckets);
+		group->buckets = NULL;
+	}
+}
+
+// find the slot holding 'key' (whose h1 hash is 'hash') in the linear
+// layout, or the empty slot where it belongs
+static Aggregate *probe_slot(GroupBy *group, int64 key, int hash) {
+	int i = hash % group->nslots;
+	while (group->slots[i].count != 0 && group->slots[i].key != key) {
+		i++;
+		if (i == group->nslots) {
+			i = 0;
+		}
+	}
+	return &group->slots[i];
+}
+
+// double the number of slots in the linear layout, rehashing every group
+static void grow_slots(GroupBy *group) {
+	int size = group->nslots * 2;
+	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+
+	Aggregate *old = group->slots;
+	int oldsize = group->nslots;
+	group->slots = calloc(size, sizeof(Aggregate));
+	assert(group->slots);
+	group->nslots = size;
+
+	int i;
+	for (i = 0; i < oldsize; i++) {
+		if (old[i].count != 0) {
+			*probe_slot(group, old[i].key, h1(old[i].key)) = old[i];
+		}
+	}
+	free(old);
+}
+
+// double the directory of the extendible layout, duplicating the pointers in
+// the first half into the new second half
+static void double_directory(GroupBy *group) {
+	int size = group->dirsize * 2;
+	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+
+	group->buckets = realloc(group->buckets, sizeof *group->buckets * size);
+	assert(group->buckets);
+	int i;
+	for (i = 0; i < group->dirsize; i++) {
+		group->buckets[group->dirsize + i] = group->buckets[i];
+	}
+	group->dirsize = size;
+	group->depth++;
+}
+
+// split the bucket at directory address 'address' of the extendible layout,
+// doubling the directory first if necessary
+static void split_group_bucket(GroupBy *group, int address) {
+	if (group->buckets[address]->depth == group->depth) {
+		double_directory(group);
+	}
+
+	// the new bucket takes the addresses with a 1 bit just above the old
+	// bucket's bits
+	GroupBucket *bucket = group->buckets[address];
+	int depth = bucket->depth;
+	bucket->depth = depth + 1;
+	int suffix = (1 << depth) | rightmostnbits(depth, bucket->id);
+	GroupBucket *newbucket = new_group_bucket(suffix, depth + 1,
+		group->bucketsize);
+	int prefix;
+	for (prefix = 0; prefix < 1 << (group->depth - depth - 1); prefix++) {
+		group->buckets[(prefix << (depth + 1)) | suffix] = newbucket;
+	}
+
+	// then redistribute the old bucket's groups between the two
+	int n = bucket->ngroups;
+	Aggregate *old = bucket->groups;
+	bucket->groups = malloc(sizeof(Aggregate) * group->bucketsize);
+	assert(bucket->groups);
+	bucket->ngroups = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		GroupBucket *to = group->buckets[rightmostnbits(group->depth,
+			h1(old[i].key))];
+		to->groups[to->ngroups++] = old[i];
+	}
+	free(old);
+}
+
+// find the slot of the group for 'key' (whose h1 hash is 'hash'), making a
+// new, empty group (with a count of 0) if there isn't one yet
+// returns NULL if there is no group for 'key' and no room for another one
+// (note that once this happens, it keeps happening, so any group which has
+// spilled can never also be held in memory at this level)
+static Aggregate *find_group(GroupBy *group, int64 key, int hash) {
+	bool full = group->budget > 0 && group->ngroups >= group->budget
+		&& group->level < SPILL_MAX_LEVEL;
+
+	Aggregate *slot;
+	if (group->type == LINEAR) {
+		slot = probe_slot(group, key, hash);
+		if (slot->count != 0) {
+			return slot;
+		}
+		if (full) {
+			return NULL;
+		}
+		// keep the load below 3/4 so that probe sequences stay short
+		if ((group->ngroups + 1) * 4 > group->nslots * 3) {
+			grow_slots(group);
+			slot = probe_slot(group, key, hash);
+		}
+	} else {
+		int address = rightmostnbits(group->depth, hash);
+		GroupBucket *bucket = group->buckets[address];
+		int i;
+		for (i = 0; i < bucket->ngroups; i++) {
+			if (bucket->groups[i].key == key) {
+				return &bucket->groups[i];
+			}
+		}
+		if (full) {
+			return NULL;
+		}
+		while (group->buckets[address]->ngroups == group->bucketsize) {
+			split_group_bucket(group, address);
+			address = rightmostnbits(group->depth, hash);
+		}
+		bucket = group->buckets[address];
+		slot = &bucket->groups[bucket->ngroups++];
+	}
+
+	slot->key = key;
+	slot->count = 0;
+	group->ngroups++;
+	group->stats.ngroups++;
+	return slot;
+}
+
+// combine the aggregate 'from' into the aggregate 'into', for the same key
+static void combine(Aggregate *into, const Aggregate *from) {
+	if (into->count == 0) {
+		*into = *from;
+		return;
+	}
+	into->count += from->count;
+	into->sum += from->sum;
+	if (from->min < into->min) {
+		into->min = from->min;
+	}
+	if (from->max > into->max) {
+		into->max = from->max;
+	}
+}
+
+// append 'aggregate' to the run file it belongs in, creating it if necessary
+static void spill_aggregate(GroupBy *group, const Aggregate *aggregate) {
+	int run = spill_run(aggregate->key, group->level);
+	if (group->runs[run] == NULL) {
+		group->runs[run] = tmpfile();
+		assert(group->runs[run] && "error: could not create run file");
+		setvbuf(group->runs[run], NULL, _IOFBF, RUN_BUFFER_SIZE);
+		group->stats.nruns++;
+	}
+	size_t n = fwrite(aggregate, sizeof *aggregate, 1, group->runs[run]);
+	assert(n == 1 && "error: could not write to run file");
+	group->stats.nspilled++;
+}
+
+// combine 'aggregate' (whose key's h1 hash is 'hash') into its group, or
+// spill it if there's no room for its group
+static void add_aggregate(GroupBy *group, const Aggregate *aggregate,
+		int hash) {
+	Aggregate *slot = find_group(group, aggregate->key, hash);
+	if (slot) {
+		combine(slot, aggregate);
+	} else {
+		spill_aggregate(group, aggregate);
+	}
+}
+
+// AggregateFunction adding each group passed to it to the group by 'data'
+static void add_group(void *data, const Aggregate *aggregate) {
+	add_aggregate(data, aggregate, h1(aggregate->key));
+}
+
+// combine every aggregate in the run file 'run' into 'group'
+static void add_run(GroupBy *group, FILE *run, Aggregate *buffer) {
+	rewind(run);
+	size_t n;
+	while ((n = fread(buffer, sizeof(Aggregate), RUN_BATCH, run)) > 0) {
+		size_t i;
+		for (i = 0; i < n; i++) {
+			add_group(group, &buffer[i]);
+		}
+	}
+}
+
+// pass every group held in memory by 'group' to 'emit'
+static void for_each_group(GroupBy *group, AggregateFunction emit,
+		void *data) {
+	int i, j;
+	if (group->type == LINEAR) {
+		for (i = 0; i < group->nslots; i++) {
+			if (group->slots[i].count != 0) {
+				emit(data, &group->slots[i]);
+			}
+		}
+	} else {
+		for (i = 0; i < group->dirsize; i++) {
+			GroupBucket *bucket = group->buckets[i];
+			if (bucket->id == i) {
+				for (j = 0; j < bucket->ngroups; j++) {
+					emit(data, &bucket->groups[j]);
+				}
+			}
+		}
+	}
+}
+
+// add the statistics of the child group by 'child' to those of 'group'
+static void add_stats(GroupBy *group, GroupByStats child) {
+	group->stats.ngroups += child.ngroups;
+	group->stats.nspilled += child.nspilled;
+	group->stats.nruns += child.nruns;
+	if (child.maxlevel > group->stats.maxlevel) {
+		group->stats.maxlevel = child.maxlevel;
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// create a group by using the layout of table type 'type', keeping at most
+// 'budget' groups in memory at once (or any number if 'budget' is 0)
+GroupBy *new_group_by(TableType type, int size, int budget) {
+	return new_group_level(type, size, budget, 0);
+}
+
+// free all memory (and run files) associated with 'group'
+void free_group_by(GroupBy *group) {
+	assert(group);
+	free_groups(group);
+	int i;
+	for (i = 0; i < NRUNS; i++) {
+		if (group->runs[i]) {
+			fclose(group->runs[i]);
+		}
+	}
+	free(group);
+}
+
+// add 'value' to the group for 'key'
+void group_by_add(GroupBy *group, int64 key, long long value) {
+	assert(group && (group->slots || group->buckets));
+	Aggregate aggregate = { key, 1, value, value, value };
+	add_aggregate(group, &aggregate, h1(key));
+}
+
+// add each of the 'n' values in 'values' to the group for the corresponding
+// key in 'keys', hashing and prefetching a batch ahead of the updates
+void group_by_add_batch(GroupBy *group, const int64 *keys,
+		const long long *values, int n) {
+	assert(group && (group->slots || group->buckets));
+	int hashes[GROUP_BATCH];
+
+	int start;
+	for (start = 0; start < n; start += GROUP_BATCH) {
+		int m = n - start < GROUP_BATCH ? n - start : GROUP_BATCH;
+
+		// first hash the whole batch, prefetching where each group should be
+		// (if the layout grows part way through, the rest of these are wasted,
+		// but the hashes are still good)
+		hash_batch(HASH_H1, keys + start, m, hashes);
+		int i;
+		for (i = 0; i < m; i++) {
+			if (group->type == LINEAR) {
+				__builtin_prefetch(&group->slots[hashes[i] % group->nslots], 1);
+			} else {
+				GroupBucket *bucket =
+					group->buckets[rightmostnbits(group->depth, hashes[i])];
+				__builtin_prefetch(bucket->groups, 1);
+			}
+		}
+
+		// then update the groups, which should now mostly be in cache
+		for (i = 0; i < m; i++) {
+			long long value = values[start + i];
+			Aggregate aggregate = { keys[start + i], 1, value, value, value };
+			add_aggregate(group, &aggregate, hashes[i]);
+		}
+	}
+}
+
+// add every group of 'from' (including any it spilled) into 'into', then
+// free 'from'
+void group_by_merge(GroupBy *into, GroupBy *from) {
+	assert(into && from && into != from);
+	assert(into->slots || into->buckets);
+
+	if (from->slots || from->buckets) {
+		for_each_group(from, add_group, into);
+	}
+
+	Aggregate *buffer = malloc(sizeof(Aggregate) * RUN_BATCH);
+	assert(buffer);
+	int run;
+	for (run = 0; run < NRUNS; run++) {
+		if (from->runs[run]) {
+			add_run(into, from->runs[run], buffer);
+		}
+	}
+	free(buffer);
+
+	into->stats.nspilled += from->stats.nspilled;
+	into->stats.nruns += from->stats.nruns;
+	free_group_by(from);
+}
+
+// pass every group of 'group' (along with 'data') to 'emit', aggregating its
+// run files one at a time
+void group_by_finish(GroupBy *group, AggregateFunction emit, void *data) {
+	assert(group && (group->slots || group->buckets));
+
+	// no group in a run file can also be in memory, so emit and free the
+	// groups in memory before processing the runs
+	for_each_group(group, emit, data);
+	free_groups(group);
+
+	Aggregate *buffer = malloc(sizeof(Aggregate) * RUN_BATCH);
+	assert(buffer);
+
+	int run;
+	for (run = 0; run < NRUNS; run++) {
+		if (group->runs[run] == NULL) {
+			continue;
+		}
+
+		// aggregate this run with a fresh group by one level further down,
+		// which will partition its aggregates again if there are too many
+		GroupBy *child = new_group_level(group->type, group->size,
+			group->budget, group->level + 1);
+		add_run(child, group->runs[run], buffer);
+		group_by_finish(child, emit, data);
+		add_stats(group, child->stats);
+		free_group_by(child);
+
+		fclose(group->runs[run]);
+		group->runs[run] = NULL;
+	}
+
+	free(buffer);
+}
+
+// get statistics about 'group'
+GroupByStats group_by_stats(GroupBy *group) {
+	assert(group);
+	return group->stats;
+}
+
+
+/* * * *
+ * parallel aggregation
+ */
+
+// how many values a worker adds per call to group_by_add_batch
+#define WORKER_BATCH 65536
+
+// one thread's share of the input, and the group by it aggregates it into
+typedef struct worker {
+	GroupBy *group;
+	const int64 *keys;
+	const long long *values;
+	long n;
+} Worker;
+
+// thread function pre-aggregating a worker's share of the input
+static void *aggregate_part(void *arg) {
+	Worker *worker = arg;
+	long i;
+	for (i = 0; i < worker->n; i += WORKER_BATCH) {
+		long m = worker->n - i < WORKER_BATCH ? worker->n - i : WORKER_BATCH;
+		group_by_add_batch(worker->group, worker->keys + i,
+			worker->values + i, m);
+	}
+	return NULL;
+}
+
+// aggregate the 'n' values in 'values' by the keys in 'keys' using 'nthreads'
+// threads, each pre-aggregating part of the input into a group by of its own
+// before they are all merged
+void group_by_parallel(TableType type, int size, int budget,
+		const int64 *keys, const long long *values, long n, int nthreads,
+		AggregateFunction emit, void *data, GroupByStats *stats) {
+	assert(nthreads > 0);
+	Worker *workers = malloc(sizeof *workers * nthreads);
+	pthread_t *threads = malloc(sizeof *threads * nthreads);
+	assert(workers && threads);
+
+	// the threads share the memory budget between them
+	int local_budget = budget / nthreads;
+	if (budget > 0 && local_budget == 0) {
+		local_budget = 1;
+	}
+
+	int t;
+	for (t = 0; t < nthreads; t++) {
+		long start = n * t / nthreads, end = n * (t + 1) / nthreads;
+		workers[t].group = new_group_by(type, size, local_budget);
+		workers[t].keys = keys + start;
+		workers[t].values = values + start;
+		workers[t].n = end - start;
+		int error = pthread_create(&threads[t], NULL, aggregate_part,
+			&workers[t]);
+		assert(error == 0 && "error: could not create thread");
+	}
+	for (t = 0; t < nthreads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	// merge the threads' groups into one group by with the whole budget
+	// (a single thread already had the whole budget, so needs no merging)
+	GroupBy *group = workers[0].group;
+	if (nthreads > 1) {
+		group = new_group_by(type, size, budget);
+		for (t = 0; t < nthreads; t++) {
+			group_by_merge(group, workers[t].group);
+		}
+	}
+
+	group_by_finish(group, emit, data);
+	if (stats) {
+		*stats = group_by_stats(group);
+	}
+	free_group_by(group);
+	free(threads);
+	free(workers);
+}
@@ -0,0 +1,78 @@
+/* * * * * * * * *
+ * Hash group-by aggregation: the count, sum, minimum and maximum of the
+ * values seen with each distinct key
+ *
+ * each group's running aggregate is stored directly in its table slot,
+ * using either the linear probing layout (one group per slot) or the
+ * extendible hashing layout (buckets of groups, split as they fill up).
+ * once 'budget' groups are held in memory, values for any new groups are
+ * partitioned into run files just as spill.c does with keys, and each run is
+ * aggregated separately once the input ends
+ */
+
+#ifndef GROUPBY_H
+#define GROUPBY_H
+
+#include "inthash.h"
+#include "hashtbl.h"
+
+// the aggregate state of a single group
+typedef struct aggregate {
+	int64 key;			// the key shared by this group's values
+	long long count;	// how many values were seen (never 0 for a group)
+	long long sum;		// their sum
+	long long min;		// the smallest of them
+	long long max;		// the largest of them
+} Aggregate;
+
+typedef struct group_by GroupBy;
+
+// function called with each group found while finishing a group by
+typedef void (*AggregateFunction)(void *data, const Aggregate *group);
+
+// statistics about a group by and all of the group bys it spilled into
+typedef struct group_by_stats {
+	long long ngroups;	// how many groups have been held in memory
+	long long nspilled;	// how many aggregates were written to run files
+	int nruns;			// how many run files were used
+	int maxlevel;		// deepest level of partitioning needed
+} GroupByStats;
+
+// create a group by using the layout of table type 'type' (LINEAR or
+// XTNDBLN) with 'size' initial slots (LINEAR) or keys per bucket (XTNDBLN),
+// keeping at most 'budget' groups in memory at once (or any number if
+// 'budget' is 0)
+GroupBy *new_group_by(TableType type, int size, int budget);
+
+// free all memory (and run files) associated with 'group'
+void free_group_by(GroupBy *group);
+
+// add 'value' to the group for 'key'
+void group_by_add(GroupBy *group, int64 key, long long value);
+
+// add each of the 'n' values in 'values' to the group for the corresponding
+// key in 'keys', hashing and prefetching a batch ahead of the updates
+void group_by_add_batch(GroupBy *group, const int64 *keys,
+	const long long *values, int n);
+
+// add every group of 'from' (including any it spilled) into 'into', then
+// free 'from'
+void group_by_merge(GroupBy *into, GroupBy *from);
+
+// pass every group of 'group' (along with 'data') to 'emit', aggregating its
+// run files one at a time. afterwards 'group' holds nothing, and may only be
+// freed
+void group_by_finish(GroupBy *group, AggregateFunction emit, void *data);
+
+// get statistics about 'group'
+GroupByStats group_by_stats(GroupBy *group);
+
+// aggregate the 'n' values in 'values' by the keys in 'keys' using 'nthreads'
+// threads, each pre-aggregating part of the input into a group by of its own
+// before they are all merged. groups are passed to 'emit' as for
+// group_by_finish, and statistics are stored in *stats (unless it is NULL)
+void group_by_parallel(TableType type, int size, int budget,
+	const int64 *keys, const long long *values, long n, int nthreads,
+	AggregateFunction emit, void *data, GroupByStats *stats);
+
+#endif
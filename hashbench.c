@@ -0,0 +1,409 @@
+/* * * * * * * * *
+ * Utility program that measures the speed and quality of the hash functions
+ * in inthash.c, over several distributions of keys
+ *
+ * usage:
+ *   make hashbench
+ *   ./hashbench [-n nkeys] [-b nbuckets] [-c trials]
+ *       nkeys:    how many keys to hash for throughput and bucket loads
+ *                 (default 1048576)
+ *       nbuckets: how many buckets to spread keys across for the
+ *                 chi-square test (default 65536)
+ *       trials:   how many cuckoo tables to fill for each failure rate
+ *                 (default 20)
+ *
+ * for each hash function, and each distribution of keys:
+ *   - latency: ns per hash when each key depends on the previous hash, so
+ *     that one hash can't start until the last one has finished
+ *   - throughput: ns per hash over an array of independent keys
+ *   - chi2/df: the chi-square statistic of how many keys land in each
+ *     bucket (hash modulo nbuckets), divided by its degrees of freedom.
+ *     close to 1 means as even as random; much more means clumping
+ * for each hash function, over uniformly random keys:
+ *   - avalanche: how often flipping each key bit flips each hash bit. the
+ *     mean number of hash bits flipped should be 15.5 of 31, and the worst
+ *     bias (how far the worst key bit/hash bit pair is from flipping half of
+ *     the time, from 0 to 1) should be near 0
+ * for each hash function, and each batch kernel this CPU supports:
+ *   - ns per hash when hashing uniformly random keys BATCH_SIZE at a time
+ *     with hash_batch_with, and its speedup over the scalar kernel (every
+ *     kernel's hashes are checked against the scalar function's)
+ * for each pair of hash functions, and each distribution of keys:
+ *   - cuckoo failures: the fraction of two-table cuckoo hash tables that
+ *     couldn't place every key at a load factor of 45%
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inthash.h"
+
+#define DEFAULT_KEYS (1 << 20)
+#define DEFAULT_BUCKETS 65536
+#define DEFAULT_TRIALS 20
+// how many keys to flip the bits of in the avalanche test
+#define AVALANCHE_KEYS 20000
+// the number of bits in each hash
+#define HASH_BITS 31
+// the size of each of the two tables in a cuckoo trial
+#define CUCKOO_SIZE (1 << 14)
+// the load factor of a cuckoo trial, across both tables
+#define CUCKOO_LOAD 0.45
+// how many keys to hash per call when timing the batch kernels
+#define BATCH_SIZE 256
+// how many displacements before a cuckoo insertion is said to have failed
+#define CUCKOO_MAX_LOOP 500
+
+typedef int (*HashFunction)(int64 key);
+
+// a hash function to measure
+typedef struct hash {
+	const char *name;
+	HashFunction function;
+	HashFn batch;	// which function the batch kernels compute instead
+} Hash;
+
+// the distributions keys can be drawn from
+typedef enum distribution {
+	UNIFORM,	// uniformly random 64-bit keys
+	SEQUENTIAL,	// consecutive integers
+	STRIDED,	// multiples of 4096, like page-aligned addresses
+	HIGHBITS,	// consecutive integers shifted up 40 bits: only high bits vary
+	NDISTRIBUTIONS
+} Distribution;
+
+static const char *distribution_names[] = { "uniform", "sequential",
+	"strided", "highbits" };
+
+static const Hash hashes[] = { { "h1", h1, HASH_H1 }, { "h2", h2, HASH_H2 },
+	{ "mix1", mix1, HASH_MIX1 }, { "mix2", mix2, HASH_MIX2 } };
+#define NHASHES (int)(sizeof hashes / sizeof hashes[0])
+
+// the pairs of hash functions to try as cuckoo tables' two hash functions
+static const int pairs[][2] = { { 0, 1 }, { 2, 3 } };
+#define NPAIRS (int)(sizeof pairs / sizeof pairs[0])
+
+typedef struct options {
+	long nkeys;
+	int nbuckets;
+	int ntrials;
+} Options;
+Options get_options(int argc, char **argv);
+
+// nanoseconds elapsed on a monotonic clock since some fixed point
+long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// xorshift64* pseudo-random number generator
+uint64_t next_random(uint64_t *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+// fill 'keys' with 'n' keys from distribution 'distribution', with 'seed'
+// choosing which ones
+void generate_keys(Distribution distribution, int64 *keys, long n,
+		uint64_t seed) {
+	uint64_t state = 0x9e3779b97f4a7c15ULL ^ (seed * 0xbf58476d1ce4e5b9ULL);
+	int64 base = seed * n;
+	long i;
+	for (i = 0; i < n; i++) {
+		switch (distribution) {
+			case UNIFORM:
+				keys[i] = next_random(&state);
+				break;
+			case SEQUENTIAL:
+				keys[i] = base + i;
+				break;
+			case STRIDED:
+				keys[i] = (base + i) * 4096;
+				break;
+			default:
+				keys[i] = (base + i) << 40;
+				break;
+		}
+	}
+}
+
+// ns per hash, hashing each of the 'n' keys in 'keys' combined with the
+// previous hash, so that every hash waits for the last
+double hash_latency(HashFunction hash, const int64 *keys, long n) {
+	long long start = now_ns();
+	int last = 0;
+	long i;
+	for (i = 0; i < n; i++) {
+		last = hash(keys[i] ^ last);
+	}
+	double ns = (double)(now_ns() - start) / n;
+	// use the result, so that the loop can't be thrown away
+	return last == -1 ? 0 : ns;
+}
+
+// ns per hash, hashing each of the 'n' keys in 'keys' into 'out'
+double hash_throughput(HashFunction hash, const int64 *keys, int *out,
+		long n) {
+	long long start = now_ns();
+	long i;
+	for (i = 0; i < n; i++) {
+		out[i] = hash(keys[i]);
+	}
+	return (double)(now_ns() - start) / n;
+}
+
+// ns per hash, hashing the 'n' keys in 'keys' into 'out' BATCH_SIZE at a
+// time with kernel 'kernel', and checking each hash against 'hash'
+double batch_throughput(const Hash *hash, HashKernel kernel,
+		const int64 *keys, int *out, long n) {
+	long long start = now_ns();
+	long i;
+	for (i = 0; i < n; i += BATCH_SIZE) {
+		int m = n - i < BATCH_SIZE ? n - i : BATCH_SIZE;
+		hash_batch_with(kernel, hash->batch, keys + i, m, out + i);
+	}
+	double ns = (double)(now_ns() - start) / n;
+
+	for (i = 0; i < n; i++) {
+		if (out[i] != hash->function(keys[i])) {
+			fprintf(stderr, "%s kernel gave %s(%llu) = %d, not %d\n",
+				hash_kernel_name(kernel), hash->name,
+				(unsigned long long)keys[i], out[i], hash->function(keys[i]));
+			exit(EXIT_FAILURE);
+		}
+	}
+	return ns;
+}
+
+// the chi-square statistic of the loads of 'nbuckets' buckets receiving the
+// 'n' keys in 'keys' (at their hash modulo 'nbuckets'), per degree of freedom
+double bucket_chi2(HashFunction hash, const int64 *keys, long n,
+		int nbuckets) {
+	long *loads = calloc(nbuckets, sizeof(long));
+	assert(loads);
+	long i;
+	for (i = 0; i < n; i++) {
+		loads[hash(keys[i]) % nbuckets]++;
+	}
+	double expected = (double)n / nbuckets;
+	double chi2 = 0;
+	int b;
+	for (b = 0; b < nbuckets; b++) {
+		double diff = loads[b] - expected;
+		chi2 += diff * diff / expected;
+	}
+	free(loads);
+	return chi2 / (nbuckets - 1);
+}
+
+// measure how flipping each bit of random keys flips each bit of their
+// hashes, storing the mean number of hash bits flipped in *mean and the
+// worst bias of any key bit/hash bit pair in *worst
+void avalanche(HashFunction hash, double *mean, double *worst) {
+	static long flips[64][HASH_BITS];
+	memset(flips, 0, sizeof flips);
+	uint64_t state = 0x2545f4914f6cdd1dULL;
+	long total = 0;
+	int k;
+	for (k = 0; k < AVALANCHE_KEYS; k++) {
+		int64 key = next_random(&state);
+		int original = hash(key);
+		int i;
+		for (i = 0; i < 64; i++) {
+			int changed = original ^ hash(key ^ (1ULL << i));
+			int j;
+			for (j = 0; j < HASH_BITS; j++) {
+				int flipped = changed >> j & 1;
+				flips[i][j] += flipped;
+				total += flipped;
+			}
+		}
+	}
+
+	*mean = (double)total / AVALANCHE_KEYS / 64;
+	*worst = 0;
+	int i, j;
+	for (i = 0; i < 64; i++) {
+		for (j = 0; j < HASH_BITS; j++) {
+			double bias = 2 * ((double)flips[i][j] / AVALANCHE_KEYS - 0.5);
+			if (bias < 0) {
+				bias = -bias;
+			}
+			if (bias > *worst) {
+				*worst = bias;
+			}
+		}
+	}
+}
+
+// try to place all 'n' keys in 'keys' in a two-table cuckoo hash table using
+// hash functions 'first' and 'second'
+// returns true if every key found a place
+bool cuckoo_fill(HashFunction first, HashFunction second, const int64 *keys,
+		long n) {
+	int64 *slots[2];
+	bool *inuse[2];
+	int t;
+	for (t = 0; t < 2; t++) {
+		slots[t] = malloc(sizeof(int64) * CUCKOO_SIZE);
+		inuse[t] = calloc(CUCKOO_SIZE, sizeof(bool));
+		assert(slots[t] && inuse[t]);
+	}
+
+	bool success = true;
+	long i;
+	for (i = 0; i < n && success; i++) {
+		int64 key = keys[i];
+		t = 0;
+		int loop;
+		for (loop = 0; loop < CUCKOO_MAX_LOOP; loop++) {
+			int h = (t == 0 ? first(key) : second(key)) % CUCKOO_SIZE;
+			if (!inuse[t][h]) {
+				slots[t][h] = key;
+				inuse[t][h] = true;
+				break;
+			}
+			if (slots[t][h] == key) {
+				break;
+			}
+			// kick out the key there, and place it in the other table
+			int64 evicted = slots[t][h];
+			slots[t][h] = key;
+			key = evicted;
+			t = 1 - t;
+		}
+		success = loop < CUCKOO_MAX_LOOP;
+	}
+
+	for (t = 0; t < 2; t++) {
+		free(slots[t]);
+		free(inuse[t]);
+	}
+	return success;
+}
+
+int main(int argc, char **argv) {
+	Options options = get_options(argc, argv);
+	int64 *keys = malloc(sizeof(int64) * options.nkeys);
+	int *out = malloc(sizeof(int) * options.nkeys);
+	assert(keys && out);
+
+	printf("%-6s %-10s %12s %14s %10s\n", "hash", "keys", "latency ns",
+		"throughput ns", "chi2/df");
+	int f;
+	Distribution d;
+	for (f = 0; f < NHASHES; f++) {
+		for (d = UNIFORM; d < NDISTRIBUTIONS; d++) {
+			generate_keys(d, keys, options.nkeys, 1);
+			double latency = hash_latency(hashes[f].function, keys,
+				options.nkeys);
+			double throughput = hash_throughput(hashes[f].function, keys, out,
+				options.nkeys);
+			double chi2 = bucket_chi2(hashes[f].function, keys, options.nkeys,
+				options.nbuckets);
+			printf("%-6s %-10s %12.2f %14.2f %10.3f\n", hashes[f].name,
+				distribution_names[d], latency, throughput, chi2);
+		}
+	}
+
+	printf("\n%-6s %16s %12s\n", "hash", "mean bits flipped", "worst bias");
+	for (f = 0; f < NHASHES; f++) {
+		double mean, worst;
+		avalanche(hashes[f].function, &mean, &worst);
+		printf("%-6s %16.2f %12.3f\n", hashes[f].name, mean, worst);
+	}
+
+	printf("\n%-6s %-8s %12s %10s\n", "hash", "kernel", "ns/hash",
+		"speedup");
+	generate_keys(UNIFORM, keys, options.nkeys, 1);
+	for (f = 0; f < NHASHES; f++) {
+		double scalar = 0;
+		HashKernel kernel;
+		for (kernel = HASH_KERNEL_SCALAR; kernel <= HASH_KERNEL_AVX512;
+				kernel++) {
+			if (!hash_kernel_supported(kernel)) {
+				continue;
+			}
+			double ns = batch_throughput(&hashes[f], kernel, keys, out,
+				options.nkeys);
+			if (kernel == HASH_KERNEL_SCALAR) {
+				scalar = ns;
+			}
+			printf("%-6s %-8s %12.2f %9.1fx\n", hashes[f].name,
+				hash_kernel_name(kernel), ns, ns > 0 ? scalar / ns : 0);
+		}
+	}
+
+	long ncuckoo = CUCKOO_LOAD * 2 * CUCKOO_SIZE;
+	printf("\n%-11s %-10s %16s\n", "pair", "keys", "cuckoo failures");
+	int p;
+	for (p = 0; p < NPAIRS; p++) {
+		const Hash *first = &hashes[pairs[p][0]];
+		const Hash *second = &hashes[pairs[p][1]];
+		char name[32];
+		snprintf(name, sizeof name, "%s/%s", first->name, second->name);
+		for (d = UNIFORM; d < NDISTRIBUTIONS; d++) {
+			int nfailed = 0;
+			int trial;
+			for (trial = 0; trial < options.ntrials; trial++) {
+				generate_keys(d, keys, ncuckoo, trial + 1);
+				nfailed += !cuckoo_fill(first->function, second->function,
+					keys, ncuckoo);
+			}
+			printf("%-11s %-10s %8d / %5d\n", name, distribution_names[d],
+				nfailed, options.ntrials);
+		}
+	}
+
+	free(keys);
+	free(out);
+	return 0;
+}
+
+// scans command line arguments for program options,
+// prints usage info and exits if commands are missing or otherwise invalid
+Options get_options(int argc, char **argv) {
+	Options options = { .nkeys = DEFAULT_KEYS, .nbuckets = DEFAULT_BUCKETS,
+		.ntrials = DEFAULT_TRIALS };
+
+	int option;
+	while ((option = getopt(argc, argv, "n:b:c:")) != -1) {
+		switch (option) {
+			case 'n': // set number of keys
+				options.nkeys = atol(optarg);
+				break;
+			case 'b': // set number of buckets
+				options.nbuckets = atoi(optarg);
+				break;
+			case 'c': // set number of cuckoo trials
+				options.ntrials = atoi(optarg);
+				break;
+			default:
+				break;
+		}
+	}
+
+	// the cuckoo trials reuse the key array, so it must fit their keys too
+	if (options.nkeys < CUCKOO_LOAD * 2 * CUCKOO_SIZE
+			|| options.nbuckets < 2 || options.ntrials <= 0) {
+		fprintf(stderr, "usage: %s [-n nkeys] [-b nbuckets] [-c trials]\n",
+			argv[0]);
+		fprintf(stderr, " nkeys: how many keys to hash (at least %d)\n",
+			(int)(CUCKOO_LOAD * 2 * CUCKOO_SIZE));
+		fprintf(stderr, " nbuckets: how many buckets to test loads across\n");
+		fprintf(stderr, " trials: how many cuckoo tables to fill\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return options;
+}
@@ -0,0 +1,305 @@
+/* * * * * * * * *
+ * Radix-partitioned hash join of two relations of keys, using any of the
+ * hash table types as the build side
+ *
+ * both relations are first partitioned by the high bits of each key's mix2
+ * hash, into enough partitions that each partition's table should fit in
+ * the L2 cache. then, in parallel, each partition's build keys are inserted
+ * into a small table of their own, and its probe keys are looked up in it
+ * in batches
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "hashjoin.h"
+#include "shards.h"
+
+// how many build keys each partition should hold, so that its table (at
+// very roughly 16 bytes of table per key) fits in a 256KB L2 cache
+#define KEYS_PER_PARTITION 16384
+// how many keys to hash per call to the batch hash kernels while
+// partitioning
+#define PARTITION_CHUNK 4096
+// the most bits of mix2 to partition on
+#define MAX_RADIX_BITS 14
+// how many probe keys to look up at once
+#define PROBE_BATCH 256
+
+// the counters each worker keeps in its own shard
+enum join_counter {
+	JOINED_PARTITIONS, BUILT_KEYS, PROBED_KEYS, MATCHED_KEYS
+};
+
+// a relation split into partitions: partition p occupies positions
+// start[p] to start[p+1]-1 of 'keys' (and 'rows')
+typedef struct partitioned {
+	int64 *keys;	// the keys, grouped by partition
+	long *rows;		// where each key came from in the original relation
+	long *start;	// where each partition starts (plus one past the end)
+} Partitioned;
+
+// the matches found in one partition
+typedef struct match_list {
+	JoinMatch *matches;
+	long nmatches;
+	long size;
+} MatchList;
+
+// everything the worker threads share
+typedef struct join {
+	TableType type;
+	int npartitions;
+	Partitioned build;
+	Partitioned probe;
+	MatchList *results;		// the matches found in each partition
+	int next;				// the next partition for a worker to take
+	pthread_mutex_t lock;	// protects 'next'
+	ShardedCounters counters;	// statistics, with a shard for each worker
+} Join;
+
+// what each worker thread is given
+typedef struct worker {
+	Join *join;
+	int shard;	// which shard of the join's counters this worker updates
+} Worker;
+
+
+/* * * *
+ * helper functions
+ */
+
+// store which of 2^'bits' partitions each of the 'n' keys in 'keys' belongs
+// to in 'parts', hashing them with the batch hash kernels
+static void partitions_of(const int64 *keys, long n, int bits, int *parts) {
+	long i;
+	for (i = 0; i < n; i += PARTITION_CHUNK) {
+		int m = n - i < PARTITION_CHUNK ? n - i : PARTITION_CHUNK;
+		// (not h1 or h2, which the partitions' tables hash with, since every
+		// key in a partition shares the bits that chose it)
+		hash_batch(HASH_MIX2, keys + i, m, parts + i);
+	}
+	for (i = 0; i < n; i++) {
+		parts[i] = bits == 0 ? 0 : parts[i] >> (31 - bits);
+	}
+}
+
+// partition the 'n' keys in 'keys' into 2^'bits' partitions, by counting
+// the size of each partition and then scattering keys into place
+static Partitioned partition(const int64 *keys, long n, int bits) {
+	int npartitions = 1 << bits;
+	Partitioned result;
+	result.keys = malloc(sizeof(int64) * (n > 0 ? n : 1));
+	result.rows = malloc(sizeof(long) * (n > 0 ? n : 1));
+	result.start = calloc(npartitions + 1, sizeof(long));
+	int *parts = malloc(sizeof(int) * (n > 0 ? n : 1));
+	assert(result.keys && result.rows && result.start && parts);
+	partitions_of(keys, n, bits, parts);
+
+	// first pass: how big is each partition?
+	long i;
+	for (i = 0; i < n; i++) {
+		result.start[parts[i] + 1]++;
+	}
+	int p;
+	for (p = 0; p < npartitions; p++) {
+		result.start[p + 1] += result.start[p];
+	}
+
+	// second pass: put each key at the next free position of its partition
+	long *next = malloc(sizeof(long) * npartitions);
+	assert(next);
+	for (p = 0; p < npartitions; p++) {
+		next[p] = result.start[p];
+	}
+	for (i = 0; i < n; i++) {
+		long pos = next[parts[i]]++;
+		result.keys[pos] = keys[i];
+		result.rows[pos] = i;
+	}
+	free(next);
+	free(parts);
+	return result;
+}
+
+static void free_partitioned(Partitioned *partitioned) {
+	free(partitioned->keys);
+	free(partitioned->rows);
+	free(partitioned->start);
+}
+
+// add a match to 'list', growing it if necessary
+static void add_match(MatchList *list, int64 key, long row) {
+	if (list->nmatches == list->size) {
+		list->size = list->size ? list->size * 2 : 64;
+		list->matches = realloc(list->matches,
+			sizeof(JoinMatch) * list->size);
+		assert(list->matches);
+	}
+	list->matches[list->nmatches].key = key;
+	list->matches[list->nmatches].probe_row = row;
+	list->nmatches++;
+}
+
+// a good initial size for a table of type 'type' that will hold 'nkeys' keys
+// (for the extendible tables, the size is a bucket size instead)
+static int initial_size(TableType type, long nkeys) {
+	switch (type) {
+		case LINEAR:
+			// linear tables only grow when full, so leave some room
+			return nkeys * 2;
+		case CUCKOO:
+			return nkeys;
+		default:
+			return 4;
+	}
+}
+
+// build and probe partition 'p' of 'join', counting what was done in shard
+// 'shard' of its counters
+static void join_partition(Join *join, int p, int shard) {
+	long build_start = join->build.start[p];
+	long nbuild = join->build.start[p + 1] - build_start;
+	long probe_start = join->probe.start[p];
+	long nprobe = join->probe.start[p + 1] - probe_start;
+	if (nbuild == 0 || nprobe == 0) {
+		return;
+	}
+
+	// build: size the table for its keys up front, where that is meaningful
+	HashTable *table = new_hash_table(join->type,
+		initial_size(join->type, nbuild));
+	assert(table);
+	hash_table_insert_batch(table, join->build.keys + build_start, nbuild,
+		NULL);
+
+	// probe, in batches
+	MatchList *results = &join->results[p];
+	long before = results->nmatches;
+	bool found[PROBE_BATCH];
+	long i;
+	for (i = 0; i < nprobe; i += PROBE_BATCH) {
+		int n = nprobe - i < PROBE_BATCH ? nprobe - i : PROBE_BATCH;
+		const int64 *keys = join->probe.keys + probe_start + i;
+		hash_table_lookup_batch(table, keys, n, found);
+		int j;
+		for (j = 0; j < n; j++) {
+			if (found[j]) {
+				add_match(results, keys[j],
+					join->probe.rows[probe_start + i + j]);
+			}
+		}
+	}
+
+	free_hash_table(table);
+
+	sharded_counter_add(&join->counters, shard, JOINED_PARTITIONS, 1);
+	sharded_counter_add(&join->counters, shard, BUILT_KEYS, nbuild);
+	sharded_counter_add(&join->counters, shard, PROBED_KEYS, nprobe);
+	sharded_counter_add(&join->counters, shard, MATCHED_KEYS,
+		results->nmatches - before);
+}
+
+// worker thread: keep taking partitions and joining them until none are left
+static void *join_worker(void *arg) {
+	Worker *worker = arg;
+	Join *join = worker->join;
+	while (true) {
+		pthread_mutex_lock(&join->lock);
+		int p = join->next++;
+		pthread_mutex_unlock(&join->lock);
+		if (p >= join->npartitions) {
+			return NULL;
+		}
+		join_partition(join, p, worker->shard);
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// join the 'nbuild' keys in 'build' with the 'nprobe' keys in 'probe' using
+// hash tables of type 'type' and 'nthreads' threads
+long hash_join(TableType type, const int64 *build, long nbuild,
+		const int64 *probe, long nprobe, int nthreads, JoinMatch **matches,
+		HashJoinStats *stats) {
+	assert(nthreads > 0);
+
+	// choose enough partitions for each to fit in cache
+	int bits = 0;
+	while (bits < MAX_RADIX_BITS
+			&& (nbuild >> bits) > KEYS_PER_PARTITION) {
+		bits++;
+	}
+
+	Join join;
+	join.type = type;
+	join.npartitions = 1 << bits;
+	join.build = partition(build, nbuild, bits);
+	join.probe = partition(probe, nprobe, bits);
+	join.results = calloc(join.npartitions, sizeof(MatchList));
+	assert(join.results);
+	join.next = 0;
+	pthread_mutex_init(&join.lock, NULL);
+	sharded_counters_init(&join.counters, nthreads);
+
+	// join all of the partitions in parallel
+	pthread_t *threads = malloc(sizeof(pthread_t) * nthreads);
+	Worker *workers = malloc(sizeof(Worker) * nthreads);
+	assert(threads && workers);
+	int t;
+	for (t = 0; t < nthreads; t++) {
+		workers[t].join = &join;
+		workers[t].shard = t;
+		pthread_create(&threads[t], NULL, join_worker, &workers[t]);
+	}
+	for (t = 0; t < nthreads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	free(threads);
+	free(workers);
+	pthread_mutex_destroy(&join.lock);
+
+	// every worker has finished, so the counters can be added up
+	if (stats) {
+		stats->npartitions = sharded_counter_total(&join.counters,
+			JOINED_PARTITIONS);
+		stats->nbuilt = sharded_counter_total(&join.counters, BUILT_KEYS);
+		stats->nprobed = sharded_counter_total(&join.counters, PROBED_KEYS);
+		stats->nmatches = sharded_counter_total(&join.counters, MATCHED_KEYS);
+		stats->maxbusy = 0;
+		for (t = 0; t < nthreads; t++) {
+			long long busy = sharded_counter_value(&join.counters, t,
+				JOINED_PARTITIONS);
+			if (busy > stats->maxbusy) {
+				stats->maxbusy = busy;
+			}
+		}
+	}
+	sharded_counters_free(&join.counters);
+
+	// gather the matches from each partition together
+	long nmatches = 0;
+	int p;
+	for (p = 0; p < join.npartitions; p++) {
+		nmatches += join.results[p].nmatches;
+	}
+	*matches = malloc(sizeof(JoinMatch) * (nmatches > 0 ? nmatches : 1));
+	assert(*matches);
+	long pos = 0;
+	for (p = 0; p < join.npartitions; p++) {
+		long i;
+		for (i = 0; i < join.results[p].nmatches; i++) {
+			(*matches)[pos++] = join.results[p].matches[i];
+		}
+		free(join.results[p].matches);
+	}
+
+	free(join.results);
+	free_partitioned(&join.build);
+	free_partitioned(&join.probe);
+	return nmatches;
+}
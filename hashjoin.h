@@ -0,0 +1,44 @@
+/* * * * * * * * *
+ * Radix-partitioned hash join of two relations of keys, using any of the
+ * hash table types as the build side
+ *
+ * both relations are first partitioned by the high bits of each key's mix2
+ * hash, into enough partitions that each partition's table should fit in
+ * the L2 cache. then, in parallel, each partition's build keys are inserted
+ * into a small table of their own, and its probe keys are looked up in it
+ * in batches
+ */
+
+#ifndef HASHJOIN_H
+#define HASHJOIN_H
+
+#include "inthash.h"
+#include "hashtbl.h"
+
+// a match between the relations: a probe key which is also a build key,
+// along with its position in the probe relation
+typedef struct join_match {
+	int64 key;		// the matching key (equal in both relations)
+	long probe_row;	// where this key appeared in the probe relation
+} JoinMatch;
+
+// statistics about a join, added up across all of its worker threads
+typedef struct hash_join_stats {
+	long long npartitions;	// how many partitions had keys on both sides
+	long long nbuilt;		// how many build keys were inserted into tables
+	long long nprobed;		// how many probe keys were looked up
+	long long nmatches;		// how many of those lookups found their key
+	long long maxbusy;		// the most partitions joined by any one worker
+} HashJoinStats;
+
+// join the 'nbuild' keys in 'build' with the 'nprobe' keys in 'probe' using
+// hash tables of type 'type' and 'nthreads' threads
+// stores a newly allocated array of every match in *matches (which the caller
+// must free), in no particular order, and statistics in *stats (unless it is
+// NULL)
+// returns the number of matches found
+long hash_join(TableType type, const int64 *build, long nbuild,
+	const int64 *probe, long nprobe, int nthreads, JoinMatch **matches,
+	HashJoinStats *stats);
+
+#endif
@@ -11,6 +11,9 @@
 #include <assert.h>
 
 #include "hashtbl.h"
+#include "trace.h"
+#include "capture.h"
+#include "front.h"
 
 #include "tables/linear.h"	// provided
 #include "tables/xtndbl1.h"	// provided
@@ -52,8 +55,84 @@ TableType strtotype(char *str) {
 struct table {
 	TableType type;	// what type of hash table is this?
 	void *table;	// the hash table itself
+	TraceRing *trace;	// the table's recent events, or NULL if not tracing
+	Capture *capture;	// where to record operations, or NULL if not capturing
+	FrontCache *front;	// recent lookup results, or NULL if not caching
+	bool forgets;		// can keys leave the table (by eviction or expiry)?
 };
 
+// insert 'key' into the table wrapped by 'table', without capturing it
+// returns true if insertion succeeds, false if it was already in there
+static bool insert_key(HashTable *table, int64 key) {
+	// forward the call onto the relevant insert function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_insert(table->table, key);
+		case XTNDBL1:
+			return xtndbl1_hash_table_insert(table->table, key);
+		case CUCKOO:
+			return cuckoo_hash_table_insert(table->table, key);
+		case XTNDBLN:
+			return xtndbln_hash_table_insert(table->table, key);
+		case XUCKOO:
+			return xuckoo_hash_table_insert(table->table, key);
+		case XUCKOON:
+			return xuckoon_hash_table_insert(table->table, key);
+		default:
+			return false;
+	}
+}
+
+// lookup whether 'key' is inside the table wrapped by 'table', without
+// capturing it
+// returns true if found, false if not
+static bool lookup_key(HashTable *table, int64 key) {
+	// forward the call onto the relevant lookup function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_lookup(table->table, key);
+		case XTNDBL1:
+			return xtndbl1_hash_table_lookup(table->table, key);
+		case CUCKOO:
+			return cuckoo_hash_table_lookup(table->table, key);
+		case XTNDBLN:
+			return xtndbln_hash_table_lookup(table->table, key);
+		case XUCKOO:
+			return xuckoo_hash_table_lookup(table->table, key);
+		case XUCKOON:
+			return xuckoon_hash_table_lookup(table->table, key);
+		default:
+			return false;
+	}
+}
+
+// lookup whether 'key' is inside the table wrapped by 'table', asking its
+// front cache first (if it has one), without capturing it
+// returns true if found, false if not
+static bool cached_lookup_key(HashTable *table, int64 key) {
+	if (table->front == NULL) {
+		return lookup_key(table, key);
+	}
+	FrontResult cached = front_cache_lookup(table->front, key);
+	if (cached != FRONT_MISS) {
+		return cached == FRONT_PRESENT;
+	}
+	bool found = lookup_key(table, key);
+	// a key found in a table that forgets keys could be gone by the next
+	// lookup, so only misses are worth caching there
+	if (!found || !table->forgets) {
+		front_cache_admit(table->front, key, found);
+	}
+	return found;
+}
+
+// tell the front cache of 'table' (if it has one) that 'key' is now in there
+static void cache_inserted(HashTable *table, int64 key) {
+	if (table->front) {
+		front_cache_inserted(table->front, key, !table->forgets);
+	}
+}
+
 // initialise a hash table of type 'type' with initial size 'size',
 // and return its pointer
 HashTable *new_hash_table(TableType type, int size) {
@@ -64,6 +143,10 @@ HashTable *new_hash_table(TableType type, int size) {
 
 	// store the table type, so we know which functions to call later
 	table->type = type;
+	table->trace = NULL;
+	table->capture = NULL;
+	table->front = NULL;
+	table->forgets = false;
 
 	// create and store the table itself
 	switch (type) {
@@ -122,6 +205,13 @@ void free_hash_table(HashTable *table) {
 			break;
 	}
 
+	if (table->trace) {
+		free_trace_ring(table->trace);
+	}
+	if (table->front) {
+		free_front_cache(table->front);
+	}
+
 	// free the wrapper struct itself
 	free(table);
 }
@@ -130,48 +220,436 @@ void free_hash_table(HashTable *table) {
 // returns true if insertion succeeds, false if it was already in there
 bool hash_table_insert(HashTable *table, int64 key) {
 	assert(table != NULL);
+	bool inserted = insert_key(table, key);
+	cache_inserted(table, key);
+	if (table->capture) {
+		capture_record(table->capture, CAPTURE_INSERT, key, 0, inserted);
+	}
+	return inserted;
+}
 
-	// forward the call onto the relevant insert function
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool hash_table_lookup(HashTable *table, int64 key) {
+	assert(table != NULL);
+	bool found = cached_lookup_key(table, key);
+	if (table->capture) {
+		capture_record(table->capture, CAPTURE_LOOKUP, key, 0, found);
+	}
+	return found;
+}
+
+// as hash_table_lookup, but for the cuckoo family (cuckoo, xuckoo and
+// xuckoon), both of the key's possible places are loaded before either is
+// checked, with no branches between them. other types, and tables with a
+// front cache, do a normal lookup
+bool hash_table_lookup_branchless(HashTable *table, int64 key) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant branchless lookup, if there is one
+	bool found;
+	switch (table->front ? NOTYPE : table->type) {
+		case CUCKOO:
+			found = cuckoo_hash_table_lookup_branchless(table->table, key);
+			break;
+		case XUCKOO:
+			found = xuckoo_hash_table_lookup_branchless(table->table, key);
+			break;
+		case XUCKOON:
+			found = xuckoon_hash_table_lookup_branchless(table->table, key);
+			break;
+		default:
+			found = cached_lookup_key(table, key);
+			break;
+	}
+	if (table->capture) {
+		capture_record(table->capture, CAPTURE_LOOKUP, key, 0, found);
+	}
+	return found;
+}
+
+// add 'delta' to the count of 'key' in 'table', inserting it with count
+// 'delta' if it's not in there already, in a single probe
+// 'delta' must be at least 1, so that a counted key's count is never 0
+// returns the key's new count, or 0 if this type of table can't count keys
+uint32_t hash_table_increment(HashTable *table, int64 key, uint32_t delta) {
+	assert(table != NULL);
+	assert(delta > 0);
+
+	// forward the call onto the relevant function, if there is one
+	uint32_t count;
 	switch (table->type) {
 		case LINEAR:
-			return linear_hash_table_insert(table->table, key);
-		case XTNDBL1:
-			return xtndbl1_hash_table_insert(table->table, key);
+			count = linear_hash_table_increment(table->table, key, delta);
+			break;
+		case XTNDBLN:
+			count = xtndbln_hash_table_increment(table->table, key, delta);
+			break;
+		default:
+			count = 0;
+			break;
+	}
+	// (so a count of 0 only means this table can't count keys)
+	if (count > 0) {
+		cache_inserted(table, key);
+	}
+
+	if (table->capture) {
+		capture_record(table->capture, CAPTURE_INCREMENT, key, delta, count);
+	}
+	return count;
+}
+
+// return the count of 'key' in 'table' (keys inserted with hash_table_insert
+// have a count of 1), or 0 if it's not in there
+uint32_t hash_table_count(HashTable *table, int64 key) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one, or
+	// otherwise fall back to whether the key is there at all
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_count(table->table, key);
+		case XTNDBLN:
+			return xtndbln_hash_table_count(table->table, key);
+		default:
+			return cached_lookup_key(table, key) ? 1 : 0;
+	}
+}
+
+// find the (up to) 'k' keys in 'table' with the highest counts, storing them
+// in 'keys' and their counts in 'counts' in descending order of count
+// returns the number of keys found (0 if this type of table can't count keys)
+int hash_table_top(HashTable *table, int k, int64 *keys, uint32_t *counts) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_top(table->table, k, keys, counts);
+		case XTNDBLN:
+			return xtndbln_hash_table_top(table->table, k, keys, counts);
+		default:
+			return 0;
+	}
+}
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', storing
+// the results in 'found'
+void hash_table_lookup_batch(HashTable *table, const int64 *keys, int n,
+		bool *found) {
+	assert(table != NULL);
+
+	// use the table's own batched lookup if it has one, which can overlap
+	// the cache misses of many lookups; otherwise (or if the front cache
+	// will answer most of them) look up one at a time
+	switch (table->front ? NOTYPE : table->type) {
+		case LINEAR:
+			linear_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
 		case CUCKOO:
-			return cuckoo_hash_table_insert(table->table, key);
+			cuckoo_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		default: {
+			int i;
+			for (i = 0; i < n; i++) {
+				found[i] = cached_lookup_key(table, keys[i]);
+			}
+			break;
+		}
+	}
+
+	if (table->capture) {
+		int i;
+		for (i = 0; i < n; i++) {
+			capture_record(table->capture, CAPTURE_LOOKUP, keys[i], 0,
+				found[i]);
+		}
+	}
+}
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 64 of found[i / 64] if keys[i] is and clearing it if not ('found'
+// must have room for (n + 63) / 64 words)
+void hash_table_lookup_mask(HashTable *table, const int64 *keys, int n,
+		uint64_t *found) {
+	assert(table != NULL);
+
+	// use the table's own bitmask lookup if it has one, which compares a
+	// vector of keys at a time; otherwise (or if the front cache will answer
+	// most of them) look up one at a time
+	int i;
+	if (table->type == CUCKOO && table->front == NULL) {
+		cuckoo_hash_table_lookup_mask(table->table, keys, n, found);
+	} else {
+		for (i = 0; i < n; i++) {
+			uint64_t bit = 1ULL << (i % 64);
+			if (i % 64 == 0) {
+				found[i / 64] = 0;
+			}
+			if (cached_lookup_key(table, keys[i])) {
+				found[i / 64] |= bit;
+			}
+		}
+	}
+
+	if (table->capture) {
+		for (i = 0; i < n; i++) {
+			capture_record(table->capture, CAPTURE_LOOKUP, keys[i], 0,
+				found[i / 64] >> (i % 64) & 1);
+		}
+	}
+}
+
+// insert each of the 'n' keys in 'keys' into 'table', recording whether each
+// one was newly inserted in 'inserted' (unless 'inserted' is NULL)
+// returns the number of keys newly inserted
+int hash_table_insert_batch(HashTable *table, const int64 *keys, int n,
+		bool *inserted) {
+	assert(table != NULL);
+
+	// the extendible tables insert the batch bucket by bucket, which gives
+	// the same results as inserting the keys in order unless keys can leave
+	// the table (and so depend on the order they were inserted in)
+	if (!table->forgets && (table->type == XTNDBLN || table->type == XUCKOON)) {
+		bool *news = inserted;
+		if (news == NULL && table->capture) {
+			news = malloc(sizeof(bool) * n);
+			assert(news);
+		}
+		int ninserted;
+		if (table->type == XTNDBLN) {
+			ninserted = xtndbln_hash_table_insert_batch(table->table, keys, n,
+				news);
+		} else {
+			ninserted = xuckoon_hash_table_insert_batch(table->table, keys, n,
+				news);
+		}
+		int i;
+		for (i = 0; i < n; i++) {
+			cache_inserted(table, keys[i]);
+			if (table->capture) {
+				capture_record(table->capture, CAPTURE_INSERT, keys[i], 0,
+					news[i]);
+			}
+		}
+		if (news != inserted) {
+			free(news);
+		}
+		return ninserted;
+	}
+
+	int ninserted = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		bool new = hash_table_insert(table, keys[i]);
+		if (inserted) {
+			inserted[i] = new;
+		}
+		ninserted += new;
+	}
+	return ninserted;
+}
+
+// note that keys can now leave 'table', dropping whatever its front cache
+// has cached as present
+static void forget_keys(HashTable *table) {
+	table->forgets = true;
+	if (table->front) {
+		front_cache_clear(table->front);
+	}
+}
+
+// bound 'table' to at most 'capacity' keys, evicting keys with CLOCK
+// (second-chance) replacement instead of growing past this size
+// returns true if successful, false if this type of table can't be bounded
+bool hash_table_set_capacity(HashTable *table, int capacity) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_set_capacity(table->table, capacity);
+			break;
 		case XTNDBLN:
-			return xtndbln_hash_table_insert(table->table, key);
+			xtndbln_hash_table_set_capacity(table->table, capacity);
+			break;
+		default:
+			return false;
+	}
+	forget_keys(table);
+	return true;
+}
+
+// the smallest capacity 'table' can be bounded to with hash_table_set_capacity
+// returns 0 if this type of table can't be bounded
+int hash_table_min_capacity(HashTable *table) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one
+	switch (table->type) {
+		case LINEAR:
+			return 1;
+		case XTNDBLN:
+			return xtndbln_hash_table_min_capacity(table->table);
+		default:
+			return 0;
+	}
+}
+
+// give keys inserted into 'table' from now on a time-to-live of 'ttl' ticks,
+// after which they are treated as absent and removed
+// (keys already in a table without a ttl get theirs from now)
+// returns true if successful, false if this type of table can't expire keys
+bool hash_table_set_ttl(HashTable *table, int ttl) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_set_ttl(table->table, ttl);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_set_ttl(table->table, ttl);
+			break;
+		default:
+			return false;
+	}
+	forget_keys(table);
+	return true;
+}
+
+// hold up to 'nkeys' newly inserted keys in a write buffer, which is merged
+// into the table (sorted so that each bucket is visited once) when it fills
+// (an insert then only reports a key as already in there if it is waiting in
+// the buffer: keys already in the table are only found when it is merged)
+// returns true if successful, false if this type of table can't buffer keys
+bool hash_table_set_buffer(HashTable *table, int nkeys) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one
+	switch (table->type) {
+		case XTNDBLN:
+			xtndbln_hash_table_set_buffer(table->table, nkeys);
+			return true;
+		default:
+			return false;
+	}
+}
+
+// move keys in 'table' forward whenever they are hit, as 'policy' says, so
+// that hot keys are found sooner: within their bucket in the xtndbln and
+// xuckoon tables, and into their first table in the cuckoo family
+// returns true if successful, false if this type of table can't reorder keys
+bool hash_table_set_reorder(HashTable *table, Reorder policy) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant function, if there is one
+	switch (table->type) {
+		case XTNDBLN:
+			xtndbln_hash_table_set_reorder(table->table, policy);
+			return true;
+		case CUCKOO:
+			cuckoo_hash_table_set_reorder(table->table, policy);
+			return true;
 		case XUCKOO:
-			return xuckoo_hash_table_insert(table->table, key);
+			xuckoo_hash_table_set_reorder(table->table, policy);
+			return true;
 		case XUCKOON:
-			return xuckoon_hash_table_insert(table->table, key);
+			xuckoon_hash_table_set_reorder(table->table, policy);
+			return true;
 		default:
 			return false;
 	}
 }
 
-// lookup whether 'key' is inside 'table'
-// returns true if found, false if not
-bool hash_table_lookup(HashTable *table, int64 key) {
+// advance the clock of 'table' to tick 'now', removing expired keys
+// ('now' must not be before the tick it was last advanced to)
+void hash_table_advance(HashTable *table, int now) {
 	assert(table != NULL);
+	if (table->capture) {
+		capture_record(table->capture, CAPTURE_ADVANCE, now, 0, 0);
+	}
 
-	// forward the call onto the relevant lookup function
+	// forward the call onto the relevant function, if there is one
 	switch (table->type) {
 		case LINEAR:
-			return linear_hash_table_lookup(table->table, key);
+			linear_hash_table_advance(table->table, now);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_advance(table->table, now);
+			break;
+		default:
+			break;
+	}
+}
+
+// start recording structural events in 'table', keeping the most recent
+// 'nevents' of them
+void hash_table_trace(HashTable *table, int nevents) {
+	assert(table != NULL);
+
+	// replace any existing ring with a fresh one
+	TraceRing *old = table->trace;
+	table->trace = new_trace_ring(nevents);
+
+	// and point the table at it
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_set_trace(table->table, table->trace);
+			break;
 		case XTNDBL1:
-			return xtndbl1_hash_table_lookup(table->table, key);
+			xtndbl1_hash_table_set_trace(table->table, table->trace);
+			break;
 		case CUCKOO:
-			return cuckoo_hash_table_lookup(table->table, key);
+			cuckoo_hash_table_set_trace(table->table, table->trace);
+			break;
 		case XTNDBLN:
-			return xtndbln_hash_table_lookup(table->table, key);
+			xtndbln_hash_table_set_trace(table->table, table->trace);
+			break;
 		case XUCKOO:
-			return xuckoo_hash_table_lookup(table->table, key);
+			xuckoo_hash_table_set_trace(table->table, table->trace);
+			break;
 		case XUCKOON:
-			return xuckoon_hash_table_lookup(table->table, key);
+			xuckoon_hash_table_set_trace(table->table, table->trace);
+			break;
 		default:
-			return false;
+			break;
+	}
+
+	if (old) {
+		free_trace_ring(old);
+	}
+}
+
+// put a front cache with room for about 'nkeys' keys in front of 'table',
+// replacing any it already has. the results of frequent lookups are kept in
+// the front cache, so that they cost one cache line instead of a walk
+// through the table. tables that forget keys only cache misses there
+void hash_table_front(HashTable *table, int nkeys) {
+	assert(table != NULL);
+	if (table->front) {
+		free_front_cache(table->front);
 	}
+	table->front = new_front_cache(nkeys);
+}
+
+// record every operation performed on 'table' from now on in 'capture', or
+// stop recording them if 'capture' is NULL
+void hash_table_capture(HashTable *table, Capture *capture) {
+	assert(table != NULL);
+	table->capture = capture;
+}
+
+// write the events recorded in 'table' to 'file' as Chrome trace JSON
+// returns false if 'table' isn't being traced
+bool hash_table_write_trace(HashTable *table, FILE *file) {
+	assert(table != NULL);
+	if (table->trace == NULL) {
+		return false;
+	}
+	trace_write_json(table->trace, file);
+	return true;
 }
 
 // print the contents of 'table' to stdout
@@ -230,4 +708,42 @@ void hash_table_stats(HashTable *table) {
 		default:
 			break;
 	}
-}
\ No newline at end of file
+
+	if (table->front) {
+		front_cache_stats(table->front);
+	}
+}
+
+// fill 'report' with a snapshot of the statistics of 'table'
+void hash_table_report(HashTable *table, StatsReport *report) {
+	assert(table != NULL);
+
+	// call the relevant report function
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_report(table->table, report);
+			break;
+		case XTNDBL1:
+			xtndbl1_hash_table_report(table->table, report);
+			break;
+		case CUCKOO:
+			cuckoo_hash_table_report(table->table, report);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_report(table->table, report);
+			break;
+		case XUCKOO:
+			xuckoo_hash_table_report(table->table, report);
+			break;
+		case XUCKOON:
+			xuckoon_hash_table_report(table->table, report);
+			break;
+		default:
+			stats_report_init(report, "none");
+			break;
+	}
+
+	if (table->front) {
+		front_cache_report(table->front, report);
+	}
+}
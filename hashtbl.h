@@ -9,8 +9,13 @@
 #ifndef HASHTBL_H
 #define HASHTBL_H
 
+#include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "inthash.h"
+#include "report.h"
+#include "capture.h"
+#include "reorder.h"
 
 // enumerated type containing constants for the various types of hash table
 // supported
@@ -43,10 +48,106 @@ bool hash_table_insert(HashTable *table, int64 key);
 // returns true if found, false if not
 bool hash_table_lookup(HashTable *table, int64 key);
 
+// as hash_table_lookup, but for the cuckoo family (cuckoo, xuckoo and
+// xuckoon), both of the key's possible places are loaded before either is
+// checked, with no branches between them. other types do a normal lookup
+bool hash_table_lookup_branchless(HashTable *table, int64 key);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', storing
+// the results in 'found'
+void hash_table_lookup_batch(HashTable *table, const int64 *keys, int n,
+	bool *found);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 64 of found[i / 64] if keys[i] is and clearing it if not ('found'
+// must have room for (n + 63) / 64 words)
+void hash_table_lookup_mask(HashTable *table, const int64 *keys, int n,
+	uint64_t *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', recording whether each
+// one was newly inserted in 'inserted' (unless 'inserted' is NULL)
+// xtndbln and xuckoon tables sort the batch by bucket before inserting it
+// returns the number of keys newly inserted
+int hash_table_insert_batch(HashTable *table, const int64 *keys, int n,
+	bool *inserted);
+
+// add 'delta' to the count of 'key' in 'table', inserting it with count
+// 'delta' if it's not in there already, in a single probe
+// 'delta' must be at least 1, so that a counted key's count is never 0
+// returns the key's new count, or 0 if this type of table can't count keys
+uint32_t hash_table_increment(HashTable *table, int64 key, uint32_t delta);
+
+// return the count of 'key' in 'table' (keys inserted with hash_table_insert
+// have a count of 1), or 0 if it's not in there
+uint32_t hash_table_count(HashTable *table, int64 key);
+
+// find the (up to) 'k' keys in 'table' with the highest counts, storing them
+// in 'keys' and their counts in 'counts' in descending order of count
+// returns the number of keys found (0 if this type of table can't count keys)
+int hash_table_top(HashTable *table, int k, int64 *keys, uint32_t *counts);
+
+// bound 'table' to at most 'capacity' keys, evicting keys with CLOCK
+// (second-chance) replacement instead of growing past this size
+// returns true if successful, false if this type of table can't be bounded
+bool hash_table_set_capacity(HashTable *table, int capacity);
+
+// the smallest capacity 'table' can be bounded to with hash_table_set_capacity
+// returns 0 if this type of table can't be bounded
+int hash_table_min_capacity(HashTable *table);
+
+// give keys inserted into 'table' from now on a time-to-live of 'ttl' ticks,
+// after which they are treated as absent and removed
+// (keys already in a table without a ttl get theirs from now)
+// returns true if successful, false if this type of table can't expire keys
+bool hash_table_set_ttl(HashTable *table, int ttl);
+
+// hold up to 'nkeys' newly inserted keys in a write buffer, which is merged
+// into the table (sorted so that each bucket is visited once) when it fills
+// (an insert then only reports a key as already in there if it is waiting in
+// the buffer: keys already in the table are only found when it is merged)
+// returns true if successful, false if this type of table can't buffer keys
+bool hash_table_set_buffer(HashTable *table, int nkeys);
+
+// move keys in 'table' forward whenever they are hit, as 'policy' says, so
+// that hot keys are found sooner: within their bucket in the xtndbln and
+// xuckoon tables, and into their first table in the cuckoo family
+// returns true if successful, false if this type of table can't reorder keys
+bool hash_table_set_reorder(HashTable *table, Reorder policy);
+
+// advance the clock of 'table' to tick 'now', removing expired keys
+// ('now' must not be before the tick it was last advanced to)
+void hash_table_advance(HashTable *table, int now);
+
+// start recording structural events in 'table' (resizes, bucket splits and
+// cuckoo cycles), keeping the most recent 'nevents' of them
+void hash_table_trace(HashTable *table, int nevents);
+
+// put a front cache with room for about 'nkeys' keys in front of 'table',
+// replacing any it already has. the results of frequent lookups are kept in
+// the front cache, so that they cost one cache line instead of a walk
+// through the table. tables that forget keys only cache misses there
+void hash_table_front(HashTable *table, int nkeys);
+
+// record every insert, lookup, increment and clock advance performed on
+// 'table' from now on in 'capture' (which the caller still owns), or stop
+// recording them if 'capture' is NULL
+void hash_table_capture(HashTable *table, Capture *capture);
+
+// write the events recorded in 'table' to 'file' as Chrome trace JSON
+// returns false if 'table' isn't being traced
+bool hash_table_write_trace(HashTable *table, FILE *file);
+
 // print the contents of 'table' to stdout
 void hash_table_print(HashTable *table);
 
 // print some statistics about 'table' to stdout
 void hash_table_stats(HashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table', as named
+// counters and histograms ready to be written out as JSON or Prometheus
+// metrics. tables do no locking of their own, so the snapshot must be taken
+// by the thread using 'table' (or while holding whatever lock guards it);
+// the report is a copy, and may then be written out from any thread
+void hash_table_report(HashTable *table, StatsReport *report);
+
 #endif
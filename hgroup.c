@@ -0,0 +1,158 @@
+/* * * * * * * * *
+ * Utility program that aggregates values by key with a hash group by,
+ * writing out the count, sum, minimum and maximum of each key's values
+ *
+ * usage:
+ *   make hgroup
+ *   ./hgroup -t type [-s size] [-j threads] [-m budget] [input] > groupfile
+ *       type:      which table layout to hold groups in (linear or xtndbln)
+ *       size:      initial number of slots (linear) or bucket size (xtndbln)
+ *       threads:   how many threads to pre-aggregate with (default 1)
+ *       budget:    maximum number of groups to hold in memory before
+ *                  spilling to disk (default unlimited)
+ *       input:     lines of 'key value' pairs (default stdin)
+ *       groupfile: one line of 'key count sum min max' per key, in no
+ *                  particular order
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inthash.h"
+#include "hashtbl.h"
+#include "groupby.h"
+
+#define DEFAULT_SIZE 1024
+
+typedef struct options {
+	TableType type;
+	int initial_size;
+	int nthreads;
+	int budget;
+	char *input;
+} Options;
+Options get_options(int argc, char **argv);
+
+// read every 'key value' pair in 'file' into newly allocated arrays, storing
+// the number of pairs in *n
+void read_pairs(FILE *file, int64 **keys, long long **values, long *n) {
+	long size = 1024, i = 0;
+	*keys = malloc(sizeof(int64) * size);
+	*values = malloc(sizeof(long long) * size);
+	assert(*keys && *values);
+	while (fscanf(file, "%llu %lld", &(*keys)[i], &(*values)[i]) == 2) {
+		i++;
+		if (i == size) {
+			size *= 2;
+			*keys = realloc(*keys, sizeof(int64) * size);
+			*values = realloc(*values, sizeof(long long) * size);
+			assert(*keys && *values);
+		}
+	}
+	*n = i;
+}
+
+// AggregateFunction printing each group to stdout
+void print_group(void *data, const Aggregate *group) {
+	printf("%llu %lld %lld %lld %lld\n", group->key, group->count, group->sum,
+		group->min, group->max);
+}
+
+// seconds elapsed on a monotonic clock since some fixed point
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	Options options = get_options(argc, argv);
+
+	FILE *input = stdin;
+	if (options.input) {
+		input = fopen(options.input, "r");
+		if (input == NULL) {
+			perror(options.input);
+			exit(EXIT_FAILURE);
+		}
+	}
+	int64 *keys;
+	long long *values;
+	long n;
+	read_pairs(input, &keys, &values, &n);
+	if (input != stdin) {
+		fclose(input);
+	}
+
+	double start = now_seconds();
+	GroupByStats stats;
+	group_by_parallel(options.type, options.initial_size, options.budget,
+		keys, values, n, options.nthreads, print_group, NULL, &stats);
+	double seconds = now_seconds() - start;
+
+	if (seconds <= 0) {
+		seconds = 1e-9;
+	}
+	fprintf(stderr, "aggregated %ld values into %lld groups\n", n,
+		stats.ngroups);
+	if (stats.nspilled > 0) {
+		fprintf(stderr, "spilled %lld aggregates to %d run files, "
+			"%d levels deep\n", stats.nspilled, stats.nruns, stats.maxlevel);
+	}
+	fprintf(stderr, "%.3f sec: %.0f values/sec\n", seconds, n / seconds);
+
+	free(keys);
+	free(values);
+	return 0;
+}
+
+// scans command line arguments for program options,
+// prints usage info and exits if commands are missing or otherwise invalid
+Options get_options(int argc, char **argv) {
+	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE,
+		.nthreads = 1, .budget = 0, .input = NULL };
+
+	int option;
+	while ((option = getopt(argc, argv, "t:s:j:m:")) != -1) {
+		switch (option) {
+			case 't': // set table layout
+				options.type = strtotype(optarg);
+				break;
+			case 's': // set initial size
+				options.initial_size = atoi(optarg);
+				break;
+			case 'j': // set number of threads
+				options.nthreads = atoi(optarg);
+				break;
+			case 'm': // set memory budget
+				options.budget = atoi(optarg);
+				break;
+			default:
+				break;
+		}
+	}
+	if (optind < argc) {
+		options.input = argv[optind++];
+	}
+
+	if ((options.type != LINEAR && options.type != XTNDBLN)
+			|| options.initial_size <= 0 || options.nthreads <= 0
+			|| options.budget < 0) {
+		fprintf(stderr, "usage: %s -t type [-s size] [-j threads] "
+			"[-m budget] [input] > groupfile\n", argv[0]);
+		fprintf(stderr, " type: linear or xtndbln\n");
+		fprintf(stderr, " size: initial table size (>0)\n");
+		fprintf(stderr, " threads: how many threads to aggregate with\n");
+		fprintf(stderr, " budget: maximum number of groups to hold in memory "
+			"before spilling to disk\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return options;
+}
@@ -0,0 +1,114 @@
+/* * * * * * * * *
+ * Small fixed-size histograms of non-negative integers, for describing the
+ * shape of a hash table (probe lengths, bucket occupancy, local depths and
+ * so on) rather than just its averages
+ */
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "histogram.h"
+
+
+/* * * *
+ * helper functions
+ */
+
+// which bin of 'histogram' does 'value' belong in?
+static int bin_of(Histogram *histogram, long long value) {
+	int bin;
+	if (histogram->log2) {
+		// bin b > 0 holds values from 2^(b-1) to 2^b - 1
+		bin = 0;
+		while (value > 0) {
+			value >>= 1;
+			bin++;
+		}
+	} else {
+		bin = value < HISTOGRAM_BINS ? value : HISTOGRAM_BINS;
+	}
+	return bin < histogram->nbins ? bin : histogram->nbins - 1;
+}
+
+// write the range of values counted by bin 'bin' of 'histogram' into 'label'
+static void bin_label(Histogram *histogram, int bin, char *label, int size) {
+	long long low, high;
+	bool bounded = histogram_bin_range(histogram, bin, &low, &high);
+	if (!bounded && histogram->max > high) {
+		// the last bin also counts every larger value
+		snprintf(label, size, "%lld+", low);
+	} else if (low == high) {
+		snprintf(label, size, "%lld", low);
+	} else {
+		snprintf(label, size, "%lld-%lld", low, high);
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// set up 'histogram' with 'nbins' empty bins
+void histogram_init(Histogram *histogram, int nbins, bool log2) {
+	assert(nbins > 0 && nbins <= HISTOGRAM_BINS);
+	int i;
+	for (i = 0; i < HISTOGRAM_BINS; i++) {
+		histogram->counts[i] = 0;
+	}
+	histogram->nbins = nbins;
+	histogram->log2 = log2;
+	histogram->total = 0;
+	histogram->sum = 0;
+	histogram->max = 0;
+}
+
+// add 'value' (>= 0) to 'histogram'
+void histogram_add(Histogram *histogram, long long value) {
+	assert(value >= 0);
+	histogram->counts[bin_of(histogram, value)]++;
+	histogram->total++;
+	histogram->sum += value;
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+// find the range of values counted by bin 'bin' of 'histogram'
+// returns false if the bin also counts values above *high
+bool histogram_bin_range(const Histogram *histogram, int bin, long long *low,
+		long long *high) {
+	*low = *high = bin;
+	if (histogram->log2 && bin > 0) {
+		*low = 1LL << (bin - 1);
+		*high = (1LL << bin) - 1;
+	}
+	return bin < histogram->nbins - 1;
+}
+
+// print 'histogram' to stdout under the heading 'title'
+void histogram_print(Histogram *histogram, const char *title) {
+	if (histogram->total == 0) {
+		printf(" %s: none\n", title);
+		return;
+	}
+	printf(" %s: %lld values, mean %.3f, max %lld\n", title,
+		histogram->total, histogram->sum * 1.0 / histogram->total,
+		histogram->max);
+
+	// only print the bins from the first non-empty one to the last
+	int first = 0, last = histogram->nbins - 1;
+	while (histogram->counts[first] == 0) {
+		first++;
+	}
+	while (histogram->counts[last] == 0) {
+		last--;
+	}
+	int bin;
+	for (bin = first; bin <= last; bin++) {
+		char label[32];
+		bin_label(histogram, bin, label, sizeof label);
+		printf("%12s: %lld (%.1f%%)\n", label, histogram->counts[bin],
+			histogram->counts[bin] * 100.0 / histogram->total);
+	}
+}
@@ -0,0 +1,45 @@
+/* * * * * * * * *
+ * Small fixed-size histograms of non-negative integers, for describing the
+ * shape of a hash table (probe lengths, bucket occupancy, local depths and
+ * so on) rather than just its averages
+ *
+ * bins are either one value wide, with the last bin also counting every
+ * larger value, or (for long-tailed distributions) powers of two wide:
+ * 0, 1, 2-3, 4-7, 8-15, ...
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdbool.h>
+
+// the most bins a histogram can have
+#define HISTOGRAM_BINS 32
+
+typedef struct histogram {
+	long long counts[HISTOGRAM_BINS];	// how many values fell in each bin
+	int nbins;			// how many bins are in use
+	bool log2;			// are the bins powers of two wide?
+	long long total;	// how many values have been added
+	long long sum;		// their sum, for the mean
+	long long max;		// the largest of them
+} Histogram;
+
+// set up 'histogram' with 'nbins' empty bins (at most HISTOGRAM_BINS), which
+// are powers of two wide if 'log2' is true, or one value wide if not
+void histogram_init(Histogram *histogram, int nbins, bool log2);
+
+// add 'value' (>= 0) to 'histogram'
+void histogram_add(Histogram *histogram, long long value);
+
+// find the range of values counted by bin 'bin' of 'histogram', storing its
+// lower and upper bounds in *low and *high
+// returns false if the bin is the last one and also counts values above *high
+bool histogram_bin_range(const Histogram *histogram, int bin, long long *low,
+	long long *high);
+
+// print 'histogram' to stdout under the heading 'title', one line per bin
+// from the first non-empty one to the last
+void histogram_print(Histogram *histogram, const char *title);
+
+#endif
@@ -0,0 +1,149 @@
+/* * * * * * * * *
+ * Utility program that joins two files of keys with a radix-partitioned hash
+ * join, writing out each key of the probe file that is also in the build file
+ *
+ * usage:
+ *   make hjoin
+ *   ./hjoin -t type [-j threads] [-b] buildfile probefile > matchfile
+ *       type:      which hash table to build partitions with (as for a2)
+ *       threads:   how many threads to build and probe with (default 1)
+ *       -b:        keys are raw 8 byte binary integers rather than text
+ *       buildfile: keys to build tables from
+ *       probefile: keys to look up in those tables
+ *       matchfile: matching probe keys, one per line, with their position in
+ *                  probefile, in no particular order
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inthash.h"
+#include "hashtbl.h"
+#include "hashjoin.h"
+
+typedef struct options {
+	TableType type;
+	int nthreads;
+	bool binary;
+	char *build;
+	char *probe;
+} Options;
+Options get_options(int argc, char **argv);
+
+// read every key in the file 'name' into a newly allocated array, storing the
+// number of keys in *nkeys
+int64 *read_keys(char *name, bool binary, long *nkeys) {
+	FILE *file = fopen(name, binary ? "rb" : "r");
+	if (file == NULL) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+
+	long size = 1024, n = 0;
+	int64 *keys = malloc(sizeof(int64) * size);
+	assert(keys);
+	while (true) {
+		if (n == size) {
+			size *= 2;
+			keys = realloc(keys, sizeof(int64) * size);
+			assert(keys);
+		}
+		if (binary) {
+			size_t got = fread(keys + n, sizeof(int64), size - n, file);
+			if (got == 0) {
+				break;
+			}
+			n += got;
+		} else {
+			if (fscanf(file, "%llu", &keys[n]) != 1) {
+				break;
+			}
+			n++;
+		}
+	}
+
+	fclose(file);
+	*nkeys = n;
+	return keys;
+}
+
+// seconds elapsed on a monotonic clock since some fixed point
+double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	Options options = get_options(argc, argv);
+
+	long nbuild, nprobe;
+	int64 *build = read_keys(options.build, options.binary, &nbuild);
+	int64 *probe = read_keys(options.probe, options.binary, &nprobe);
+
+	double start = now_seconds();
+	JoinMatch *matches;
+	HashJoinStats stats;
+	long nmatches = hash_join(options.type, build, nbuild, probe, nprobe,
+		options.nthreads, &matches, &stats);
+	double seconds = now_seconds() - start;
+
+	long i;
+	for (i = 0; i < nmatches; i++) {
+		printf("%llu %ld\n", matches[i].key, matches[i].probe_row);
+	}
+
+	if (seconds <= 0) {
+		seconds = 1e-9;
+	}
+	fprintf(stderr, "joined %ld build keys with %ld probe keys: %ld matches\n",
+		nbuild, nprobe, nmatches);
+	fprintf(stderr, "joined %lld partitions, at most %lld by one thread\n",
+		stats.npartitions, stats.maxbusy);
+	fprintf(stderr, "%.3f sec: %.0f keys/sec\n", seconds,
+		(nbuild + nprobe) / seconds);
+
+	free(matches);
+	free(build);
+	free(probe);
+	return 0;
+}
+
+// scans command line arguments for program options,
+// prints usage info and exits if commands are missing or otherwise invalid
+Options get_options(int argc, char **argv) {
+	Options options = { .type = NOTYPE, .nthreads = 1, .binary = false };
+
+	int option;
+	while ((option = getopt(argc, argv, "t:j:b")) != -1) {
+		switch (option) {
+			case 't': // set hash table type
+				options.type = strtotype(optarg);
+				break;
+			case 'j': // set number of threads
+				options.nthreads = atoi(optarg);
+				break;
+			case 'b': // read binary keys
+				options.binary = true;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (options.type == NOTYPE || options.nthreads <= 0
+			|| argc - optind < 2) {
+		fprintf(stderr, "usage: %s -t type [-j threads] [-b] "
+			"buildfile probefile > matchfile\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	options.build = argv[optind];
+	options.probe = argv[optind + 1];
+	return options;
+}
@@ -5,8 +5,17 @@
  * by Matt Farrugia <matt.farrugia@unimelb.edu.au>
  */
 
+#include <assert.h>
+
 #include "inthash.h"
 
+// the vector kernels need x86 intrinsics, and GCC-style target attributes
+// so that they can be compiled without assuming every CPU has them
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_VECTOR_KERNELS
+#include <immintrin.h>
+#endif
+
 // constants for first hash function
 #define A1 885390553
 #define B1 639360243
@@ -17,6 +26,20 @@
 #define B2 306837493
 #define p2 2147483563
 
+// seeds for the mixing hash functions
+#define S1 0x9e3779b97f4a7c15ULL
+#define S2 0xc2b2ae3d27d4eb4fULL
+
+// the constants of fmix64's multiplications
+#define M1 0xff51afd7ed558ccdULL
+#define M2 0xc4ceb9fe1a85ec53ULL
+
+// each hash function, indexed by HashFn
+static int (*const functions[])(int64) = { h1, h2, mix1, mix2 };
+
+// the name of each kernel, indexed by HashKernel
+static const char *kernel_names[] = { "scalar", "avx2", "avx512" };
+
 // first available hash function
 int h1(int64 k) {
 	return (A1 * k + B1) % p1;
@@ -26,3 +49,232 @@ int h1(int64 k) {
 int h2(int64 k) {
 	return (A2 * k + B2) % p2;
 }
+
+// MurmurHash3's 64-bit finaliser: a bijection on 64-bit integers in which
+// each input bit affects each output bit with probability close to 1/2
+static uint64_t fmix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= M1;
+	k ^= k >> 33;
+	k *= M2;
+	k ^= k >> 33;
+	return k;
+}
+
+// first mixing hash function
+int mix1(int64 k) {
+	return fmix64(k ^ S1) >> 33;
+}
+
+// second mixing hash function
+int mix2(int64 k) {
+	return fmix64(k ^ S2) >> 33;
+}
+
+
+/* * * *
+ * batch kernels
+ *
+ * h1 and h2 reduce x = A * k + B modulo a prime p = 2^31 - c. since
+ * 2^31 = c (mod p), splitting x into its top and bottom 31 bits and adding
+ * c times the top to the bottom leaves x's residue unchanged. two such folds
+ * bring any 64-bit x below 2^31 + 2^16 (less than 2p), and a conditional
+ * subtraction of p finishes the job
+ */
+
+#ifdef HAVE_VECTOR_KERNELS
+
+// the low 64 bits of each lane of 'a' times 'b' (AVX2 has no 64-bit
+// multiply, so this is built from 32x32-bit ones)
+__attribute__((target("avx2")))
+static __m256i mul64_avx2(__m256i a, uint64_t b) {
+	__m256i blo = _mm256_set1_epi64x(b & 0xffffffff);
+	__m256i bhi = _mm256_set1_epi64x(b >> 32);
+	__m256i cross = _mm256_add_epi64(
+		_mm256_mul_epu32(_mm256_srli_epi64(a, 32), blo),
+		_mm256_mul_epu32(a, bhi));
+	return _mm256_add_epi64(_mm256_mul_epu32(a, blo),
+		_mm256_slli_epi64(cross, 32));
+}
+
+// each lane of 'x' modulo 'p' (just under 2^31)
+__attribute__((target("avx2")))
+static __m256i mod_prime_avx2(__m256i x, uint64_t p) {
+	__m256i low31 = _mm256_set1_epi64x(0x7fffffff);
+	__m256i c = _mm256_set1_epi64x(0x80000000ULL - p);
+
+	// first fold: the top part has 33 bits, too many for a 32-bit multiply,
+	// so its top bit (x's bit 63) is multiplied by c separately
+	__m256i top = _mm256_slli_epi64(
+		_mm256_mul_epu32(_mm256_srli_epi64(x, 63), c), 32);
+	x = _mm256_add_epi64(
+		_mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 31), c), top),
+		_mm256_and_si256(x, low31));
+	// second fold
+	x = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 31), c),
+		_mm256_and_si256(x, low31));
+
+	// every lane is now well below 2^63, so a signed comparison will do
+	__m256i over = _mm256_cmpgt_epi64(x, _mm256_set1_epi64x(p - 1));
+	return _mm256_sub_epi64(x, _mm256_and_si256(over, _mm256_set1_epi64x(p)));
+}
+
+// fmix64 of each lane of 'k'
+__attribute__((target("avx2")))
+static __m256i fmix64_avx2(__m256i k) {
+	k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+	k = mul64_avx2(k, M1);
+	k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+	k = mul64_avx2(k, M2);
+	return _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+}
+
+// hash as many of the 'n' keys in 'keys' as fill whole vectors of 4
+// returns how many keys were hashed
+__attribute__((target("avx2")))
+static int batch_avx2(HashFn fn, const int64 *keys, int n, int *hashes) {
+	// the low 32 bits of each lane, gathered into the bottom half
+	__m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256i k = _mm256_loadu_si256((const __m256i *)(keys + i));
+		__m256i x;
+		switch (fn) {
+			case HASH_H1:
+				x = mod_prime_avx2(_mm256_add_epi64(mul64_avx2(k, A1),
+					_mm256_set1_epi64x(B1)), p1);
+				break;
+			case HASH_H2:
+				x = mod_prime_avx2(_mm256_add_epi64(mul64_avx2(k, A2),
+					_mm256_set1_epi64x(B2)), p2);
+				break;
+			case HASH_MIX1:
+				x = _mm256_srli_epi64(fmix64_avx2(
+					_mm256_xor_si256(k, _mm256_set1_epi64x(S1))), 33);
+				break;
+			default:
+				x = _mm256_srli_epi64(fmix64_avx2(
+					_mm256_xor_si256(k, _mm256_set1_epi64x(S2))), 33);
+				break;
+		}
+		x = _mm256_permutevar8x32_epi32(x, low_halves);
+		_mm_storeu_si128((__m128i *)(hashes + i), _mm256_castsi256_si128(x));
+	}
+	return i;
+}
+
+// each lane of 'x' modulo 'p' (just under 2^31)
+__attribute__((target("avx512f,avx512dq")))
+static __m512i mod_prime_avx512(__m512i x, uint64_t p) {
+	__m512i low31 = _mm512_set1_epi64(0x7fffffff);
+	__m512i c = _mm512_set1_epi64(0x80000000ULL - p);
+	x = _mm512_add_epi64(_mm512_mullo_epi64(_mm512_srli_epi64(x, 31), c),
+		_mm512_and_si512(x, low31));
+	x = _mm512_add_epi64(_mm512_mullo_epi64(_mm512_srli_epi64(x, 31), c),
+		_mm512_and_si512(x, low31));
+	__m512i vp = _mm512_set1_epi64(p);
+	return _mm512_mask_sub_epi64(x, _mm512_cmpge_epu64_mask(x, vp), x, vp);
+}
+
+// fmix64 of each lane of 'k'
+__attribute__((target("avx512f,avx512dq")))
+static __m512i fmix64_avx512(__m512i k) {
+	k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+	k = _mm512_mullo_epi64(k, _mm512_set1_epi64(M1));
+	k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+	k = _mm512_mullo_epi64(k, _mm512_set1_epi64(M2));
+	return _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+}
+
+// hash as many of the 'n' keys in 'keys' as fill whole vectors of 8
+// returns how many keys were hashed
+__attribute__((target("avx512f,avx512dq")))
+static int batch_avx512(HashFn fn, const int64 *keys, int n, int *hashes) {
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m512i k = _mm512_loadu_si512(keys + i);
+		__m512i x;
+		switch (fn) {
+			case HASH_H1:
+				x = mod_prime_avx512(_mm512_add_epi64(
+					_mm512_mullo_epi64(k, _mm512_set1_epi64(A1)),
+					_mm512_set1_epi64(B1)), p1);
+				break;
+			case HASH_H2:
+				x = mod_prime_avx512(_mm512_add_epi64(
+					_mm512_mullo_epi64(k, _mm512_set1_epi64(A2)),
+					_mm512_set1_epi64(B2)), p2);
+				break;
+			case HASH_MIX1:
+				x = _mm512_srli_epi64(fmix64_avx512(
+					_mm512_xor_si512(k, _mm512_set1_epi64(S1))), 33);
+				break;
+			default:
+				x = _mm512_srli_epi64(fmix64_avx512(
+					_mm512_xor_si512(k, _mm512_set1_epi64(S2))), 33);
+				break;
+		}
+		_mm256_storeu_si256((__m256i *)(hashes + i), _mm512_cvtepi64_epi32(x));
+	}
+	return i;
+}
+
+#endif
+
+// store hash function 'fn' of each of the 'n' keys in 'keys' in 'hashes',
+// using the best kernel this CPU supports
+void hash_batch(HashFn fn, const int64 *keys, int n, int *hashes) {
+	hash_batch_with(hash_kernel_best(), fn, keys, n, hashes);
+}
+
+// as hash_batch, but using kernel 'kernel', which this CPU must support
+void hash_batch_with(HashKernel kernel, HashFn fn, const int64 *keys, int n,
+		int *hashes) {
+	assert(hash_kernel_supported(kernel));
+	int i = 0;
+#ifdef HAVE_VECTOR_KERNELS
+	if (kernel == HASH_KERNEL_AVX512) {
+		i = batch_avx512(fn, keys, n, hashes);
+	} else if (kernel == HASH_KERNEL_AVX2) {
+		i = batch_avx2(fn, keys, n, hashes);
+	}
+#endif
+	// the scalar kernel, and the keys left over from the vector kernels
+	int (*hash)(int64) = functions[fn];
+	for (; i < n; i++) {
+		hashes[i] = hash(keys[i]);
+	}
+}
+
+// can this CPU run kernel 'kernel'?
+bool hash_kernel_supported(HashKernel kernel) {
+	switch (kernel) {
+		case HASH_KERNEL_SCALAR:
+			return true;
+#ifdef HAVE_VECTOR_KERNELS
+		case HASH_KERNEL_AVX2:
+			return __builtin_cpu_supports("avx2");
+		case HASH_KERNEL_AVX512:
+			return __builtin_cpu_supports("avx512f")
+				&& __builtin_cpu_supports("avx512dq");
+#endif
+		default:
+			return false;
+	}
+}
+
+// the best kernel this CPU supports
+HashKernel hash_kernel_best() {
+	if (hash_kernel_supported(HASH_KERNEL_AVX512)) {
+		return HASH_KERNEL_AVX512;
+	}
+	if (hash_kernel_supported(HASH_KERNEL_AVX2)) {
+		return HASH_KERNEL_AVX2;
+	}
+	return HASH_KERNEL_SCALAR;
+}
+
+// the name of kernel 'kernel' (e.g. "avx2")
+const char *hash_kernel_name(HashKernel kernel) {
+	return kernel_names[kernel];
+}
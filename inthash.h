@@ -10,6 +10,7 @@
 #define INTHASH_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // the maximum allowable table size; 2^27 = ~134 million entries
 // a table with this many 8 byte entries (e.g. pointers or 64-bit integers)
@@ -36,4 +37,54 @@ int h1(int64 k);
 // second available hash function
 int h2(int64 k);
 
+// the following functions are an alternative family of hash functions, which
+// mix every bit of the key into every bit of the hash with the 64-bit
+// finaliser from MurmurHash3 (each using a different seed). like h1 and h2,
+// they return a non-negative 31-bit hash, so they can be swapped in for them
+
+// first mixing hash function
+int mix1(int64 k);
+
+// second mixing hash function
+int mix2(int64 k);
+
+// the following functions hash a whole batch of keys at once, giving exactly
+// the same hashes as calling one of the functions above on each key in turn.
+// h1 and h2 are computed without any division (reducing modulo p by folding,
+// since p is just under 2^31), so that several keys can be hashed per
+// instruction with the CPU's vector instructions. the widest kernel this CPU
+// supports is chosen at run time, with a plain scalar loop as the fallback
+
+// which hash function to compute over a batch
+typedef enum hash_fn {
+	HASH_H1,
+	HASH_H2,
+	HASH_MIX1,
+	HASH_MIX2
+} HashFn;
+
+// the ways of computing a batch of hashes
+typedef enum hash_kernel {
+	HASH_KERNEL_SCALAR,	// one key at a time
+	HASH_KERNEL_AVX2,	// 4 keys per instruction
+	HASH_KERNEL_AVX512	// 8 keys per instruction
+} HashKernel;
+
+// store hash function 'fn' of each of the 'n' keys in 'keys' in 'hashes',
+// using the best kernel this CPU supports
+void hash_batch(HashFn fn, const int64 *keys, int n, int *hashes);
+
+// as hash_batch, but using kernel 'kernel', which this CPU must support
+void hash_batch_with(HashKernel kernel, HashFn fn, const int64 *keys, int n,
+	int *hashes);
+
+// can this CPU run kernel 'kernel'?
+bool hash_kernel_supported(HashKernel kernel);
+
+// the best kernel this CPU supports
+HashKernel hash_kernel_best();
+
+// the name of kernel 'kernel' (e.g. "avx2")
+const char *hash_kernel_name(HashKernel kernel);
+
 #endif
@@ -6,20 +6,38 @@
  * by Matt Farrugia <matt.farrugia@unimelb.edu.au>
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include <getopt.h>
 
 #include "inthash.h"
 #include "hashtbl.h"
+#include "capture.h"
+#include "histogram.h"
 
 // command line options
 #define DEFAULT_SIZE 4
+// how many of the most recent table events to keep when tracing
+#define TRACE_EVENTS 65536
+// waits shorter than this (in nanoseconds) are spun through when replaying
+#define SPIN_NS 200000
 typedef struct options {
 	TableType type;
 	int initial_size;
+	int capacity;	// maximum number of keys, or 0 for unbounded
+	int ttl;		// how many ticks keys live for, or 0 for forever
+	Reorder reorder;	// how keys move forward when they are hit
+	int front;		// keys in a front cache before the table, or 0 for none
+	int buffer;		// keys in a write buffer for inserts, or 0 for none
+	char *trace;	// file to write a trace of table events to, or NULL
+	char *capture;	// file to capture the operations performed to, or NULL
+	char *replay;	// file of captured operations to replay, or NULL
+	bool paced;		// replay operations at their captured times?
 } Options;
 Options get_options(int argc, char** argv);
 
@@ -30,6 +48,11 @@ Options get_options(int argc, char** argv);
 #define LOOKUP 'l'
 #define PRINT  'p'
 #define STATS  's'
+#define JSON   'j'
+#define METRICS 'm'
+#define TICK   't'
+#define COUNT  '+'
+#define TOP    'k'
 #define HELP   'h'
 #define QUIT   'q'
 #define MAX_LINE_LEN 80
@@ -39,6 +62,9 @@ int get_command(char *operation, int64 *key);
 // main program
 
 void run_interpreter(HashTable *table);
+void print_top(HashTable *table, int k);
+void print_report(HashTable *table, bool json);
+void run_replay(HashTable *table, char *filename, bool paced);
 
 int main(int argc, char **argv) {
 	
@@ -48,8 +74,93 @@ int main(int argc, char **argv) {
 	// create hashtable (of given type)
 	HashTable *table = new_hash_table(options.type, options.initial_size);
 
-	// start the interpreter loop
-	run_interpreter(table);
+	// bound its size, if we were asked to
+	if (options.capacity > 0) {
+		int min_capacity = hash_table_min_capacity(table);
+		if (min_capacity == 0) {
+			fprintf(stderr, "this table type does not support -c capacity\n");
+			free_hash_table(table);
+			exit(EXIT_FAILURE);
+		}
+		if (options.capacity < min_capacity) {
+			fprintf(stderr, "please specify table capacity (>=%d) using the "
+				"-c flag\n", min_capacity);
+			free_hash_table(table);
+			exit(EXIT_FAILURE);
+		}
+		hash_table_set_capacity(table, options.capacity);
+	}
+
+	// and expire its keys, if we were asked to
+	if (options.ttl > 0 && !hash_table_set_ttl(table, options.ttl)) {
+		fprintf(stderr, "this table type does not support -e ttl\n");
+		free_hash_table(table);
+		exit(EXIT_FAILURE);
+	}
+
+	// and move hit keys forward, if we were asked to
+	if (options.reorder != REORDER_NONE && !hash_table_set_reorder(table,
+			options.reorder)) {
+		fprintf(stderr, "this table type does not support -o policy\n");
+		free_hash_table(table);
+		exit(EXIT_FAILURE);
+	}
+
+	// and buffer its inserts, if we were asked to
+	if (options.buffer > 0 && !hash_table_set_buffer(table, options.buffer)) {
+		fprintf(stderr, "this table type does not support -b buffer\n");
+		free_hash_table(table);
+		exit(EXIT_FAILURE);
+	}
+
+	// and cache hot keys in front of it, if we were asked to
+	if (options.front > 0) {
+		hash_table_front(table, options.front);
+	}
+
+	// and record its resizes, splits and cycles, if we were asked to
+	if (options.trace) {
+		hash_table_trace(table, TRACE_EVENTS);
+	}
+
+	// and capture everything done to it, if we were asked to
+	FILE *capture_file = NULL;
+	Capture *capture = NULL;
+	if (options.capture) {
+		capture_file = fopen(options.capture, "wb");
+		if (capture_file == NULL) {
+			perror(options.capture);
+			free_hash_table(table);
+			exit(EXIT_FAILURE);
+		}
+		capture = new_capture(capture_file, true);
+		hash_table_capture(table, capture);
+	}
+
+	// start the interpreter loop, or replay a capture instead
+	if (options.replay) {
+		run_replay(table, options.replay, options.paced);
+	} else {
+		run_interpreter(table);
+	}
+
+	// finish writing out the capture
+	if (capture) {
+		hash_table_capture(table, NULL);
+		free_capture(capture);
+		fclose(capture_file);
+	}
+
+	// write out the trace of what happened to the table
+	if (options.trace) {
+		FILE *file = fopen(options.trace, "w");
+		if (file == NULL) {
+			perror(options.trace);
+		} else {
+			hash_table_write_trace(table, file);
+			fclose(file);
+		}
+	}
 
 	// done!
 	free_hash_table(table);
@@ -60,8 +171,13 @@ int main(int argc, char **argv) {
 void print_operations() {
 	printf(" %c number: insert 'number' into table\n",  INSERT);
 	printf(" %c number: lookup is 'number' in table\n", LOOKUP);
+	printf(" %c number: count another occurrence of 'number'\n", COUNT);
+	printf(" %c number: list the 'number' most counted keys\n", TOP);
+	printf(" %c number: advance the clock to tick 'number'\n", TICK);
 	printf(" %c: print table\n", PRINT);
 	printf(" %c: print stats\n", STATS);
+	printf(" %c: print stats as JSON\n", JSON);
+	printf(" %c: print stats as Prometheus metrics\n", METRICS);
 	printf(" %c: quit\n", QUIT);
 }
 
@@ -73,6 +189,7 @@ void run_interpreter(HashTable *table) {
 	
 	char op;
 	int64 key;
+	int64 clock = 0;	// the tick the table's clock was last advanced to
 	
 	// then loop, getting and executing commands, until 'quit'
 	while (true) {
@@ -115,6 +232,50 @@ void run_interpreter(HashTable *table) {
 				}
 				break;
 
+			case COUNT:
+				if (argc < 2) {
+					// count commands must have an argument
+					printf("syntax: %c number\n", COUNT);
+
+				} else {
+					// perform the increment
+					uint32_t count = hash_table_increment(table, key, 1);
+					if (count > 0) {
+						printf("%llu counted %u times\n", key, count);
+					} else {
+						printf("this table type can't count keys\n");
+					}
+				}
+				break;
+
+			case TOP:
+				if (argc < 2) {
+					// top commands must have an argument
+					printf("syntax: %c number\n", TOP);
+
+				} else {
+					// find and list the most counted keys
+					print_top(table, key);
+				}
+				break;
+
+			case TICK:
+				if (argc < 2) {
+					// tick commands must have an argument
+					printf("syntax: %c number\n", TICK);
+
+				} else if (key < clock) {
+					// the clock only ever moves forwards
+					printf("clock already at %llu\n", clock);
+
+				} else {
+					// advance the table's clock, expiring keys
+					hash_table_advance(table, key);
+					clock = key;
+					printf("clock at %llu\n", key);
+				}
+				break;
+
 			case PRINT:
 				// perform the print table
 				hash_table_print(table);
@@ -125,6 +286,13 @@ void run_interpreter(HashTable *table) {
 				hash_table_stats(table);
 				break;
 
+			case JSON:
+			case METRICS:
+				// take a snapshot of the stats and print it in the
+				// requested format
+				print_report(table, op == JSON);
+				break;
+
 			default:
 				// display error
 				printf("unknown operation '%c'\n", op);
@@ -143,6 +311,23 @@ void run_interpreter(HashTable *table) {
 	}
 }
 
+// list the 'k' keys in 'table' with the highest counts, most counted first
+void print_top(HashTable *table, int k) {
+	int64 *keys = malloc(sizeof(int64) * k);
+	uint32_t *counts = malloc(sizeof(uint32_t) * k);
+	if (keys == NULL || counts == NULL) {
+		printf("can't list %d keys\n", k);
+	} else {
+		int n = hash_table_top(table, k, keys, counts);
+		int i;
+		for (i = 0; i < n; i++) {
+			printf("%llu counted %u times\n", keys[i], counts[i]);
+		}
+	}
+	free(keys);
+	free(counts);
+}
+
 // reads a line from stdin, parses it into an operation character and possibly
 // a long long uinteger argument. store results in *operation and *key, resp.
 //
@@ -172,11 +357,14 @@ int get_command(char *operation, int64 *key) {
 Options get_options(int argc, char** argv) {
 	
 	// create the Options structure with defaults
-	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE };
+	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE,
+		.capacity = 0, .ttl = 0, .reorder = REORDER_NONE, .front = 0,
+		.buffer = 0, .trace = NULL, .capture = NULL, .replay = NULL, .paced = false };
+	bool known_reorder = true;
 
 	// use C's built-in getopt function to scan inputs by flag
 	char option;
-	while ((option = getopt(argc, argv, "t:s:")) != EOF){
+	while ((option = getopt(argc, argv, "t:s:c:e:o:f:b:x:w:r:p")) != EOF){
 		switch (option){
 			case 't': // set hash table type
 				options.type = strtotype(optarg);
@@ -184,6 +372,39 @@ Options get_options(int argc, char** argv) {
 			case 's': // set hash table size
 				options.initial_size = atoi(optarg);
 				break;
+			case 'c': // set hash table capacity (linear, xtndbln only)
+				options.capacity = atoi(optarg);
+				break;
+			case 'e': // set key time-to-live (linear, xtndbln only)
+				options.ttl = atoi(optarg);
+				break;
+			case 'o': // move hit keys forward (not linear or xtndbl1)
+				if (strcmp(optarg, "transpose") == 0) {
+					options.reorder = REORDER_TRANSPOSE;
+				} else if (strcmp(optarg, "front") == 0) {
+					options.reorder = REORDER_FRONT;
+				} else {
+					known_reorder = false;
+				}
+				break;
+			case 'f': // cache hot keys in a small table in front
+				options.front = atoi(optarg);
+				break;
+			case 'b': // buffer inserts (xtndbln only)
+				options.buffer = atoi(optarg);
+				break;
+			case 'x': // write a trace of table events to a file
+				options.trace = optarg;
+				break;
+			case 'w': // capture the operations performed to a file
+				options.capture = optarg;
+				break;
+			case 'r': // replay captured operations instead of interpreting
+				options.replay = optarg;
+				break;
+			case 'p': // replay operations at the pace they were captured
+				options.paced = true;
+				break;
 			default:
 				break;
 		}
@@ -212,6 +433,49 @@ Options get_options(int argc, char** argv) {
 		valid = false;
 	}
 
+	// validate table capacity
+	if(options.capacity < 0) {
+		fprintf(stderr,
+			"please specify table capacity (>0) using the -c flag\n");
+		valid = false;
+	}
+
+	// validate key time-to-live
+	if(options.ttl < 0) {
+		fprintf(stderr,
+			"please specify key time-to-live (>0) using the -e flag\n");
+		valid = false;
+	}
+
+	// validate front cache size
+	if(options.front < 0) {
+		fprintf(stderr,
+			"please specify front cache size (>0) using the -f flag\n");
+		valid = false;
+	}
+
+	// validate write buffer size
+	if(options.buffer < 0) {
+		fprintf(stderr,
+			"please specify write buffer size (>0) using the -b flag\n");
+		valid = false;
+	}
+
+	// validate reorder policy
+	if(!known_reorder) {
+		fprintf(stderr,
+			"please specify reorder policy (transpose or front) using the "
+			"-o flag\n");
+		valid = false;
+	}
+
+	// pacing only makes sense for a replay
+	if(options.paced && options.replay == NULL) {
+		fprintf(stderr,
+			"please specify a capture to replay using the -r flag\n");
+		valid = false;
+	}
+
 	// check overall validity before continuing
 	if(!valid){
 		exit(EXIT_FAILURE);
@@ -219,3 +483,110 @@ Options get_options(int argc, char** argv) {
 
 	return options;
 }
+
+// print a snapshot of the stats of 'table' to stdout, as a JSON object if
+// 'json' is true or as Prometheus metrics if not
+void print_report(HashTable *table, bool json) {
+	StatsReport *report = malloc(sizeof(*report));
+	if (report == NULL) {
+		printf("can't take a stats snapshot\n");
+		return;
+	}
+	hash_table_report(table, report);
+	if (json) {
+		stats_report_write_json(report, stdout);
+	} else {
+		stats_report_write_prometheus(report, stdout, "hashtable");
+	}
+	free(report);
+}
+
+// nanoseconds elapsed on a monotonic clock since some fixed point
+long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// perform the operations captured in 'filename' on 'table', as fast as
+// possible, or (if 'paced') each at the time it was captured. paced replays
+// are open-loop: an operation's latency is measured from when it was due,
+// so time spent waiting behind slow operations counts too
+void run_replay(HashTable *table, char *filename, bool paced) {
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) {
+		perror(filename);
+		return;
+	}
+	CaptureReader *reader = new_capture_reader(file);
+	if (reader == NULL) {
+		fprintf(stderr, "%s is not a capture file\n", filename);
+		fclose(file);
+		return;
+	}
+	if (paced && !capture_reader_timed(reader)) {
+		fprintf(stderr, "%s has no timestamps, replaying without pacing\n",
+			filename);
+		paced = false;
+	}
+
+	Histogram latencies;
+	histogram_init(&latencies, HISTOGRAM_BINS, true);
+	long long noperations = 0, ndiffering = 0;
+	long long start = now_ns();
+	CaptureRecord record;
+	while (capture_read(reader, &record)) {
+		long long due = start + record.time;
+		if (paced) {
+			// wait until this operation is due: sleep through most of a
+			// long wait, but spin through short ones, since sleeps overshoot
+			long long wait;
+			while ((wait = due - now_ns()) > 0) {
+				if (wait > SPIN_NS) {
+					wait -= SPIN_NS / 2;
+					struct timespec ts = { wait / 1000000000LL,
+						wait % 1000000000LL };
+					nanosleep(&ts, NULL);
+				}
+			}
+		}
+
+		uint32_t result = 0;
+		switch (record.op) {
+			case CAPTURE_INSERT:
+				result = hash_table_insert(table, record.key);
+				break;
+			case CAPTURE_LOOKUP:
+				result = hash_table_lookup(table, record.key);
+				break;
+			case CAPTURE_INCREMENT:
+				result = hash_table_increment(table, record.key, record.arg);
+				break;
+			case CAPTURE_ADVANCE:
+				hash_table_advance(table, record.key);
+				break;
+		}
+		if (paced) {
+			histogram_add(&latencies, now_ns() - due);
+		}
+
+		// a different result means the table behaves differently from the
+		// one that was captured (e.g. it evicted or expired other keys)
+		noperations++;
+		ndiffering += result != record.result;
+	}
+	double seconds = (now_ns() - start) * 1e-9;
+
+	if (seconds <= 0) {
+		seconds = 1e-9;
+	}
+	printf("replayed %lld operations in %.3f sec: %.0f ops/sec\n",
+		noperations, seconds, noperations / seconds);
+	printf("%lld results differed from the capture\n", ndiffering);
+	if (paced) {
+		histogram_print(&latencies, "latency (ns)");
+	}
+
+	free_capture_reader(reader);
+	fclose(file);
+}
@@ -0,0 +1,60 @@
+/* * * * * * * * *
+ * Per-phase cycle counters, breaking down where a hash table spends its time
+ * (hashing, probing, eviction chains, bucket splits, growth and allocation)
+ */
+
+#include <stdio.h>
+
+#include "phases.h"
+
+// the name of each phase, as printed
+static const char *phase_names[] = {
+	"none", "hash", "probe", "evict", "split", "grow", "alloc"
+};
+
+// the name of 'phase', such as "hash" or "split"
+const char *phase_name(Phase phase) {
+	return phase_names[phase];
+}
+
+// the phase the calling thread is in right now, and when it entered it
+__thread Phase phase_current = PHASE_NONE;
+__thread uint64_t phase_since = 0;
+
+// set up 'costs' with nothing charged to any phase yet
+void phase_costs_init(PhaseCosts *costs) {
+	sharded_counters_init(&costs->cycles, TABLE_SHARDS);
+}
+
+// free the counters held by 'costs'
+void phase_costs_free(PhaseCosts *costs) {
+	sharded_counters_free(&costs->cycles);
+}
+
+// the total cycles charged to 'phase' in 'costs', by every thread
+long long phase_costs_total(PhaseCosts *costs, Phase phase) {
+	return sharded_counter_total(&costs->cycles, phase);
+}
+
+// print the cycles charged to each phase of 'costs' (other than PHASE_NONE)
+// to stdout, along with their share of the total
+void phase_costs_print(PhaseCosts *costs) {
+	uint64_t cycles[NPHASES];
+	uint64_t total = 0;
+	int i;
+	for (i = PHASE_NONE + 1; i < NPHASES; i++) {
+		cycles[i] = phase_costs_total(costs, i);
+		total += cycles[i];
+	}
+	if (total == 0) {
+		return;
+	}
+
+	printf(" phase costs: %llu cycles\n", (unsigned long long)total);
+	for (i = PHASE_NONE + 1; i < NPHASES; i++) {
+		if (cycles[i] > 0) {
+			printf("%12s: %llu (%.1f%%)\n", phase_names[i],
+				(unsigned long long)cycles[i], cycles[i] * 100.0 / total);
+		}
+	}
+}
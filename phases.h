@@ -0,0 +1,87 @@
+/* * * * * * * * *
+ * Per-phase cycle counters, breaking down where a hash table spends its time
+ * (hashing, probing, eviction chains, bucket splits, growth and allocation)
+ *
+ * a table's operations call phase_enter() as they move from one phase to
+ * the next, which charges the cycles since the last call to the phase being
+ * left. phases are exclusive, so work nested inside another phase (such as
+ * the allocation inside a split) is charged only to the innermost one
+ */
+
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "shards.h"
+
+// the phases an operation can be in
+typedef enum phase {
+	PHASE_NONE,		// outside of any operation (never printed)
+	PHASE_HASH,		// computing hash values and addresses
+	PHASE_PROBE,	// scanning slots or buckets for a key or a free space
+	PHASE_EVICT,	// following a cuckoo eviction chain or a CLOCK hand
+	PHASE_SPLIT,	// splitting a bucket and redistributing its keys
+	PHASE_GROW,		// growing a table or directory and rehashing into it
+	PHASE_ALLOC,	// allocating memory for new arrays or buckets
+	NPHASES
+} Phase;
+
+// the cycles spent in each phase so far, counted by each thread in its own
+// shard (see shards.h)
+typedef struct phase_costs {
+	ShardedCounters cycles;		// cycles charged to each phase
+} PhaseCosts;
+
+// the phase the calling thread is in right now, and when it entered it
+// (a thread only works on one operation at a time, so these belong to the
+// thread rather than to any one table's costs)
+extern __thread Phase phase_current;
+extern __thread uint64_t phase_since;
+
+// read a cheap, monotonic cycle counter (or the closest thing available)
+static inline uint64_t phase_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return clock();
+#endif
+}
+
+// charge the cycles since the calling thread's last phase change to its
+// current phase in 'costs', then make 'phase' its current phase
+// returns the phase that was current before, so it can be restored later
+static inline Phase phase_enter(PhaseCosts *costs, Phase phase) {
+	Phase previous = phase_current;
+	uint64_t now = phase_clock();
+	sharded_counter_count(&costs->cycles, previous, now - phase_since);
+	phase_since = now;
+	phase_current = phase;
+	return previous;
+}
+
+// the name of 'phase', such as "hash" or "split"
+const char *phase_name(Phase phase);
+
+// set up 'costs' with nothing charged to any phase yet
+void phase_costs_init(PhaseCosts *costs);
+
+// free the counters held by 'costs'
+void phase_costs_free(PhaseCosts *costs);
+
+// the total cycles charged to 'phase' in 'costs', by every thread
+long long phase_costs_total(PhaseCosts *costs, Phase phase);
+
+// print the cycles charged to each phase of 'costs' (other than PHASE_NONE)
+// to stdout, along with their share of the total
+void phase_costs_print(PhaseCosts *costs);
+
+#endif
@@ -0,0 +1,21 @@
+/* * * * * * * * *
+ * Self-organising policies for tables whose lookups scan for a key
+ *
+ * under a skewed workload a few hot keys take most of the hits, so moving a
+ * key forward whenever it is hit lets most hits stop at the first compare:
+ *   - in a bucket of several keys, the hit key swaps places with the key
+ *     before it (transpose) or moves to the front (move to front)
+ *   - in the cuckoo family, a key hit in its second table moves into its
+ *     first table if that place is free, since lookups check there first
+ */
+
+#ifndef REORDER_H
+#define REORDER_H
+
+typedef enum reorder {
+	REORDER_NONE,		// keys stay where they were inserted
+	REORDER_TRANSPOSE,	// a hit key moves one place forward
+	REORDER_FRONT		// a hit key moves all the way forward
+} Reorder;
+
+#endif
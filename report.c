@@ -0,0 +1,137 @@
+/* * * * * * * * *
+ * Structured statistics reports: a snapshot of a hash table's statistics as
+ * named 64-bit counters and histograms, which can be written out as JSON or
+ * in the Prometheus text exposition format instead of being scraped from
+ * the free-form output of hash_table_stats
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "report.h"
+
+
+/* * * *
+ * helper functions
+ */
+
+// copy 'name' into the fixed-size buffer 'to', truncating it if necessary
+static void copy_name(char *to, const char *name) {
+	strncpy(to, name, REPORT_NAME_LEN - 1);
+	to[REPORT_NAME_LEN - 1] = '\0';
+}
+
+// write the bins of 'histogram' to 'file' as a JSON array
+static void write_json_bins(const Histogram *histogram, FILE *file) {
+	fprintf(file, "[");
+	int bin;
+	for (bin = 0; bin < histogram->nbins; bin++) {
+		long long low, high;
+		bool bounded = histogram_bin_range(histogram, bin, &low, &high);
+		fprintf(file, "%s{\"low\":%lld,\"high\":", bin == 0 ? "" : ",", low);
+		if (bounded) {
+			fprintf(file, "%lld", high);
+		} else {
+			fprintf(file, "null");
+		}
+		fprintf(file, ",\"count\":%lld}", histogram->counts[bin]);
+	}
+	fprintf(file, "]");
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// set up 'report' as an empty report about a table of type 'type'
+void stats_report_init(StatsReport *report, const char *type) {
+	copy_name(report->type, type);
+	report->ncounters = 0;
+	report->nhistograms = 0;
+}
+
+// add a counter called 'name' with value 'value' to 'report'
+void stats_report_counter(StatsReport *report, const char *name,
+		long long value) {
+	assert(report->ncounters < REPORT_COUNTERS && "error: too many counters");
+	ReportCounter *counter = &report->counters[report->ncounters++];
+	copy_name(counter->name, name);
+	counter->value = value;
+}
+
+// add a copy of 'histogram', called 'name', to 'report'
+void stats_report_histogram(StatsReport *report, const char *name,
+		const Histogram *histogram) {
+	assert(report->nhistograms < REPORT_HISTOGRAMS
+		&& "error: too many histograms");
+	ReportHistogram *copy = &report->histograms[report->nhistograms++];
+	copy_name(copy->name, name);
+	copy->histogram = *histogram;
+}
+
+// add a counter for the cycles charged to each phase of 'costs' to 'report'
+void stats_report_phases(StatsReport *report, PhaseCosts *costs) {
+	int phase;
+	for (phase = PHASE_NONE + 1; phase < NPHASES; phase++) {
+		char name[REPORT_NAME_LEN];
+		snprintf(name, sizeof name, "phase_%s_cycles", phase_name(phase));
+		stats_report_counter(report, name, phase_costs_total(costs, phase));
+	}
+}
+
+// write 'report' to 'file' as a single JSON object
+void stats_report_write_json(StatsReport *report, FILE *file) {
+	fprintf(file, "{\"type\":\"%s\",\"counters\":{", report->type);
+	int i;
+	for (i = 0; i < report->ncounters; i++) {
+		fprintf(file, "%s\"%s\":%lld", i == 0 ? "" : ",",
+			report->counters[i].name, report->counters[i].value);
+	}
+	fprintf(file, "},\"histograms\":{");
+	for (i = 0; i < report->nhistograms; i++) {
+		const Histogram *histogram = &report->histograms[i].histogram;
+		fprintf(file, "%s\"%s\":{\"count\":%lld,\"sum\":%lld,\"max\":%lld,"
+			"\"bins\":", i == 0 ? "" : ",", report->histograms[i].name,
+			histogram->total, histogram->sum, histogram->max);
+		write_json_bins(histogram, file);
+		fprintf(file, "}");
+	}
+	fprintf(file, "}}\n");
+}
+
+// write 'report' to 'file' in the Prometheus text exposition format
+void stats_report_write_prometheus(StatsReport *report, FILE *file,
+		const char *prefix) {
+	int i;
+	for (i = 0; i < report->ncounters; i++) {
+		ReportCounter *counter = &report->counters[i];
+		fprintf(file, "# TYPE %s_%s gauge\n", prefix, counter->name);
+		fprintf(file, "%s_%s{type=\"%s\"} %lld\n", prefix, counter->name,
+			report->type, counter->value);
+	}
+
+	// histogram buckets are cumulative, each counting every value up to
+	// and including its upper bound
+	for (i = 0; i < report->nhistograms; i++) {
+		const char *name = report->histograms[i].name;
+		const Histogram *histogram = &report->histograms[i].histogram;
+		fprintf(file, "# TYPE %s_%s histogram\n", prefix, name);
+		long long cumulative = 0;
+		int bin;
+		for (bin = 0; bin < histogram->nbins; bin++) {
+			long long low, high;
+			cumulative += histogram->counts[bin];
+			if (histogram_bin_range(histogram, bin, &low, &high)) {
+				fprintf(file, "%s_%s_bucket{type=\"%s\",le=\"%lld\"} %lld\n",
+					prefix, name, report->type, high, cumulative);
+			}
+		}
+		fprintf(file, "%s_%s_bucket{type=\"%s\",le=\"+Inf\"} %lld\n",
+			prefix, name, report->type, histogram->total);
+		fprintf(file, "%s_%s_sum{type=\"%s\"} %lld\n", prefix, name,
+			report->type, histogram->sum);
+		fprintf(file, "%s_%s_count{type=\"%s\"} %lld\n", prefix, name,
+			report->type, histogram->total);
+	}
+}
@@ -0,0 +1,62 @@
+/* * * * * * * * *
+ * Structured statistics reports: a snapshot of a hash table's statistics as
+ * named 64-bit counters and histograms, which can be written out as JSON or
+ * in the Prometheus text exposition format instead of being scraped from
+ * the free-form output of hash_table_stats
+ */
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include "histogram.h"
+#include "phases.h"
+
+// the most counters and histograms a report can hold
+#define REPORT_COUNTERS 48
+#define REPORT_HISTOGRAMS 16
+// the longest name of a counter or histogram (including the terminator)
+#define REPORT_NAME_LEN 48
+
+typedef struct report_counter {
+	char name[REPORT_NAME_LEN];
+	long long value;
+} ReportCounter;
+
+typedef struct report_histogram {
+	char name[REPORT_NAME_LEN];
+	Histogram histogram;
+} ReportHistogram;
+
+// a snapshot of the statistics of one table
+typedef struct stats_report {
+	char type[REPORT_NAME_LEN];	// the type of table the report is about
+	ReportCounter counters[REPORT_COUNTERS];
+	int ncounters;
+	ReportHistogram histograms[REPORT_HISTOGRAMS];
+	int nhistograms;
+} StatsReport;
+
+// set up 'report' as an empty report about a table of type 'type'
+void stats_report_init(StatsReport *report, const char *type);
+
+// add a counter called 'name' with value 'value' to 'report'
+void stats_report_counter(StatsReport *report, const char *name,
+	long long value);
+
+// add a copy of 'histogram', called 'name', to 'report'
+void stats_report_histogram(StatsReport *report, const char *name,
+	const Histogram *histogram);
+
+// add a counter for the cycles charged to each phase of 'costs' to 'report'
+void stats_report_phases(StatsReport *report, PhaseCosts *costs);
+
+// write 'report' to 'file' as a single JSON object
+void stats_report_write_json(StatsReport *report, FILE *file);
+
+// write 'report' to 'file' in the Prometheus text exposition format, with
+// every metric name prefixed by 'prefix' and labelled with the table type
+void stats_report_write_prometheus(StatsReport *report, FILE *file,
+	const char *prefix);
+
+#endif
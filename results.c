@@ -0,0 +1,299 @@
+/* * * * * * * * *
+ * A store of benchmark results, and noise-aware comparison of a run against
+ * a baseline
+ *
+ * the CSV columns are: version, label, machine, config, type, workload,
+ * rep, value. no field contains a comma
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "results.h"
+
+// how many results a set has room for at first
+#define INITIAL_SIZE 64
+// the longest CSV row we expect to read
+#define MAX_ROW (6 * RESULT_FIELD_LEN + 64)
+// the header row
+#define CSV_HEADER "version,label,machine,config,type,workload,rep,value"
+
+// the summary of the repetitions of a measurement
+typedef struct sample {
+	int n;
+	double mean;
+	double var;		// sample variance (0 if n < 2)
+} Sample;
+
+
+/* * * *
+ * helper functions
+ */
+
+// copy 'src' (up to 'len' chars) into the field 'dst', truncating if need be
+static void set_field(char *dst, const char *src, size_t len) {
+	if (len >= RESULT_FIELD_LEN) {
+		len = RESULT_FIELD_LEN - 1;
+	}
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+// is 'result' a repetition of the same measurement as 'other'?
+static bool same_measurement(const Result *result, const Result *other) {
+	return strcmp(result->machine, other->machine) == 0
+		&& strcmp(result->config, other->config) == 0
+		&& strcmp(result->type, other->type) == 0
+		&& strcmp(result->workload, other->workload) == 0;
+}
+
+// summarise the repetitions in 'set' of the same measurement as 'like'
+static Sample summarise(ResultSet *set, const Result *like) {
+	Sample sample = {0, 0, 0};
+	double sum = 0, sumsq = 0;
+	int i;
+	for (i = 0; i < set->nresults; i++) {
+		if (same_measurement(&set->results[i], like)) {
+			double value = set->results[i].value;
+			sample.n++;
+			sum += value;
+			sumsq += value * value;
+		}
+	}
+	if (sample.n > 0) {
+		sample.mean = sum / sample.n;
+	}
+	if (sample.n > 1) {
+		sample.var = (sumsq - sum * sample.mean) / (sample.n - 1);
+		if (sample.var < 0) {
+			// rounding error on near-identical repetitions
+			sample.var = 0;
+		}
+	}
+	return sample;
+}
+
+// the two-sided 95% critical value of Student's t with 'df' degrees of
+// freedom (rounded down to a whole number)
+static double t_critical(double df) {
+	static const double table[] = {
+		0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+		2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+		2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+		2.042
+	};
+	int whole = (int)df;
+	if (whole < 1) {
+		whole = 1;
+	}
+	if (whole > 30) {
+		return 1.960;
+	}
+	return table[whole];
+}
+
+// the half-width of the 95% confidence interval of the mean of 'sample'
+static double ci95(Sample sample) {
+	if (sample.n < 2) {
+		return 0;
+	}
+	return t_critical(sample.n - 1) * sqrt(sample.var / sample.n);
+}
+
+// is the difference between the means of 'a' and 'b' significant at the 95%
+// level, by Welch's t-test?
+static bool significant(Sample a, Sample b) {
+	if (a.n < 2 || b.n < 2) {
+		// no idea of the noise: trust the threshold alone
+		return true;
+	}
+	double va = a.var / a.n, vb = b.var / b.n;
+	if (va + vb == 0) {
+		return a.mean != b.mean;
+	}
+	double t = fabs(a.mean - b.mean) / sqrt(va + vb);
+	// Welch-Satterthwaite degrees of freedom
+	double df = (va + vb) * (va + vb)
+		/ (va * va / (a.n - 1) + vb * vb / (b.n - 1));
+	return t > t_critical(df);
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// set up 'set' to hold no results
+void result_set_init(ResultSet *set) {
+	assert(set);
+	set->results = malloc(INITIAL_SIZE * sizeof *set->results);
+	assert(set->results);
+	set->nresults = 0;
+	set->size = INITIAL_SIZE;
+}
+
+// free the results held by 'set'
+void result_set_free(ResultSet *set) {
+	assert(set);
+	free(set->results);
+	set->results = NULL;
+	set->nresults = set->size = 0;
+}
+
+// add a copy of 'result' to 'set'
+void result_set_add(ResultSet *set, const Result *result) {
+	assert(set && result);
+	if (set->nresults == set->size) {
+		set->size *= 2;
+		set->results = realloc(set->results,
+			set->size * sizeof *set->results);
+		assert(set->results);
+	}
+	set->results[set->nresults++] = *result;
+}
+
+// write every result in 'set' to 'file' as CSV rows, preceded by a header
+// row if 'header' is true
+void result_set_write_csv(ResultSet *set, FILE *file, bool header) {
+	assert(set && file);
+	if (header) {
+		fprintf(file, "%s\n", CSV_HEADER);
+	}
+	int i;
+	for (i = 0; i < set->nresults; i++) {
+		Result *r = &set->results[i];
+		fprintf(file, "%d,%s,%s,%s,%s,%s,%d,%.3f\n", RESULTS_VERSION,
+			r->label, r->machine, r->config, r->type, r->workload, r->rep,
+			r->value);
+	}
+	fflush(file);
+}
+
+// add every result in the CSV rows of 'file' to 'set', skipping header rows
+// and rows written by other versions of the format
+// returns the number of results added
+int result_set_read_csv(ResultSet *set, FILE *file) {
+	assert(set && file);
+	char row[MAX_ROW];
+	int nadded = 0;
+	while (fgets(row, sizeof row, file)) {
+		// split the row into its 8 fields
+		char *fields[8];
+		int nfields = 0;
+		char *start = row;
+		while (nfields < 8) {
+			fields[nfields++] = start;
+			char *end = strpbrk(start, ",\n");
+			if (end == NULL || *end == '\n') {
+				if (end) {
+					*end = '\0';
+				}
+				break;
+			}
+			*end = '\0';
+			start = end + 1;
+		}
+		if (nfields != 8 || atoi(fields[0]) != RESULTS_VERSION) {
+			continue;
+		}
+
+		Result result;
+		set_field(result.label, fields[1], strlen(fields[1]));
+		set_field(result.machine, fields[2], strlen(fields[2]));
+		set_field(result.config, fields[3], strlen(fields[3]));
+		set_field(result.type, fields[4], strlen(fields[4]));
+		set_field(result.workload, fields[5], strlen(fields[5]));
+		result.rep = atoi(fields[6]);
+		result.value = atof(fields[7]);
+		result_set_add(set, &result);
+		nadded++;
+	}
+	return nadded;
+}
+
+// the label of the last result in 'set' from the same machine and config as
+// 'like' (i.e. the most recent comparable run), or NULL if there is none
+const char *result_set_last_label(ResultSet *set, const Result *like) {
+	assert(set && like);
+	int i;
+	for (i = set->nresults - 1; i >= 0; i--) {
+		Result *result = &set->results[i];
+		if (strcmp(result->machine, like->machine) == 0
+				&& strcmp(result->config, like->config) == 0) {
+			return result->label;
+		}
+	}
+	return NULL;
+}
+
+// remove every result from 'set' whose label isn't 'label'
+void result_set_keep_label(ResultSet *set, const char *label) {
+	assert(set && label);
+	// copy the label first, in case it points into one of the results
+	char keep[RESULT_FIELD_LEN];
+	set_field(keep, label, strlen(label));
+	int i, n = 0;
+	for (i = 0; i < set->nresults; i++) {
+		if (strcmp(set->results[i].label, keep) == 0) {
+			set->results[n++] = set->results[i];
+		}
+	}
+	set->nresults = n;
+}
+
+// compare each measurement in 'current' with the same measurement (same
+// machine, config, type and workload) in 'baseline', writing a line about
+// each to 'out'. a change is flagged when the means differ by more than
+// 'threshold' (a fraction, e.g. 0.05) and Welch's t-test finds the
+// difference significant at the 95% level
+// returns the number of measurements that got significantly worse
+int result_set_compare(ResultSet *baseline, ResultSet *current,
+		double threshold, FILE *out) {
+	assert(baseline && current && out);
+	fprintf(out, "%-8s %-8s %22s %22s %8s  %s\n", "type", "workload",
+		"baseline", "current", "change", "verdict");
+
+	int nworse = 0;
+	int i, j;
+	for (i = 0; i < current->nresults; i++) {
+		Result *result = &current->results[i];
+
+		// only report each measurement once, at its first repetition
+		for (j = 0; j < i; j++) {
+			if (same_measurement(&current->results[j], result)) {
+				break;
+			}
+		}
+		if (j < i) {
+			continue;
+		}
+
+		Sample now = summarise(current, result);
+		Sample then = summarise(baseline, result);
+		fprintf(out, "%-8s %-8s ", result->type, result->workload);
+		if (then.n == 0) {
+			fprintf(out, "%22s %11.1f +- %7.1f %8s  %s\n", "-", now.mean,
+				ci95(now), "-", "new");
+			continue;
+		}
+
+		double change = (now.mean - then.mean) / then.mean;
+		const char *verdict = "same";
+		if (fabs(change) > threshold && significant(now, then)) {
+			if (change > 0) {
+				verdict = "REGRESSION";
+				nworse++;
+			} else {
+				verdict = "improved";
+			}
+		} else if (fabs(change) > threshold) {
+			verdict = "same (noisy)";
+		}
+		fprintf(out, "%11.1f +- %7.1f %11.1f +- %7.1f %+7.1f%%  %s\n",
+			then.mean, ci95(then), now.mean, ci95(now), change * 100,
+			verdict);
+	}
+	return nworse;
+}
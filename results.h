@@ -0,0 +1,77 @@
+/* * * * * * * * *
+ * A store of benchmark results, and noise-aware comparison of a run against
+ * a baseline
+ *
+ * each result is one repetition of one measurement (e.g. ns per insert) of
+ * one type of table under one workload, tagged with the machine it ran on,
+ * the configuration it ran with and a label for the run (e.g. a release).
+ * results are kept as CSV rows, so runs can be appended to a store over time
+ * and compared against any earlier run. a comparison treats the repetitions
+ * of each measurement as a sample, and only flags a change where the two
+ * samples' means differ by more than a threshold and by more than their
+ * noise can explain
+ */
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// the version of the CSV format written, stored in each row
+#define RESULTS_VERSION 1
+// the longest field (including the terminator)
+#define RESULT_FIELD_LEN 64
+
+// a single repetition of a measurement
+typedef struct result {
+	char label[RESULT_FIELD_LEN];		// which run this came from
+	char machine[RESULT_FIELD_LEN];		// where it ran
+	char config[RESULT_FIELD_LEN];		// what it ran with
+	char type[RESULT_FIELD_LEN];		// which type of table it measured
+	char workload[RESULT_FIELD_LEN];	// what it measured
+	int rep;							// which repetition it was
+	double value;						// the measurement (lower is better)
+} Result;
+
+typedef struct result_set {
+	Result *results;
+	int nresults;
+	int size;
+} ResultSet;
+
+// set up 'set' to hold no results
+void result_set_init(ResultSet *set);
+
+// free the results held by 'set'
+void result_set_free(ResultSet *set);
+
+// add a copy of 'result' to 'set'
+void result_set_add(ResultSet *set, const Result *result);
+
+// write every result in 'set' to 'file' as CSV rows, preceded by a header
+// row if 'header' is true
+void result_set_write_csv(ResultSet *set, FILE *file, bool header);
+
+// add every result in the CSV rows of 'file' to 'set', skipping header rows
+// and rows written by other versions of the format
+// returns the number of results added
+int result_set_read_csv(ResultSet *set, FILE *file);
+
+// the label of the last result in 'set' from the same machine and config as
+// 'like' (i.e. the most recent comparable run), or NULL if there is none
+const char *result_set_last_label(ResultSet *set, const Result *like);
+
+// remove every result from 'set' whose label isn't 'label'
+void result_set_keep_label(ResultSet *set, const char *label);
+
+// compare each measurement in 'current' with the same measurement (same
+// machine, config, type and workload) in 'baseline', writing a line about
+// each to 'out'. a change is flagged when the means differ by more than
+// 'threshold' (a fraction, e.g. 0.05) and Welch's t-test finds the
+// difference significant at the 95% level
+// returns the number of measurements that got significantly worse
+int result_set_compare(ResultSet *baseline, ResultSet *current,
+	double threshold, FILE *out);
+
+#endif
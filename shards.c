@@ -0,0 +1,136 @@
+/* * * * * * * * *
+ * Sharded statistics counters for use by several threads at once
+ *
+ * each thread updates its own shard: a block of counters padded out to a
+ * whole cache line, so that threads never write to the same line and the
+ * counters need no locks or atomic read-modify-writes. a counter's value is
+ * the sum of its value in every shard, and is only added up when it is read.
+ * there is a shard for every thread: shards are allocated a chunk at a time,
+ * as threads with higher numbers first need them, and a thread's number (and
+ * so its shard) is only handed on to another thread once it has exited
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "shards.h"
+
+// the most threads that can be running (and so have numbers) at once
+#define MAX_THREADS (MAX_SHARD_CHUNKS * SHARD_CHUNK)
+
+// set up 'counters' with zeroed shards for the first 'nshards' threads
+// (later threads' shards are allocated when they are first needed)
+void sharded_counters_init(ShardedCounters *counters, int nshards) {
+	assert(nshards > 0 && nshards <= MAX_THREADS);
+	int chunk;
+	for (chunk = 0; chunk < MAX_SHARD_CHUNKS; chunk++) {
+		counters->chunks[chunk] = NULL;
+	}
+	for (chunk = 0; chunk * SHARD_CHUNK < nshards; chunk++) {
+		sharded_counters_grow(counters, chunk);
+	}
+}
+
+// free the shards held by 'counters'
+void sharded_counters_free(ShardedCounters *counters) {
+	int chunk;
+	for (chunk = 0; chunk < MAX_SHARD_CHUNKS; chunk++) {
+		free(counters->chunks[chunk]);
+		counters->chunks[chunk] = NULL;
+	}
+}
+
+// allocate chunk 'chunk' of the shards of 'counters', if another thread
+// hasn't just done so, and return it
+void *sharded_counters_grow(ShardedCounters *counters, int chunk) {
+	assert(chunk < MAX_SHARD_CHUNKS && "error: too many threads");
+	// allocate an extra line, so that the shards can start on a line boundary
+	void *memory = calloc(SHARD_CHUNK + 1, sizeof(CounterShard));
+	assert(memory);
+	void *expected = NULL;
+	if (!__atomic_compare_exchange_n(&counters->chunks[chunk], &expected,
+			memory, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+		// another thread got there first, so use its chunk
+		free(memory);
+		return expected;
+	}
+	return memory;
+}
+
+
+// the number of the calling thread, or -1 if it hasn't been given one yet
+__thread int shard_thread_number = -1;
+
+// which numbers running threads have, guarded by 'numbers_lock'
+static bool numbered[MAX_THREADS];
+static pthread_mutex_t numbers_lock = PTHREAD_MUTEX_INITIALIZER;
+// a key whose destructor gives a thread's number back when the thread exits
+static pthread_key_t number_key;
+static pthread_once_t number_key_once = PTHREAD_ONCE_INIT;
+
+// give back the number of an exiting thread, stored as 'value' (plus 1, so
+// that it isn't NULL)
+static void release_number(void *value) {
+	pthread_mutex_lock(&numbers_lock);
+	numbered[(intptr_t)value - 1] = false;
+	pthread_mutex_unlock(&numbers_lock);
+}
+
+// set up the key that gives numbers back
+static void make_number_key(void) {
+	int error = pthread_key_create(&number_key, release_number);
+	assert(error == 0);
+	(void)error;
+}
+
+// give the calling thread the lowest number no running thread has, and
+// return it
+int shard_number_thread(void) {
+	pthread_once(&number_key_once, make_number_key);
+	pthread_mutex_lock(&numbers_lock);
+	int number = 0;
+	while (number < MAX_THREADS && numbered[number]) {
+		number++;
+	}
+	assert(number < MAX_THREADS && "error: too many threads");
+	numbered[number] = true;
+	pthread_mutex_unlock(&numbers_lock);
+
+	pthread_setspecific(number_key, (void *)(intptr_t)(number + 1));
+	shard_thread_number = number;
+	return number;
+}
+
+
+// counter 'counter' in shard 'shard' alone
+long long sharded_counter_value(ShardedCounters *counters, int shard,
+		int counter) {
+	assert(counter >= 0 && counter < (int)SHARD_COUNTERS);
+	void *chunk = __atomic_load_n(&counters->chunks[shard / SHARD_CHUNK],
+		__ATOMIC_ACQUIRE);
+	if (chunk == NULL) {
+		return 0;
+	}
+	return __atomic_load_n(&sharded_counter_shard(counters, shard)
+		->values[counter], __ATOMIC_RELAXED);
+}
+
+// add up counter 'counter' across every shard
+long long sharded_counter_total(ShardedCounters *counters, int counter) {
+	long long total = 0;
+	int shard;
+	for (shard = 0; shard < MAX_THREADS; shard += SHARD_CHUNK) {
+		if (__atomic_load_n(&counters->chunks[shard / SHARD_CHUNK],
+				__ATOMIC_ACQUIRE) == NULL) {
+			continue;
+		}
+		int i;
+		for (i = 0; i < SHARD_CHUNK; i++) {
+			total += sharded_counter_value(counters, shard + i, counter);
+		}
+	}
+	return total;
+}
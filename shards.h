@@ -0,0 +1,110 @@
+/* * * * * * * * *
+ * Sharded statistics counters for use by several threads at once
+ *
+ * each thread updates its own shard: a block of counters padded out to a
+ * whole cache line, so that threads never write to the same line and the
+ * counters need no locks or atomic read-modify-writes. a counter's value is
+ * the sum of its value in every shard, and is only added up when it is read.
+ * there is a shard for every thread: shards are allocated a chunk at a time,
+ * as threads with higher numbers first need them, and a thread's number (and
+ * so its shard) is only handed on to another thread once it has exited
+ */
+
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include <stdint.h>
+
+// the size of a cache line, in bytes
+#define CACHE_LINE 64
+// how many counters each shard holds (exactly filling one cache line)
+#define SHARD_COUNTERS (CACHE_LINE / sizeof(long long))
+// how many shards are allocated at a time
+#define SHARD_CHUNK 16
+// how many chunks of shards there can be, so at most how many threads can
+// be running at once, in units of SHARD_CHUNK
+#define MAX_SHARD_CHUNKS 64
+// how many shards each hash table's statistics start out with (enough for
+// this many threads before any more need allocating)
+#define TABLE_SHARDS SHARD_CHUNK
+
+// one thread's block of counters
+typedef struct counter_shard {
+	long long values[SHARD_COUNTERS];
+} CounterShard;
+
+// the counters of every thread
+typedef struct sharded_counters {
+	void *chunks[MAX_SHARD_CHUNKS];	// the allocation holding each chunk of
+									// SHARD_CHUNK shards (starting on the
+									// next line boundary), or NULL if no
+									// thread has needed it yet
+} ShardedCounters;
+
+// set up 'counters' with zeroed shards for the first 'nshards' threads
+// (later threads' shards are allocated when they are first needed)
+void sharded_counters_init(ShardedCounters *counters, int nshards);
+
+// free the shards held by 'counters'
+void sharded_counters_free(ShardedCounters *counters);
+
+// allocate chunk 'chunk' of the shards of 'counters', if another thread
+// hasn't just done so, and return it
+void *sharded_counters_grow(ShardedCounters *counters, int chunk);
+
+// shard 'shard' of 'counters', allocating it if need be
+static inline CounterShard *sharded_counter_shard(ShardedCounters *counters,
+		int shard) {
+	void *chunk = __atomic_load_n(&counters->chunks[shard / SHARD_CHUNK],
+		__ATOMIC_ACQUIRE);
+	if (chunk == NULL) {
+		chunk = sharded_counters_grow(counters, shard / SHARD_CHUNK);
+	}
+	uintptr_t start = (uintptr_t)chunk;
+	start = (start + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+	return (CounterShard *)start + shard % SHARD_CHUNK;
+}
+
+// add 'delta' to counter 'counter' in shard 'shard', which must only ever be
+// updated by one thread
+// (the load and store are atomic only so that reading the total while the
+// shard is being updated is safe; they compile to plain moves)
+static inline void sharded_counter_add(ShardedCounters *counters, int shard,
+		int counter, long long delta) {
+	long long *value = &sharded_counter_shard(counters, shard)->values[counter];
+	__atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + delta,
+		__ATOMIC_RELAXED);
+}
+
+// the number of the calling thread, or -1 if it hasn't been given one yet
+extern __thread int shard_thread_number;
+
+// give the calling thread the lowest number no running thread has, and
+// return it
+int shard_number_thread(void);
+
+// which shard the calling thread should update: each thread is numbered the
+// first time it asks, and takes the shard with its number
+static inline int shard_of_thread(void) {
+	int number = shard_thread_number;
+	if (number < 0) {
+		number = shard_number_thread();
+	}
+	return number;
+}
+
+// add 'delta' to counter 'counter' in the calling thread's shard
+static inline void sharded_counter_count(ShardedCounters *counters,
+		int counter, long long delta) {
+	sharded_counter_add(counters, shard_of_thread(), counter, delta);
+}
+
+// counter 'counter' in shard 'shard' alone
+long long sharded_counter_value(ShardedCounters *counters, int shard,
+	int counter);
+
+// add up counter 'counter' across every shard. only exact once all of the
+// threads updating 'counters' have finished (or been joined)
+long long sharded_counter_total(ShardedCounters *counters, int counter);
+
+#endif
@@ -0,0 +1,197 @@
+/* * * * * * * * *
+ * Deduplicating set that keeps a bounded number of keys in memory, spilling
+ * the rest to disk, Grace hash join style
+ *
+ * keys are inserted into an in-memory hash table until it holds 'budget'
+ * keys. after that, keys not already in the table are appended to one of
+ * several run files, chosen by the high bits of their mix2 hash. when the
+ * input is finished, each run file is deduplicated in turn with a fresh
+ * table (which may itself spill, partitioning by the next bits down)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "spill.h"
+
+#define NRUNS (1 << SPILL_BITS)
+// bytes of buffering for each run file
+#define RUN_BUFFER_SIZE 65536
+
+struct spill_set {
+	TableType type;		// the type of table to deduplicate with
+	int size;			// the initial size of those tables
+	int budget;			// how many keys may be held in memory
+	int level;			// how many times keys have been partitioned already
+	HashTable *table;	// the keys held in memory
+	int nkeys;			// how many keys are in 'table'
+	FILE *runs[NRUNS];	// the run files keys spill into, created as needed
+	EmitFunction emit;
+	void *data;
+	SpillStats stats;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// create a spill set at partitioning depth 'level'
+static SpillSet *new_spill_level(TableType type, int size, int budget,
+		EmitFunction emit, void *data, int level) {
+	SpillSet *set = malloc(sizeof *set);
+	assert(set);
+
+	set->type = type;
+	set->size = size;
+	set->budget = budget;
+	set->level = level;
+	set->table = new_hash_table(type, size);
+	assert(set->table);
+	set->nkeys = 0;
+	int i;
+	for (i = 0; i < NRUNS; i++) {
+		set->runs[i] = NULL;
+	}
+	set->emit = emit;
+	set->data = data;
+	set->stats.nspilled = 0;
+	set->stats.nruns = 0;
+	set->stats.maxlevel = level;
+	return set;
+}
+
+// append 'key' to run file 'run' of 'set', creating the file if necessary
+static void spill_key(SpillSet *set, int run, int64 key) {
+	if (set->runs[run] == NULL) {
+		set->runs[run] = tmpfile();
+		assert(set->runs[run] && "error: could not create run file");
+		setvbuf(set->runs[run], NULL, _IOFBF, RUN_BUFFER_SIZE);
+		set->stats.nruns++;
+	}
+	size_t n = fwrite(&key, sizeof key, 1, set->runs[run]);
+	assert(n == 1 && "error: could not write to run file");
+	set->stats.nspilled++;
+}
+
+// add the statistics of the child set 'child' to those of 'set'
+static void add_stats(SpillSet *set, SpillStats child) {
+	set->stats.nspilled += child.nspilled;
+	set->stats.nruns += child.nruns;
+	if (child.maxlevel > set->stats.maxlevel) {
+		set->stats.maxlevel = child.maxlevel;
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// create a spill set deduplicating with hash tables of type 'type' and
+// initial size 'size', keeping at most 'budget' keys in memory at once
+SpillSet *new_spill_set(TableType type, int size, int budget,
+		EmitFunction emit, void *data) {
+	assert(budget > 0);
+	return new_spill_level(type, size, budget, emit, data, 0);
+}
+
+// free all memory (and run files) associated with 'set'
+void free_spill_set(SpillSet *set) {
+	assert(set);
+	if (set->table) {
+		free_hash_table(set->table);
+	}
+	int i;
+	for (i = 0; i < NRUNS; i++) {
+		if (set->runs[i]) {
+			fclose(set->runs[i]);
+		}
+	}
+	free(set);
+}
+
+// add 'key' to 'set'
+// returns true if 'key' is definitely being seen for the first time, false
+// if it is a duplicate or if it was spilled
+bool spill_set_add(SpillSet *set, int64 key) {
+	assert(set && set->table);
+
+	// once we have run out of bits to partition by, there's nothing for it
+	// but to keep going in memory
+	if (set->nkeys < set->budget || set->level >= SPILL_MAX_LEVEL) {
+		if (hash_table_insert(set->table, key)) {
+			set->nkeys++;
+			return true;
+		}
+		return false;
+	}
+
+	// over budget: keys we already hold are still duplicates, but anything
+	// else has to wait until the end
+	if (hash_table_lookup(set->table, key)) {
+		return false;
+	}
+	spill_key(set, spill_run(key, set->level), key);
+	return false;
+}
+
+// deduplicate each of the run files of 'set', passing each unique key found
+// to its emit function
+void spill_set_finish(SpillSet *set) {
+	assert(set && set->table);
+
+	// the in-memory keys are no longer needed, and no run key can be among
+	// them, so free them before processing the runs
+	free_hash_table(set->table);
+	set->table = NULL;
+
+	int64 *keys = malloc(sizeof(int64) * RUN_BUFFER_SIZE);
+	assert(keys);
+
+	int run;
+	for (run = 0; run < NRUNS; run++) {
+		if (set->runs[run] == NULL) {
+			continue;
+		}
+		rewind(set->runs[run]);
+
+		// deduplicate this run with a fresh set one level further down,
+		// which will partition its keys again if there are too many
+		SpillSet *child = new_spill_level(set->type, set->size, set->budget,
+			set->emit, set->data, set->level + 1);
+		size_t n;
+		while ((n = fread(keys, sizeof(int64), RUN_BUFFER_SIZE,
+				set->runs[run])) > 0) {
+			size_t i;
+			for (i = 0; i < n; i++) {
+				if (spill_set_add(child, keys[i])) {
+					set->emit(set->data, keys[i]);
+				}
+			}
+		}
+		spill_set_finish(child);
+		add_stats(set, child->stats);
+		free_spill_set(child);
+
+		fclose(set->runs[run]);
+		set->runs[run] = NULL;
+	}
+
+	free(keys);
+}
+
+// get statistics about 'set'
+SpillStats spill_set_stats(SpillSet *set) {
+	assert(set);
+	return set->stats;
+}
+
+// which of the run files should 'key' spill into at partitioning depth 'level'?
+// (this uses mix2, not h1 or h2, since the tables each run is loaded into hash
+// with those, and every key in a run shares the bits that chose it)
+int spill_run(int64 key, int level) {
+	int shift = 31 - SPILL_BITS * (level + 1);
+	return (mix2(key) >> shift) & (NRUNS - 1);
+}
@@ -0,0 +1,65 @@
+/* * * * * * * * *
+ * Deduplicating set that keeps a bounded number of keys in memory, spilling
+ * the rest to disk, Grace hash join style
+ *
+ * keys are inserted into an in-memory hash table until it holds 'budget'
+ * keys. after that, keys not already in the table are appended to one of
+ * several run files, chosen by the high bits of their mix2 hash. when the
+ * input is finished, each run file is deduplicated in turn with a fresh
+ * table (which may itself spill, partitioning by the next bits down)
+ */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdbool.h>
+#include "inthash.h"
+#include "hashtbl.h"
+
+// how many bits of mix2 choose a run file at each level (so there are
+// 2^SPILL_BITS run files per level)
+#define SPILL_BITS 4
+// mix2 produces 31 bit hashes, so this is how many levels of partitioning
+// there can be before we run out of bits
+#define SPILL_MAX_LEVEL (31 / SPILL_BITS)
+
+typedef struct spill_set SpillSet;
+
+// function called with each unique key found while finishing a spill set
+typedef void (*EmitFunction)(void *data, int64 key);
+
+// statistics about a spill set and all of the sets it spilled into
+typedef struct spill_stats {
+	long long nspilled;	// how many keys were written to run files
+	int nruns;			// how many run files were used
+	int maxlevel;		// deepest level of partitioning needed
+} SpillStats;
+
+// create a spill set deduplicating with hash tables of type 'type' and
+// initial size 'size', keeping at most 'budget' keys in memory at once
+// unique keys that had to be spilled are passed to 'emit' (along with
+// 'data') by spill_set_finish()
+SpillSet *new_spill_set(TableType type, int size, int budget,
+	EmitFunction emit, void *data);
+
+// free all memory (and run files) associated with 'set'
+void free_spill_set(SpillSet *set);
+
+// add 'key' to 'set'
+// returns true if 'key' is definitely being seen for the first time, false
+// if it is a duplicate or if it was spilled (in which case it will be passed
+// to 'emit' by spill_set_finish() if it turns out to be unique)
+bool spill_set_add(SpillSet *set, int64 key);
+
+// deduplicate each of the run files of 'set', passing each unique key found
+// to its emit function
+void spill_set_finish(SpillSet *set);
+
+// get statistics about 'set'
+SpillStats spill_set_stats(SpillSet *set);
+
+// which of the 2^SPILL_BITS run files should 'key' spill into at
+// partitioning depth 'level'?
+int spill_run(int64 key, int level);
+
+#endif
@@ -14,6 +14,10 @@
 #include <assert.h>
 #include <time.h>
 #include "cuckoo.h"
+#include "../phases.h"
+#include "../histogram.h"
+#include "../shards.h"
+#include "../gather.h"
 
 /*
 #include <windows.h>
@@ -27,13 +31,25 @@
 */
 
 #define EMPTY 0
+// how many keys ahead batched lookups prefetch
+#define PREFETCH_DISTANCE 8
+// how many keys batched lookups hash at a time
+#define HASH_CHUNK 64
 
 typedef struct stats {
-	int nkeys;		// how many keys are being stored in the table
-	int time;		// how much CPU time has been used to insert/lookup keys
-					// in this table
+	PhaseCosts phases;	// how many cycles each phase of an operation took
+	Histogram chains;	// how many keys each insertion displaced
+	ShardedCounters counters;	// keys and time (see below)
 } Stats;
 
+// the statistics every operation updates, which each thread counts in its
+// own shard of the table's counters (see shards.h)
+enum stat_counter {
+	STAT_KEYS,	// how many keys are being stored in the table
+	STAT_TIME	// how much CPU time has been used to insert/lookup keys
+				// in this table
+};
+
 // an inner table represents one of the two internal tables for a cuckoo
 // hash table. it stores two parallel arrays: 'slots' for storing keys and
 // 'inuse' for marking which entries are occupied
@@ -47,9 +63,21 @@ struct cuckoo_table {
 	InnerTable *table1; // first table
 	InnerTable *table2; // second table
 	int size;			// size of each table
+	TraceRing *trace;	// where to record resizes and cycles, or NULL
+	Reorder reorder;	// whether hit keys move to their first table
 	Stats stats;
 };
 
+// add 'delta' to statistic 'counter' of 'table', in the calling thread's shard
+static void count_stat(CuckooHashTable *table, int counter, long long delta) {
+	sharded_counter_count(&table->stats.counters, counter, delta);
+}
+
+// the total of statistic 'counter' of 'table', across every thread's shard
+static long long stat_total(CuckooHashTable *table, int counter) {
+	return sharded_counter_total(&table->stats.counters, counter);
+}
+
 void upsize_table(CuckooHashTable *table, int size);
 void upsize_inner(InnerTable *table, int size);
 InnerTable *new_inner_table(int size);
@@ -65,8 +93,11 @@ CuckooHashTable *new_cuckoo_hash_table(int size) {
 	cuckoo->table1 = new_inner_table(size);
 	cuckoo->table2 = new_inner_table(size);
 	cuckoo->size = size;
-	cuckoo->stats.time = 0;
-	cuckoo->stats.nkeys = 0;
+	cuckoo->trace = NULL;
+	cuckoo->reorder = REORDER_NONE;
+	sharded_counters_init(&cuckoo->stats.counters, TABLE_SHARDS);
+	phase_costs_init(&cuckoo->stats.phases);
+	histogram_init(&cuckoo->stats.chains, 16, true);
 	return cuckoo;
 }
 
@@ -80,6 +111,8 @@ void free_cuckoo_hash_table(CuckooHashTable *table) {
 	// Free inner tables
 	free(table->table1);
 	free(table->table2);
+	sharded_counters_free(&table->stats.counters);
+	phase_costs_free(&table->stats.phases);
 	// Free table
 	free(table);
 }
@@ -91,13 +124,17 @@ bool cuckoo_hash_table_insert(CuckooHashTable *table, int64 key) {
 	// Check if the key is already in the table, if so, return false
 	int start_time = clock(); // start timing
 	if (cuckoo_hash_table_lookup(table, key) == true){
-		table->stats.time += clock() - start_time;
+		count_stat(table, STAT_TIME, clock() - start_time);
 		return false;
 	}
 	// call recursive function with the key and hash. If false, then
 	// return unsuccessful insert, else return success
-	try_insert(table, key, (h1(key)%table->size), key, EMPTY);
-	table->stats.time += clock() - start_time;
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+	int pos = h1(key) % table->size;
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	try_insert(table, key, pos, key, EMPTY);
+	phase_enter(&table->stats.phases, outer);
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return true;
 }
 
@@ -107,22 +144,140 @@ bool cuckoo_hash_table_insert(CuckooHashTable *table, int64 key) {
 bool cuckoo_hash_table_lookup(CuckooHashTable *table, int64 key) {
 	int start_time = clock(); 
 	// Check both positions the key could possibly be in
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	int pos1 = h1(key) % table->size;
 	int pos2 = h2(key) % table->size;
+	phase_enter(&table->stats.phases, PHASE_PROBE);
 	// If key is found, return true
-	if (table->table1->slots[pos1] == key){
-		table->stats.time += clock() - start_time;		
-		return true;
+	bool found = table->table1->slots[pos1] == key
+		|| table->table2->slots[pos2] == key;
+	// a key found in its second table moves to its first if that slot is
+	// free, so the next lookup stops at the first compare. the old slot
+	// still holds the key, but it's marked free, and with no deletes a
+	// stale copy of a key that's still in the table can't give a false hit
+	if (found && table->reorder != REORDER_NONE
+			&& table->table1->slots[pos1] != key
+			&& !table->table1->inuse[pos1]) {
+		table->table1->slots[pos1] = key;
+		table->table1->inuse[pos1] = true;
+		table->table2->inuse[pos2] = false;
 	}
-	else if (table->table2->slots[pos2] == key){
-		table->stats.time += clock() - start_time;
-		return true;
+	phase_enter(&table->stats.phases, outer);
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return found;
+}
+
+
+// as cuckoo_hash_table_lookup, but without branching on the first slot:
+// both slots are loaded before either is compared, so that a miss waits for
+// memory once rather than twice
+bool cuckoo_hash_table_lookup_branchless(CuckooHashTable *table, int64 key) {
+	int start_time = clock();
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+	int pos1 = h1(key) % table->size;
+	int pos2 = h2(key) % table->size;
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	int64 slot1 = table->table1->slots[pos1];
+	int64 slot2 = table->table2->slots[pos2];
+	// | rather than ||, so there's no branch between the two comparisons
+	bool found = (slot1 == key) | (slot2 == key);
+	phase_enter(&table->stats.phases, outer);
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return found;
+}
+
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', storing
+// the results in 'found'
+// keys are hashed a chunk at a time with the batch hash kernels, and then
+// both possible slots of each key are prefetched a few keys ahead of looking
+// for it, so that the cache misses of several lookups overlap
+void cuckoo_hash_table_lookup_batch(CuckooHashTable *table, const int64 *keys,
+		int n, bool *found) {
+	assert(table);
+	int start_time = clock();
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+
+	// hashes of the current chunk, which become positions as they're
+	// prefetched
+	int pos1[HASH_CHUNK];
+	int pos2[HASH_CHUNK];
+	int start;
+	for (start = 0; start < n; start += HASH_CHUNK) {
+		const int64 *chunk = keys + start;
+		int m = n - start < HASH_CHUNK ? n - start : HASH_CHUNK;
+		phase_enter(&table->stats.phases, PHASE_HASH);
+		hash_batch(HASH_H1, chunk, m, pos1);
+		hash_batch(HASH_H2, chunk, m, pos2);
+
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		int i;
+		for (i = 0; i < m + PREFETCH_DISTANCE; i++) {
+			// check the key prefetched a while ago
+			if (i >= PREFETCH_DISTANCE) {
+				int j = i - PREFETCH_DISTANCE;
+				found[start + j] = (table->table1->slots[pos1[j]] == chunk[j])
+					| (table->table2->slots[pos2[j]] == chunk[j]);
+			}
+			if (i < m) {
+				pos1[i] %= table->size;
+				pos2[i] %= table->size;
+				__builtin_prefetch(&table->table1->slots[pos1[i]]);
+				__builtin_prefetch(&table->table2->slots[pos2[i]]);
+			}
+		}
 	}
-	table->stats.time += clock() - start_time;
-	return false;
+
+	phase_enter(&table->stats.phases, outer);
+	count_stat(table, STAT_TIME, clock() - start_time);
 }
 
 
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 64 of found[i / 64] if keys[i] is and clearing it if not ('found'
+// must have room for (n + 63) / 64 words)
+// keys are hashed and their slots gathered and compared 8 (or 4) at a time
+// with vector instructions, where the CPU has them
+void cuckoo_hash_table_lookup_mask(CuckooHashTable *table, const int64 *keys,
+		int n, uint64_t *found) {
+	assert(table);
+	int start_time = clock();
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+
+	// a word of the result at a time
+	int hashes1[GATHER_MAX];
+	int hashes2[GATHER_MAX];
+	int start;
+	for (start = 0; start < n; start += GATHER_MAX) {
+		int m = n - start < GATHER_MAX ? n - start : GATHER_MAX;
+		phase_enter(&table->stats.phases, PHASE_HASH);
+		hash_batch(HASH_H1, keys + start, m, hashes1);
+		hash_batch(HASH_H2, keys + start, m, hashes2);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		found[start / GATHER_MAX] = gather_match2(table->table1->slots,
+			table->table2->slots, table->size, hashes1, hashes2,
+			keys + start, m);
+	}
+
+	phase_enter(&table->stats.phases, outer);
+	count_stat(table, STAT_TIME, clock() - start_time);
+}
+
+
+// record structural events in 'table' in 'trace' from now on, or stop
+// recording them if 'trace' is NULL
+void cuckoo_hash_table_set_trace(CuckooHashTable *table, TraceRing *trace) {
+	assert(table != NULL);
+	table->trace = trace;
+}
+
+// move keys hit in their second table into their first whenever that slot is
+// free, unless 'policy' is REORDER_NONE
+void cuckoo_hash_table_set_reorder(CuckooHashTable *table, Reorder policy) {
+	assert(table != NULL);
+	table->reorder = policy;
+}
+
 // print the contents of 'table' to stdout
 void cuckoo_hash_table_print(CuckooHashTable *table) {
 	assert(table);
@@ -165,14 +320,47 @@ void cuckoo_hash_table_stats(CuckooHashTable *table) {
 	printf("--- table stats ---\n");
 	// print some information about the table
 	printf("current size: %d slots\n", table->size);
-	printf("current load: %d items\n", table->stats.nkeys);
-	printf(" load factor: %.3f%%\n", table->stats.nkeys * 100.0 / table->size*2);
+	long long nkeys = stat_total(table, STAT_KEYS);
+	printf("current load: %lld items\n", nkeys);
+	printf(" load factor: %.3f%%\n", nkeys * 100.0 / table->size*2);
+	// count how the keys are split between the two tables
+	int nkeys1 = 0, nkeys2 = 0;
+	int i;
+	for (i = 0; i < table->size; i++) {
+		nkeys1 += table->table1->inuse[i];
+		nkeys2 += table->table2->inuse[i];
+	}
+	printf("table 1 keys: %d\n", nkeys1);
+	printf("table 2 keys: %d\n", nkeys2);
 	// also calculate CPU usage in seconds and print this
-	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	float seconds = stat_total(table, STAT_TIME) * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
+	histogram_print(&table->stats.chains, "eviction chain lengths");
+	phase_costs_print(&table->stats.phases);
 	printf("--- end stats ---\n");
 }
 
+// fill 'report' with the statistics of 'table'
+void cuckoo_hash_table_report(CuckooHashTable *table, StatsReport *report) {
+	assert(table != NULL);
+	stats_report_init(report, "cuckoo");
+	int nkeys1 = 0, nkeys2 = 0;
+	int i;
+	for (i = 0; i < table->size; i++) {
+		nkeys1 += table->table1->inuse[i];
+		nkeys2 += table->table2->inuse[i];
+	}
+	stats_report_counter(report, "size_slots", table->size);
+	stats_report_counter(report, "load_keys", stat_total(table, STAT_KEYS));
+	stats_report_counter(report, "table1_keys", nkeys1);
+	stats_report_counter(report, "table2_keys", nkeys2);
+	stats_report_counter(report, "cpu_time_usec",
+		stat_total(table, STAT_TIME) * 1000000LL / CLOCKS_PER_SEC);
+	stats_report_phases(report, &table->stats.phases);
+	stats_report_histogram(report, "eviction_chain_lengths",
+		&table->stats.chains);
+}
+
 // Helper Functions!
 
 // Creates an inner table
@@ -216,8 +404,13 @@ void try_insert(CuckooHashTable *table, int64 key, int orig_pos,
 	// the original key
 	if ((init_pos == orig_pos) && (key == orig_key) && (loop > 1) && 
 		(loop % 2 == 1)) {
+		trace_instant(table->trace, EVENT_CYCLE, loop, 0);
+		phase_enter(&table->stats.phases, PHASE_GROW);
 		upsize_table(table, table->size*2);
-		try_insert(table, key, orig_pos, orig_key, EMPTY);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		// (the key's position has moved with the new size, and the cycle
+		// check needs to know where it now starts)
+		try_insert(table, key, h1(key) % table->size, orig_key, EMPTY);
 		return;
 	}
 	// check if there is already something in the position
@@ -227,6 +420,7 @@ void try_insert(CuckooHashTable *table, int64 key, int orig_pos,
 		// taken out
 		int64 rehash_key = inner_table->slots[init_pos];
 		inner_table->slots[init_pos] = key;
+		phase_enter(&table->stats.phases, PHASE_EVICT);
 		try_insert(table, rehash_key, orig_pos, orig_key, loop);
 		return;
 	}
@@ -234,7 +428,8 @@ void try_insert(CuckooHashTable *table, int64 key, int orig_pos,
 		// If there's nothing there, insert!
 		inner_table->inuse[init_pos] = true;
 		inner_table->slots[init_pos] = key;
-		table->stats.nkeys++;
+		count_stat(table, STAT_KEYS, 1);
+		histogram_add(&table->stats.chains, loop - 1);
 	}
 }
 
@@ -244,6 +439,7 @@ void upsize_table(CuckooHashTable *table, int size) {
 	assert(table);
 	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
 	int i;
+	long long start = trace_start(table->trace);
 	// Copy old keys into their respective arrays
 	int64 *old_keys_1 = table->table1->slots;
 	int64 *old_keys_2 = table->table2->slots;
@@ -251,8 +447,10 @@ void upsize_table(CuckooHashTable *table, int size) {
 	bool *old_inuse_2 = table->table2->inuse;
 	int old_size = table->size;
 	// remake inner tables with new size
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
 	upsize_inner(table->table1, size);
 	upsize_inner(table->table2, size);
+	phase_enter(&table->stats.phases, PHASE_GROW);
 	// update table size
 	table->size = size;
 	// Reinsert old keys into respective tables
@@ -269,6 +467,7 @@ void upsize_table(CuckooHashTable *table, int size) {
 	free(old_keys_2);
 	free(old_inuse_1);
 	free(old_inuse_2);
+	trace_end(table->trace, EVENT_RESIZE, start, old_size, size);
 }
 
 // function doubles the size of an inner table
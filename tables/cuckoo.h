@@ -10,7 +10,11 @@
 #define CUCKOO_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "../inthash.h"
+#include "../trace.h"
+#include "../report.h"
+#include "../reorder.h"
 
 typedef struct cuckoo_table CuckooHashTable;
 
@@ -28,10 +32,39 @@ bool cuckoo_hash_table_insert(CuckooHashTable *table, int64 key);
 // returns true if found, false if not
 bool cuckoo_hash_table_lookup(CuckooHashTable *table, int64 key);
 
+// as cuckoo_hash_table_lookup, but without branching on the first slot:
+// both slots are loaded before either is compared, so that a miss waits for
+// memory once rather than twice
+bool cuckoo_hash_table_lookup_branchless(CuckooHashTable *table, int64 key);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', storing
+// the results in 'found'
+void cuckoo_hash_table_lookup_batch(CuckooHashTable *table, const int64 *keys,
+	int n, bool *found);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 64 of found[i / 64] if keys[i] is and clearing it if not ('found'
+// must have room for (n + 63) / 64 words)
+// keys are hashed and their slots gathered and compared 8 (or 4) at a time
+// with vector instructions, where the CPU has them
+void cuckoo_hash_table_lookup_mask(CuckooHashTable *table, const int64 *keys,
+	int n, uint64_t *found);
+
+// record structural events in 'table' (such as resizes) in 'trace' from now
+// on, or stop recording them if 'trace' is NULL
+void cuckoo_hash_table_set_trace(CuckooHashTable *table, TraceRing *trace);
+
+// move keys hit in their second table into their first whenever that slot is
+// free, unless 'policy' is REORDER_NONE
+void cuckoo_hash_table_set_reorder(CuckooHashTable *table, Reorder policy);
+
 // print the contents of 'table' to stdout
 void cuckoo_hash_table_print(CuckooHashTable *table);
 
 // print some statistics about 'table' to stdout
 void cuckoo_hash_table_stats(CuckooHashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table'
+void cuckoo_hash_table_report(CuckooHashTable *table, StatsReport *report);
+
 #endif
@@ -12,6 +12,11 @@
 #include <time.h>
 
 #include "linear.h"
+#include "../timewheel.h"
+#include "../counts.h"
+#include "../phases.h"
+#include "../histogram.h"
+#include "../shards.h"
 
 // Define colours used for debugging purposes.
 /*
@@ -26,33 +31,96 @@
 
 // how many cells to advance at a time while looking for a free slot
 #define STEP_SIZE 1
+// how many keys ahead batched lookups prefetch
+#define PREFETCH_DISTANCE 8
+// how many keys batched lookups hash at a time
+#define HASH_CHUNK 64
 // helper structure to store statistics gathered
 typedef struct stats {
-	float collisions;	// how many distinct buckets does the table point to
-	int nkeys;		// how many keys are being stored in the table
-	float total_probes; // total steps taken in probes
-	int time;		// how much CPU time has been used to insert/lookup keys
-					// in this table
+	PhaseCosts phases;	// how many cycles each phase of an operation took
+	ShardedCounters counters;	// keys, time, probes and more (see below)
 } Stats;
 
+// the statistics every operation updates, which each thread counts in its
+// own shard of the table's counters (see shards.h)
+enum stat_counter {
+	STAT_KEYS,			// how many keys are being stored in the table
+	STAT_TIME,			// how much CPU time has been used to insert/lookup keys
+						// in this table
+	STAT_COLLISIONS,	// how many inserts found their first slot taken
+	STAT_PROBES,		// total steps taken in probes
+	STAT_EVICTIONS,		// how many keys have been evicted to stay within
+						// capacity
+	STAT_EXPIRED		// how many keys have been removed after their ttl
+						// passed
+};
+
 // a hash table is an array of slots holding keys, along with a parallel array
 // of boolean markers recording which slots are in use (true) or free (false)
 // important because not-in-use slots might hold garbage data, as they may
 // not have been initialised
+// in bounded mode, a third parallel array holds the CLOCK reference bit of
+// each slot, set whenever the key in that slot is hit
+// in ttl mode, a fourth holds the tick at which the key in each slot expires,
+// and a timer wheel schedules the removal of each key when it does
+// every slot also has a compact counter of how many times its key was counted
 struct linear_table {
 	int64 *slots;	// array of slots holding keys
 	bool  *inuse;	// is this slot in use or not?
-	int size;		// the size of both of these arrays right now
+	bool  *refbit;	// has this slot been referenced since the hand passed?
+	int   *expiry;	// at which tick does the key in this slot expire?
+	CountArray counts;	// how many times has the key in each slot been counted?
+	int size;		// the size of all of these arrays right now
 	int load;		// number of keys in the table right now
+	int capacity;	// maximum size in bounded mode, or 0 if unbounded
+	int hand;		// the slot the CLOCK hand is currently pointing at
+	int stride;		// how many slots the CLOCK hand moves at a time
+	int ttl;		// how many ticks keys live for in ttl mode, or 0 if forever
+	int now;		// the current tick, as last set by advance
+	TimerWheel *wheel;	// schedule of key expiries in ttl mode
+	TraceRing *trace;	// where to record resizes, or NULL if not tracing
 	Stats stats;
 };
 
+// add 'delta' to statistic 'counter' of 'table', in the calling thread's shard
+static void count_stat(LinearHashTable *table, int counter, long long delta) {
+	sharded_counter_count(&table->stats.counters, counter, delta);
+}
+
+// the total of statistic 'counter' of 'table', across every thread's shard
+static long long stat_total(LinearHashTable *table, int counter) {
+	return sharded_counter_total(&table->stats.counters, counter);
+}
+
 
 
 /* * * *
  * helper functions
  */
 
+// how far the CLOCK hand should move at a time around a table of 'size'
+// slots: about 0.618 of the way round (so that the keys it evicts one after
+// another are spread across the table, rather than emptying one region while
+// the rest fills up and its probe runs grow long), and sharing no factor with
+// 'size' (so that it visits every slot before coming back around)
+static int hand_stride(int size) {
+	int stride = (int)((long long)size * 618 / 1000);
+	if (stride < 1) {
+		stride = 1;
+	}
+	for (;; stride++) {
+		int a = size, b = stride;
+		while (b != 0) {
+			int r = a % b;
+			a = b;
+			b = r;
+		}
+		if (a == 1) {
+			return stride;
+		}
+	}
+}
+
 // set up the internals of a linear hash table struct with new
 // arrays of size 'size'
 static void initialise_table(LinearHashTable *table, int size) {
@@ -62,12 +130,44 @@ static void initialise_table(LinearHashTable *table, int size) {
 	assert(table->slots);
 	table->inuse = malloc((sizeof *table->inuse) * size);
 	assert(table->inuse);
+	table->refbit = malloc((sizeof *table->refbit) * size);
+	assert(table->refbit);
+	table->expiry = malloc((sizeof *table->expiry) * size);
+	assert(table->expiry);
+	count_array_init(&table->counts, size);
 	int i;
 	for (i = 0; i < size; i++) {
 		table->inuse[i] = false;
+		table->refbit[i] = false;
 	}
 	table->size = size;
 	table->load = 0;
+	table->hand = 0;
+	table->stride = hand_stride(size);
+}
+
+
+// reinsert a key into the table after doubling, keeping its reference bit,
+// expiry tick and count --- we can assume that there will definitely be space
+// for this key because it was already inside the (smaller) table previously
+static void reinsert_key(LinearHashTable *table, int64 key, bool refbit,
+		int expiry, uint32_t count) {
+	int steps = 0;
+	int h = h1(key) % table->size;
+	while (table->inuse[h]) {
+		h = (h + STEP_SIZE) % table->size;
+		steps++;
+	}
+	if (steps > 0) {
+		count_stat(table, STAT_PROBES, steps);
+		count_stat(table, STAT_COLLISIONS, 1);
+	}
+	table->slots[h] = key;
+	table->inuse[h] = true;
+	table->refbit[h] = refbit;
+	table->expiry[h] = expiry;
+	count_array_set(&table->counts, h, count);
+	table->load++;
 }
 
 
@@ -76,19 +176,148 @@ static void initialise_table(LinearHashTable *table, int size) {
 static void double_table(LinearHashTable *table) {
 	int64 *oldslots = table->slots;
 	bool  *oldinuse = table->inuse;
+	bool  *oldrefbit = table->refbit;
+	int   *oldexpiry = table->expiry;
+	CountArray oldcounts = table->counts;
 	int oldsize = table->size;
+	long long start = trace_start(table->trace);
 
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
 	initialise_table(table, table->size * 2);
+	phase_enter(&table->stats.phases, PHASE_GROW);
 
 	int i;
 	for (i = 0; i < oldsize; i++) {
 		if (oldinuse[i] == true) {
-			linear_hash_table_insert(table, oldslots[i]);
+			reinsert_key(table, oldslots[i], oldrefbit[i], oldexpiry[i],
+				count_array_get(&oldcounts, i));
 		}
 	}
 
 	free(oldslots);
 	free(oldinuse);
+	free(oldrefbit);
+	free(oldexpiry);
+	count_array_free(&oldcounts);
+	trace_end(table->trace, EVENT_RESIZE, start, oldsize, table->size);
+}
+
+
+// find the slot holding 'key', returning its address, or -1 if it's not there
+static int find_slot(LinearHashTable *table, int64 key) {
+	int steps = 0;
+	int h = h1(key) % table->size;
+	while (table->inuse[h] && steps < table->size) {
+		if (table->slots[h] == key) {
+			return h;
+		}
+		h = (h + STEP_SIZE) % table->size;
+		steps++;
+	}
+	return -1;
+}
+
+
+// has the key in slot 'h' outlived its ttl?
+static bool is_expired(LinearHashTable *table, int h) {
+	return table->ttl > 0 && table->expiry[h] - table->now <= 0;
+}
+
+
+// remove the key in slot 'h', then shift any later keys in the same probe
+// run backwards so that every remaining key is still reachable from its home
+// slot without passing a free slot
+static void remove_slot(LinearHashTable *table, int h) {
+	table->inuse[h] = false;
+	table->refbit[h] = false;
+	table->load--;
+	count_stat(table, STAT_KEYS, -1);
+
+	int hole = h;
+	int i = (h + STEP_SIZE) % table->size;
+	while (table->inuse[i]) {
+		// the key at i may fill the hole only if the hole lies on its probe
+		// path, i.e. between its home slot and i
+		int home = h1(table->slots[i]) % table->size;
+		int from_home = (i - home + table->size) % table->size;
+		int from_hole = (i - hole + table->size) % table->size;
+		if (from_home >= from_hole) {
+			table->slots[hole] = table->slots[i];
+			table->inuse[hole] = true;
+			table->refbit[hole] = table->refbit[i];
+			table->expiry[hole] = table->expiry[i];
+			count_array_set(&table->counts, hole,
+				count_array_get(&table->counts, i));
+			table->inuse[i] = false;
+			table->refbit[i] = false;
+			hole = i;
+		}
+		i = (i + STEP_SIZE) % table->size;
+	}
+}
+
+
+// how many keys a bounded table holds before it grows or evicts a key: 3/4
+// of its slots, so that probe runs stay short
+static int bounded_load(LinearHashTable *table) {
+	return table->size - table->size / 4;
+}
+
+
+// advance the CLOCK hand past free slots until it finds a key whose
+// reference bit is clear, clearing reference bits as it passes (giving those
+// keys a second chance), then evict that key. the hand stays put, so a later
+// key shifted back into the victim's slot is checked next
+static void evict_slot(LinearHashTable *table) {
+	while (!table->inuse[table->hand] || table->refbit[table->hand]) {
+		table->refbit[table->hand] = false;
+		table->hand = (table->hand + table->stride) % table->size;
+	}
+	int victim = table->hand;
+
+	remove_slot(table, victim);
+	count_stat(table, STAT_EVICTIONS, 1);
+}
+
+
+// a due timer tagged with the home address of its key, for sorting
+typedef struct due_timer {
+	int home;
+	Timer timer;
+} DueTimer;
+
+// compare two due timers by home address, for qsort
+static int compare_due(const void *a, const void *b) {
+	const DueTimer *x = a, *y = b;
+	return (x->home > y->home) - (x->home < y->home);
+}
+
+// remove a batch of keys whose timers have come due from the table (passed
+// as 'data'), visiting them in address order so the sweep moves through the
+// table sequentially
+static void expire_timers(void *data, Timer *timers, int ntimers) {
+	LinearHashTable *table = data;
+
+	DueTimer *due = malloc((sizeof *due) * ntimers);
+	assert(due);
+	int i;
+	for (i = 0; i < ntimers; i++) {
+		due[i].home = h1(timers[i].key) % table->size;
+		due[i].timer = timers[i];
+	}
+	qsort(due, ntimers, sizeof *due, compare_due);
+
+	for (i = 0; i < ntimers; i++) {
+		// the key may since have been removed, or removed and reinserted with
+		// a later expiry, in which case this timer is stale
+		int h = find_slot(table, due[i].timer.key);
+		if (h >= 0 && table->expiry[h] == due[i].timer.deadline
+				&& is_expired(table, h)) {
+			remove_slot(table, h);
+			count_stat(table, STAT_EXPIRED, 1);
+		}
+	}
+	free(due);
 }
 
 
@@ -103,10 +332,13 @@ LinearHashTable *new_linear_hash_table(int size) {
 
 	// set up the internals of the table struct with arrays of size 'size'
 	initialise_table(table, size);
-	table->stats.nkeys = 0;
-	table->stats.time = 0;
-	table->stats.collisions = 0;
-	table->stats.total_probes = 0;
+	table->capacity = 0;
+	table->ttl = 0;
+	table->now = 0;
+	table->wheel = NULL;
+	table->trace = NULL;
+	sharded_counters_init(&table->stats.counters, TABLE_SHARDS);
+	phase_costs_init(&table->stats.phases);
 	return table;
 }
 
@@ -118,29 +350,51 @@ void free_linear_hash_table(LinearHashTable *table) {
 	// free the table's arrays
 	free(table->slots);
 	free(table->inuse);
+	free(table->refbit);
+	free(table->expiry);
+	count_array_free(&table->counts);
+	if (table->wheel) {
+		free_timer_wheel(table->wheel);
+	}
 
+	sharded_counters_free(&table->stats.counters);
+	phase_costs_free(&table->stats.phases);
 	// free the table struct itself
 	free(table);
 }
 
 
-// insert 'key' into 'table', if it's not in there already
-// returns true if insertion succeeds, false if it was already in there
-bool linear_hash_table_insert(LinearHashTable *table, int64 key) {
+// insert 'key' into 'table' with count 'initial' if it's not in there already,
+// or add 'delta' to its count if it is, storing its resulting count in *count
+// returns true if the key was inserted, false if it was already in there
+static bool insert_key(LinearHashTable *table, int64 key, uint32_t initial,
+		uint32_t delta, uint32_t *count) {
 	assert(table != NULL);
 	int start_time = clock(); // start timing
 	// need to count our steps to make sure we recognise when the table is full
 	int steps = 0;
 
 	// calculate the initial address for this key
+	phase_enter(&table->stats.phases, PHASE_HASH);
 	int h = h1(key) % table->size;
+	phase_enter(&table->stats.phases, PHASE_PROBE);
 	bool did_probe = false;
 	// step along the array until we find a free space (inuse[]==false),
 	// or until we visit every cell
 	while (table->inuse[h] && steps < table->size) {
+		if (table->slots[h] == key && is_expired(table, h)) {
+			// this key is here, but it has expired: remove it and start
+			// again, this time inserting it afresh
+			remove_slot(table, h);
+			count_stat(table, STAT_EXPIRED, 1);
+			count_stat(table, STAT_TIME, clock() - start_time);
+			return insert_key(table, key, initial, delta, count);
+		}
 		if (table->slots[h] == key) {
 			// this key already exists in the table! no need to insert
-			table->stats.time += clock() - start_time;
+			table->refbit[h] = true;
+			*count = count_array_add(&table->counts, h, delta);
+			count_stat(table, STAT_TIME, clock() - start_time);
 			return false;
 		}
 		
@@ -155,45 +409,95 @@ bool linear_hash_table_insert(LinearHashTable *table, int64 key) {
 	// Also increment collisions.
 
 	// if we used up all of our steps, then we're back where we started and the
-	// table is full
-	if (steps == table->size) {
-		// let's make some more space and then try to insert this key again!
-		double_table(table);
-		return linear_hash_table_insert(table, key);
+	// table is full (a bounded table counts as full a little sooner)
+	if (steps == table->size || (table->capacity > 0
+			&& table->load >= bounded_load(table))) {
+		if (table->capacity > 0 && table->size * 2 > table->capacity) {
+			// we're not allowed to grow any further, so make space by
+			// evicting a key that hasn't been used recently instead
+			phase_enter(&table->stats.phases, PHASE_EVICT);
+			evict_slot(table);
+		} else {
+			// let's make some more space
+			phase_enter(&table->stats.phases, PHASE_GROW);
+			double_table(table);
+		}
+		// and then try to insert this key again!
+		return insert_key(table, key, initial, delta, count);
 
 	} else {
 		// otherwise, we have found a free slot! insert this key right here
 		if (did_probe){
-			table->stats.total_probes += steps;
-			table->stats.collisions++;
+			count_stat(table, STAT_PROBES, steps);
+			count_stat(table, STAT_COLLISIONS, 1);
 		}
 		table->slots[h] = key;
 		table->inuse[h] = true;
+		table->refbit[h] = false;
+		count_array_set(&table->counts, h, initial);
+		*count = initial;
 		table->load++;
-		table->stats.nkeys++;
-		table->stats.time += clock() - start_time;
+		count_stat(table, STAT_KEYS, 1);
+		if (table->ttl > 0) {
+			// schedule this key's removal once its ttl has passed
+			table->expiry[h] = table->now + table->ttl;
+			timer_wheel_add(table->wheel, key, table->expiry[h]);
+		}
+		count_stat(table, STAT_TIME, clock() - start_time);
 		return true;
 	}
 }
 
 
-// lookup whether 'key' is inside 'table'
-// returns true if found, false if not
-bool linear_hash_table_lookup(LinearHashTable *table, int64 key) {
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool linear_hash_table_insert(LinearHashTable *table, int64 key) {
 	assert(table != NULL);
-	int start_time = clock(); // start timing
+	uint32_t count;
+	// (insert_key will enter each phase once it has started timing)
+	Phase outer = phase_enter(&table->stats.phases, PHASE_NONE);
+	bool inserted = insert_key(table, key, 1, 0, &count);
+	phase_enter(&table->stats.phases, outer);
+	return inserted;
+}
+
+
+// add 'delta' to the count of 'key' in 'table', inserting it with count
+// 'delta' if it's not in there already, all in a single probe ('delta' must
+// be at least 1)
+// returns the key's new count
+uint32_t linear_hash_table_increment(LinearHashTable *table, int64 key,
+		uint32_t delta) {
+	assert(table != NULL);
+	assert(delta > 0);
+	uint32_t count;
+	// (insert_key will enter each phase once it has started timing)
+	Phase outer = phase_enter(&table->stats.phases, PHASE_NONE);
+	insert_key(table, key, delta, delta, &count);
+	phase_enter(&table->stats.phases, outer);
+	return count;
+}
+
+
+// look for 'key' in 'table', starting from its home address 'h'
+// returns true if found, false if not
+static bool probe_for_key(LinearHashTable *table, int64 key, int h) {
 	// need to count our steps to make sure we recognise when the table is full
 	int steps = 0;
 
-	// calculate the initial address for this key
-	int h = h1(key) % table->size;
-
 	// step along until we find a free space (inuse[]==false), or until we
 	// visit every cell
 	while (table->inuse[h] && steps < table->size) {
 
+		if (table->slots[h] == key && is_expired(table, h)) {
+			// found the key, but it has expired, so remove it now
+			remove_slot(table, h);
+			count_stat(table, STAT_EXPIRED, 1);
+			return false;
+		}
 		if (table->slots[h] == key) {
 			// found the key!
+			table->refbit[h] = true;
 			return true;
 		}
 
@@ -201,13 +505,155 @@ bool linear_hash_table_lookup(LinearHashTable *table, int64 key) {
 		h = (h + STEP_SIZE) % table->size;
 		steps++;
 	}
-	table->stats.time += clock() - start_time;
 	// we have either searched the whole table or come back to where we started
 	// either way, the key is not in the hash table
 	return false;
 }
 
 
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool linear_hash_table_lookup(LinearHashTable *table, int64 key) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	// calculate the initial address for this key, and look from there
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+	int h = h1(key) % table->size;
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	bool found = probe_for_key(table, key, h);
+	phase_enter(&table->stats.phases, outer);
+
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return found;
+}
+
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', storing
+// the results in 'found'
+// keys are hashed a chunk at a time with the batch hash kernels, and then
+// the home slot of each key is prefetched a few keys ahead of looking for
+// it, so that the cache misses of several lookups overlap
+void linear_hash_table_lookup_batch(LinearHashTable *table, const int64 *keys,
+		int n, bool *found) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+
+	// hashes of the current chunk, which become home addresses as they're
+	// prefetched
+	int homes[HASH_CHUNK];
+	int start;
+	for (start = 0; start < n; start += HASH_CHUNK) {
+		const int64 *chunk = keys + start;
+		int m = n - start < HASH_CHUNK ? n - start : HASH_CHUNK;
+		phase_enter(&table->stats.phases, PHASE_HASH);
+		hash_batch(HASH_H1, chunk, m, homes);
+
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		int i;
+		for (i = 0; i < m + PREFETCH_DISTANCE; i++) {
+			// look for the key prefetched a while ago
+			if (i >= PREFETCH_DISTANCE) {
+				int j = i - PREFETCH_DISTANCE;
+				found[start + j] = probe_for_key(table, chunk[j], homes[j]);
+			}
+			if (i < m) {
+				homes[i] %= table->size;
+				__builtin_prefetch(&table->slots[homes[i]]);
+				__builtin_prefetch(&table->inuse[homes[i]]);
+			}
+		}
+	}
+
+	phase_enter(&table->stats.phases, outer);
+	count_stat(table, STAT_TIME, clock() - start_time);
+}
+
+
+// return the count of 'key' in 'table', or 0 if it's not in there
+uint32_t linear_hash_table_count(LinearHashTable *table, int64 key) {
+	assert(table != NULL);
+	int h = find_slot(table, key);
+	if (h < 0 || is_expired(table, h)) {
+		return 0;
+	}
+	return count_array_get(&table->counts, h);
+}
+
+
+// find the (up to) 'k' keys in 'table' with the highest counts, storing them
+// in 'keys' and their counts in 'counts' in descending order of count
+// returns the number of keys found
+int linear_hash_table_top(LinearHashTable *table, int k, int64 *keys,
+		uint32_t *counts) {
+	assert(table != NULL);
+	TopCounts top;
+	top_counts_init(&top, keys, counts, k);
+	int i;
+	for (i = 0; i < table->size; i++) {
+		if (table->inuse[i] && !is_expired(table, i)) {
+			top_counts_offer(&top, table->slots[i],
+				count_array_get(&table->counts, i));
+		}
+	}
+	return top_counts_finish(&top);
+}
+
+
+// bound 'table' to at most 'capacity' slots: once it can't double without
+// exceeding this, inserting into a full table evicts a key using CLOCK
+// (second-chance) replacement instead of growing
+void linear_hash_table_set_capacity(LinearHashTable *table, int capacity) {
+	assert(table != NULL);
+	assert(capacity > 0);
+	table->capacity = capacity;
+}
+
+
+// give keys inserted into 'table' from now on a time-to-live of 'ttl' ticks,
+// after which they are treated as absent and removed
+// (keys already in a table without a ttl get theirs from now)
+void linear_hash_table_set_ttl(LinearHashTable *table, int ttl) {
+	assert(table != NULL);
+	assert(ttl > 0);
+	if (table->wheel == NULL) {
+		table->wheel = new_timer_wheel(table->now);
+	}
+	if (table->ttl == 0) {
+		// the keys already here were inserted without an expiry, so give
+		// them one, and schedule their removal
+		int h;
+		for (h = 0; h < table->size; h++) {
+			if (table->inuse[h]) {
+				table->expiry[h] = table->now + ttl;
+				timer_wheel_add(table->wheel, table->slots[h], table->expiry[h]);
+			}
+		}
+	}
+	table->ttl = ttl;
+}
+
+
+// advance the clock of 'table' to tick 'now', sweeping out any keys whose
+// ttl has passed along the way
+void linear_hash_table_advance(LinearHashTable *table, int now) {
+	assert(table != NULL);
+	assert(now >= table->now && "error: clock can't go backwards");
+	table->now = now;
+	if (table->wheel) {
+		timer_wheel_advance(table->wheel, now, expire_timers, table);
+	}
+}
+
+
+// record structural events in 'table' in 'trace' from now on, or stop
+// recording them if 'trace' is NULL
+void linear_hash_table_set_trace(LinearHashTable *table, TraceRing *trace) {
+	assert(table != NULL);
+	table->trace = trace;
+}
+
 // print the contents of 'table' to stdout
 void linear_hash_table_print(LinearHashTable *table) {
 	assert(table != NULL);
@@ -236,21 +682,73 @@ void linear_hash_table_print(LinearHashTable *table) {
 }
 
 
+// fill 'probes' with how far each key in 'table' is from its home slot
+static void probe_lengths(LinearHashTable *table, Histogram *probes) {
+	histogram_init(probes, 16, true);
+	int i;
+	for (i = 0; i < table->size; i++) {
+		if (table->inuse[i]) {
+			int home = h1(table->slots[i]) % table->size;
+			histogram_add(probes, (i - home + table->size) % table->size);
+		}
+	}
+}
+
 // print some statistics about 'table' to stdout
 void linear_hash_table_stats(LinearHashTable *table) {
 	assert(table != NULL);
 	printf("--- table stats ---\n");
 	// calculate the average probe distance
-	float avg_probes = table->stats.total_probes/table->stats.collisions;
+	float collisions = stat_total(table, STAT_COLLISIONS);
+	float avg_probes = stat_total(table, STAT_PROBES)/collisions;
 	// print some information about the table
 	printf("current size: %d slots\n", table->size);
 	printf("current load: %d items\n", table->load);
 	printf(" load factor: %.3f%%\n", table->load * 100.0 / table->size);
 	printf("   step size: %d slots\n", STEP_SIZE);
-	printf("  collisions: %.3f\n", table->stats.collisions);
+	if (table->counts.width > 1) {
+		printf(" count width: %d bits\n", table->counts.width * 8);
+	}
+	printf("  collisions: %.3f\n", collisions);
 	printf("  avg_probes: %.3f\n", avg_probes);
+	if (table->capacity > 0) {
+		printf("    capacity: %d slots\n", table->capacity);
+		printf("   evictions: %lld\n", stat_total(table, STAT_EVICTIONS));
+	}
+	if (table->ttl > 0) {
+		printf("         ttl: %d ticks\n", table->ttl);
+		printf("     expired: %lld\n", stat_total(table, STAT_EXPIRED));
+	}
 	// also calculate CPU usage in seconds and print this
-	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	float seconds = stat_total(table, STAT_TIME) * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
+	Histogram probes;
+	probe_lengths(table, &probes);
+	histogram_print(&probes, "probe lengths");
+	phase_costs_print(&table->stats.phases);
 	printf("--- end stats ---\n");
 }
+
+// fill 'report' with the statistics of 'table'
+void linear_hash_table_report(LinearHashTable *table, StatsReport *report) {
+	assert(table != NULL);
+	stats_report_init(report, "linear");
+	stats_report_counter(report, "size_slots", table->size);
+	stats_report_counter(report, "load_keys", table->load);
+	stats_report_counter(report, "inserted_keys",
+		stat_total(table, STAT_KEYS));
+	stats_report_counter(report, "collisions",
+		stat_total(table, STAT_COLLISIONS));
+	stats_report_counter(report, "probe_steps",
+		stat_total(table, STAT_PROBES));
+	stats_report_counter(report, "capacity_slots", table->capacity);
+	stats_report_counter(report, "evictions",
+		stat_total(table, STAT_EVICTIONS));
+	stats_report_counter(report, "expired", stat_total(table, STAT_EXPIRED));
+	stats_report_counter(report, "cpu_time_usec",
+		stat_total(table, STAT_TIME) * 1000000LL / CLOCKS_PER_SEC);
+	stats_report_phases(report, &table->stats.phases);
+	Histogram probes;
+	probe_lengths(table, &probes);
+	stats_report_histogram(report, "probe_lengths", &probes);
+}
@@ -6,7 +6,10 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "../inthash.h"
+#include "../trace.h"
+#include "../report.h"
 
 typedef struct linear_table LinearHashTable;
 
@@ -24,9 +27,52 @@ bool linear_hash_table_insert(LinearHashTable *table, int64 key);
 // returns true if found, false if not
 bool linear_hash_table_lookup(LinearHashTable *table, int64 key);
 
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', storing
+// the results in 'found'
+void linear_hash_table_lookup_batch(LinearHashTable *table, const int64 *keys,
+	int n, bool *found);
+
+// add 'delta' to the count of 'key' in 'table', inserting it with count
+// 'delta' if it's not in there already, all in a single probe ('delta' must
+// be at least 1)
+// returns the key's new count
+uint32_t linear_hash_table_increment(LinearHashTable *table, int64 key,
+	uint32_t delta);
+
+// return the count of 'key' in 'table', or 0 if it's not in there
+uint32_t linear_hash_table_count(LinearHashTable *table, int64 key);
+
+// find the (up to) 'k' keys in 'table' with the highest counts, storing them
+// in 'keys' and their counts in 'counts' in descending order of count
+// returns the number of keys found
+int linear_hash_table_top(LinearHashTable *table, int k, int64 *keys,
+	uint32_t *counts);
+
+// bound 'table' to at most 'capacity' slots: the table then grows (or, once
+// it can't double without exceeding this, evicts a key using CLOCK
+// (second-chance) replacement) whenever it is 3/4 full, not just when full
+void linear_hash_table_set_capacity(LinearHashTable *table, int capacity);
+
+// give keys inserted into 'table' from now on a time-to-live of 'ttl' ticks,
+// after which they are treated as absent and removed
+// (keys already in a table without a ttl get theirs from now)
+void linear_hash_table_set_ttl(LinearHashTable *table, int ttl);
+
+// advance the clock of 'table' to tick 'now', sweeping out any keys whose
+// ttl has passed along the way
+// ('now' must not be before the tick it was last advanced to)
+void linear_hash_table_advance(LinearHashTable *table, int now);
+
+// record structural events in 'table' (such as resizes) in 'trace' from now
+// on, or stop recording them if 'trace' is NULL
+void linear_hash_table_set_trace(LinearHashTable *table, TraceRing *trace);
+
 // print the contents of 'table' to stdout
 void linear_hash_table_print(LinearHashTable *table);
 
 // print some statistics about 'table' to stdout
 void linear_hash_table_stats(LinearHashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table'
+void linear_hash_table_report(LinearHashTable *table, StatsReport *report);
+
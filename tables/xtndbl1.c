@@ -12,6 +12,9 @@
 #include <time.h>
 
 #include "xtndbl1.h"
+#include "../phases.h"
+#include "../histogram.h"
+#include "../shards.h"
 
 // macro to calculate the rightmost n bits of a number x
 #define rightmostnbits(n, x) (x) & ((1 << (n)) - 1)
@@ -30,11 +33,18 @@ typedef struct bucket {
 // helper structure to store statistics gathered
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
-	int nkeys;		// how many keys are being stored in the table
-	int time;		// how much CPU time has been used to insert/lookup keys
-					// in this table
+	PhaseCosts phases;	// how many cycles each phase of an operation took
+	ShardedCounters counters;	// keys and time (see below)
 } Stats;
 
+// the statistics every operation updates, which each thread counts in its
+// own shard of the table's counters (see shards.h)
+enum stat_counter {
+	STAT_KEYS,	// how many keys are being stored in the table
+	STAT_TIME	// how much CPU time has been used to insert/lookup keys
+				// in this table
+};
+
 // a hash table is an array of slots pointing to buckets holding up to 1 key,
 // along with some usage statistics and information about the number of hash
 // value bits to use for addressing
@@ -42,9 +52,20 @@ struct xtndbl1_table {
 	Bucket **buckets;	// array of pointers to buckets
 	int size;			// how many entries in the table of pointers (2^depth)
 	int depth;			// how many bits of the hash value to use (log2(size))
+	TraceRing *trace;	// where to record resizes and splits, or NULL
 	Stats stats;		// collection of statistics about this hash table
 };
 
+// add 'delta' to statistic 'counter' of 'table', in the calling thread's shard
+static void count_stat(Xtndbl1HashTable *table, int counter, long long delta) {
+	sharded_counter_count(&table->stats.counters, counter, delta);
+}
+
+// the total of statistic 'counter' of 'table', across every thread's shard
+static long long stat_total(Xtndbl1HashTable *table, int counter) {
+	return sharded_counter_total(&table->stats.counters, counter);
+}
+
 /* * * *
  * helper functions
  */
@@ -67,6 +88,7 @@ static Bucket *new_bucket(int first_address, int depth) {
 static void double_table(Xtndbl1HashTable *table) {
 	int size = table->size * 2;
 	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+	long long start = trace_start(table->trace);
 
 	// get a new array of twice as many bucket pointers, and copy pointers down
 	table->buckets = realloc(table->buckets, (sizeof *table->buckets) * size);
@@ -77,6 +99,7 @@ static void double_table(Xtndbl1HashTable *table) {
 	}
 
 	// finally, increase the table size and the depth we are using to hash keys
+	trace_end(table->trace, EVENT_RESIZE, start, table->size, size);
 	table->size = size;
 	table->depth++;
 }
@@ -93,12 +116,15 @@ static void reinsert_key(Xtndbl1HashTable *table, int64 key) {
 
 // split the bucket in 'table' at address 'address', growing table if necessary
 static void split_bucket(Xtndbl1HashTable *table, int address) {
-	
+	long long start = trace_start(table->trace);
+
 	// FIRST,
 	// do we need to grow the table?
 	if (table->buckets[address]->depth == table->depth) {
 		// yep, this bucket is down to its last pointer
+		phase_enter(&table->stats.phases, PHASE_GROW);
 		double_table(table);
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
 	}
 	// either way, now it's time to split this bucket
 
@@ -114,7 +140,9 @@ static void split_bucket(Xtndbl1HashTable *table, int address) {
 
 	// new bucket's first address will be a 1 bit plus the old first address
 	int new_first_address = 1 << depth | first_address;
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
 	Bucket *newbucket = new_bucket(new_first_address, new_depth);
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
 	table->stats.nbuckets++;
 	
 	// THIRD,
@@ -149,6 +177,7 @@ static void split_bucket(Xtndbl1HashTable *table, int address) {
 	int64 key = bucket->key;
 	bucket->full = false;
 	reinsert_key(table, key);
+	trace_end(table->trace, EVENT_SPLIT, start, first_address, new_depth);
 }
 
 
@@ -166,10 +195,11 @@ Xtndbl1HashTable *new_xtndbl1_hash_table() {
 	assert(table->buckets);
 	table->buckets[0] = new_bucket(0, 0);
 	table->depth = 0;
+	table->trace = NULL;
 
 	table->stats.nbuckets = 1;
-	table->stats.nkeys = 0;
-	table->stats.time = 0;
+	sharded_counters_init(&table->stats.counters, TABLE_SHARDS);
+	phase_costs_init(&table->stats.phases);
 
 	return table;
 }
@@ -192,6 +222,8 @@ void free_xtndbl1_hash_table(Xtndbl1HashTable *table) {
 	// free the array of bucket pointers
 	free(table->buckets);
 	
+	sharded_counters_free(&table->stats.counters);
+	phase_costs_free(&table->stats.phases);
 	// free the table struct itself
 	free(table);
 }
@@ -204,18 +236,23 @@ bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key) {
 	int start_time = clock(); // start timing
 	
 	// calculate table address
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	int hash = h1(key);
 	int address = rightmostnbits(table->depth, hash);
 	
 	// is this key already there?
+	phase_enter(&table->stats.phases, PHASE_PROBE);
 	if (table->buckets[address]->full && table->buckets[address]->key == key) {
-		table->stats.time += clock() - start_time; // add time elapsed
+		phase_enter(&table->stats.phases, outer);
+		count_stat(table, STAT_TIME, clock() - start_time); // add time elapsed
 		return false;
 	}
 
 	// if not, make space in the table until our target bucket has space
 	while (table->buckets[address]->full) {
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
 		split_bucket(table, address);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
 
 		// and recalculate address because we might now need more bits
 		address = rightmostnbits(table->depth, hash);
@@ -224,10 +261,11 @@ bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key) {
 	// there's now space! we can insert this key
 	table->buckets[address]->key = key;
 	table->buckets[address]->full = true;
-	table->stats.nkeys++;
+	count_stat(table, STAT_KEYS, 1);
+	phase_enter(&table->stats.phases, outer);
 
 	// add time elapsed to total CPU time before returning
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return true;
 }
 
@@ -239,21 +277,31 @@ bool xtndbl1_hash_table_lookup(Xtndbl1HashTable *table, int64 key) {
 	int start_time = clock(); // start timing
 
 	// calculate table address for this key
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	int address = rightmostnbits(table->depth, h1(key));
 	
 	// look for the key in that bucket (unless it's empty)
+	phase_enter(&table->stats.phases, PHASE_PROBE);
 	bool found = false;
 	if (table->buckets[address]->full) {
 		// found it?
 		found = table->buckets[address]->key == key;
 	}
+	phase_enter(&table->stats.phases, outer);
 
 	// add time elapsed to total CPU time before returning result
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return found;
 }
 
 
+// record structural events in 'table' in 'trace' from now on, or stop
+// recording them if 'trace' is NULL
+void xtndbl1_hash_table_set_trace(Xtndbl1HashTable *table, TraceRing *trace) {
+	assert(table != NULL);
+	table->trace = trace;
+}
+
 // print the contents of 'table' to stdout
 void xtndbl1_hash_table_print(Xtndbl1HashTable *table) {
 	assert(table);
@@ -287,6 +335,30 @@ void xtndbl1_hash_table_print(Xtndbl1HashTable *table) {
 	return;
 }
 
+// histograms of the shape of a table: how many hash bits each bucket uses,
+// and how many directory entries point to it
+typedef struct shape {
+	Histogram depths, aliases;
+} Shape;
+
+// fill 'shape' with histograms of the shape of 'table'
+static void table_shape(Xtndbl1HashTable *table, Shape *shape) {
+	int nbins = table->depth + 1;
+	histogram_init(&shape->depths,
+		nbins < HISTOGRAM_BINS ? nbins : HISTOGRAM_BINS, false);
+	histogram_init(&shape->aliases, HISTOGRAM_BINS, true);
+
+	// visit each bucket once, at its first reference
+	int i;
+	for (i = 0; i < table->size; i++) {
+		Bucket *bucket = table->buckets[i];
+		if (bucket->id == i) {
+			histogram_add(&shape->depths, bucket->depth);
+			histogram_add(&shape->aliases, 1 << (table->depth - bucket->depth));
+		}
+	}
+}
+
 // print some statistics about 'table' to stdout
 void xtndbl1_hash_table_stats(Xtndbl1HashTable *table) {
 	assert(table);
@@ -295,12 +367,34 @@ void xtndbl1_hash_table_stats(Xtndbl1HashTable *table) {
 
 	// print some stats about state of the table
 	printf("current table size: %d\n", table->size);
-	printf("    number of keys: %d\n", table->stats.nkeys);
+	printf("    number of keys: %lld\n", stat_total(table, STAT_KEYS));
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
 
 	// also calculate CPU usage in seconds and print this
-	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	float seconds = stat_total(table, STAT_TIME) * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
 	
+	Shape shape;
+	table_shape(table, &shape);
+	histogram_print(&shape.depths, "local depths");
+	histogram_print(&shape.aliases, "directory aliases");
+	phase_costs_print(&table->stats.phases);
 	printf("--- end stats ---\n");
 }
+
+// fill 'report' with the statistics of 'table'
+void xtndbl1_hash_table_report(Xtndbl1HashTable *table, StatsReport *report) {
+	assert(table);
+	stats_report_init(report, "xtndbl1");
+	stats_report_counter(report, "size_entries", table->size);
+	stats_report_counter(report, "depth_bits", table->depth);
+	stats_report_counter(report, "load_keys", stat_total(table, STAT_KEYS));
+	stats_report_counter(report, "buckets", table->stats.nbuckets);
+	stats_report_counter(report, "cpu_time_usec",
+		stat_total(table, STAT_TIME) * 1000000LL / CLOCKS_PER_SEC);
+	stats_report_phases(report, &table->stats.phases);
+	Shape shape;
+	table_shape(table, &shape);
+	stats_report_histogram(report, "local_depths", &shape.depths);
+	stats_report_histogram(report, "directory_aliases", &shape.aliases);
+}
@@ -11,6 +11,8 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "../trace.h"
+#include "../report.h"
 
 typedef struct xtndbl1_table Xtndbl1HashTable;
 
@@ -28,10 +30,17 @@ bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key);
 // returns true if found, false if not
 bool xtndbl1_hash_table_lookup(Xtndbl1HashTable *table, int64 key);
 
+// record structural events in 'table' (such as resizes) in 'trace' from now
+// on, or stop recording them if 'trace' is NULL
+void xtndbl1_hash_table_set_trace(Xtndbl1HashTable *table, TraceRing *trace);
+
 // print the contents of 'table' to stdout
 void xtndbl1_hash_table_print(Xtndbl1HashTable *table);
 
 // print some statistics about 'table' to stdout
 void xtndbl1_hash_table_stats(Xtndbl1HashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table'
+void xtndbl1_hash_table_report(Xtndbl1HashTable *table, StatsReport *report);
+
 #endif
@@ -10,10 +10,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 
 #include "xtndbln.h"
+#include "../timewheel.h"
+#include "../counts.h"
+#include "../phases.h"
+#include "../histogram.h"
+#include "../shards.h"
+#include "../dirsort.h"
 
 /*
 
@@ -28,6 +35,8 @@
 */
 
 #define EMPTY 0
+// how many keys ahead merges and batch inserts prefetch
+#define PREFETCH_DISTANCE 8
 
 // macro to calculate the rightmost n bits of a number x
 #define rightmostnbits(n, x) (x) & ((1 << (n)) - 1)
@@ -41,14 +50,66 @@ typedef struct xtndbln_bucket {
 	int depth;		// how many hash value bits are being used by this bucket
 	int nkeys;		// number of keys currently contained in this bucket
 	int64 *keys;	// the keys stored in this bucket
+	bool *refbit;	// CLOCK reference bit for each key, set when it is hit
+	int *expiry;	// tick at which each key expires, in ttl mode
+	CountArray counts;	// how many times each key has been counted
+	int hand;		// which key the bucket's CLOCK hand is pointing at
 } Bucket;
 
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
-	int nkeys;		// how many keys are being stored in the table
-	int time;		// how much CPU time has been used to insert/lookup keys
-					// in this table
+	int merges;		// how many times the write buffer has been merged
+	PhaseCosts phases;	// how many cycles each phase of an operation took
+	ShardedCounters counters;	// keys, time and more (see below)
 } Stats;
+
+// the statistics every operation updates, which each thread counts in its
+// own shard of the table's counters (see shards.h)
+enum stat_counter {
+	STAT_KEYS,		// how many keys are being stored in the table
+	STAT_TIME,		// how much CPU time has been used to insert/lookup keys
+					// in this table
+	STAT_EVICTIONS,	// how many keys have been evicted to stay within capacity
+	STAT_EXPIRED,	// how many keys have been removed after their ttl passed
+	STAT_LOOKUPS,	// how many lookups there have been
+	STAT_COMPARES	// how many keys those lookups have compared against
+};
+
+// a write buffer holds newly inserted keys until it fills up, and then they
+// are merged into their buckets all at once. a small open addressing table
+// indexes the buffered keys, so that lookups can find them
+typedef struct write_buffer {
+	SortKey *keys;		// the buffered keys, in the order they were inserted
+	SortKey *scratch;	// working space for sorting them
+	int nkeys;			// how many keys are in the buffer
+	int size;			// how many keys the buffer holds, or 0 if it's off
+	int *index;			// 1 + the position in 'keys' of the key hashing to
+						// each slot (or nearby), or 0 if the slot is free
+	int mask;			// how many index slots there are, less 1
+} WriteBuffer;
+
+// one of the buckets a bucket is to be split into all at once: the keys at
+// 'start' onwards in the split's entries, whose hashes end in 'depth' bits 'id'
+typedef struct piece {
+	int id;
+	int depth;
+	int start;
+	int nkeys;
+} Piece;
+
+// the plan for splitting a bucket straight to the depths its keys call for,
+// kept with the table so that its space can be reused from split to split
+typedef struct split_plan {
+	SortKey *entries;	// the bucket's keys and its new keys, with hashes
+	SortKey *scratch;	// working space for partitioning the entries
+	int maxentries;		// how many entries there is space for
+	Piece *pieces;		// the buckets the entries are split into, in order
+	int npieces;
+	int maxpieces;		// how many pieces there is space for
+	int depth;			// the depth of the deepest piece
+	int bucketsize;
+} SplitPlan;
+
 // a hash table is an array of slots pointing to buckets holding up to 
 // bucketsize keys, along with some information about the number of hash value 
 // bits to use for addressing
@@ -57,9 +118,90 @@ struct xtndbln_table {
 	int size;			// how many entries in the table of pointers (2^depth)
 	int depth;			// how many bits of the hash value to use (log2(size))
 	int bucketsize;		// maximum number of keys per bucket
+	int capacity;		// maximum number of keys in bounded mode, or 0
+	int ttl;			// how many ticks keys live for in ttl mode, or 0
+	int now;			// the current tick, as last set by advance
+	Reorder reorder;	// how hit keys move forward in their bucket
+	TimerWheel *wheel;	// schedule of key expiries in ttl mode
+	TraceRing *trace;	// where to record resizes and splits, or NULL
+	WriteBuffer buffer;	// inserts that haven't been merged into buckets yet
+	SplitPlan split;	// working space for splitting buckets all at once
 	Stats stats;
 };
 
+// add 'delta' to statistic 'counter' of 'table', in the calling thread's shard
+static void count_stat(XtndblNHashTable *table, int counter, long long delta) {
+	sharded_counter_count(&table->stats.counters, counter, delta);
+}
+
+// the total of statistic 'counter' of 'table', across every thread's shard
+static long long stat_total(XtndblNHashTable *table, int counter) {
+	return sharded_counter_total(&table->stats.counters, counter);
+}
+
+// give 'bucket' new, empty arrays with space for 'bucketsize' keys
+static void alloc_entries(Bucket *bucket, int bucketsize) {
+	bucket->keys = malloc(sizeof(int64) * bucketsize);
+	assert(bucket->keys);
+	bucket->refbit = malloc(sizeof(bool) * bucketsize);
+	assert(bucket->refbit);
+	bucket->expiry = malloc(sizeof(int) * bucketsize);
+	assert(bucket->expiry);
+	count_array_init(&bucket->counts, bucketsize);
+	bucket->nkeys = 0;
+	bucket->hand = 0;
+}
+
+// free the arrays belonging to 'bucket'
+static void free_entries(Bucket *bucket) {
+	free(bucket->keys);
+	free(bucket->refbit);
+	free(bucket->expiry);
+	count_array_free(&bucket->counts);
+}
+
+// copy the key at index 'i' of bucket 'from', along with everything stored
+// alongside it, into index 'j' of bucket 'to'
+static void copy_entry(Bucket *to, int j, Bucket *from, int i) {
+	to->keys[j] = from->keys[i];
+	to->refbit[j] = from->refbit[i];
+	to->expiry[j] = from->expiry[i];
+	count_array_set(&to->counts, j, count_array_get(&from->counts, i));
+}
+
+// swap the keys at indices 'i' and 'j' of 'bucket', along with everything
+// stored alongside them
+static void swap_entries(Bucket *bucket, int i, int j) {
+	int64 key = bucket->keys[i];
+	bool refbit = bucket->refbit[i];
+	int expiry = bucket->expiry[i];
+	uint32_t count = count_array_get(&bucket->counts, i);
+	copy_entry(bucket, i, bucket, j);
+	bucket->keys[j] = key;
+	bucket->refbit[j] = refbit;
+	bucket->expiry[j] = expiry;
+	count_array_set(&bucket->counts, j, count);
+}
+
+// move the key at index 'i' of 'bucket', which has just been hit, forward as
+// far as the reorder policy of 'table' says
+static void promote_key(XtndblNHashTable *table, Bucket *bucket, int i) {
+	switch (table->reorder) {
+		case REORDER_TRANSPOSE:
+			if (i > 0) {
+				swap_entries(bucket, i, i - 1);
+			}
+			break;
+		case REORDER_FRONT:
+			for (; i > 0; i--) {
+				swap_entries(bucket, i, i - 1);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
 // create a new bucket first referenced from 'first_address', based on 'depth'
 // bits of its keys' hash values
 static Bucket *new_bucket(int first_address, int depth, int bucketsize) {
@@ -67,34 +209,36 @@ static Bucket *new_bucket(int first_address, int depth, int bucketsize) {
 	Bucket *bucket = malloc(sizeof *bucket);
 	assert(bucket);
 
-	// Create an array to hold keys
-	bucket->keys = malloc(sizeof(int64) * bucketsize);
-	assert(bucket->keys);
+	// Create arrays to hold keys
+	alloc_entries(bucket, bucketsize);
 
 	// Set bucket values to initial values
 	bucket->id = first_address;
 	bucket->depth = depth;
-	bucket->nkeys = 0;
 	return bucket;
 }
 
-// double the table of bucket pointers, duplicating the bucket pointers in the
-// first half into the new second half of the table
-static void double_table(XtndblNHashTable *table) {
-	int size = table->size * 2;
-	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+// grow the table of bucket pointers to use 'depth' bits of hash values,
+// duplicating the existing bucket pointers into each new part of the table
+static void grow_table(XtndblNHashTable *table, int depth) {
+	assert(depth < 31 && (1 << depth) < MAX_TABLE_SIZE
+		&& "error: table has grown too large!");
+	int size = 1 << depth;
+	long long start = trace_start(table->trace);
 
-	// get a new array of twice as many bucket pointers, and copy pointers down
+	// get a new array of bucket pointers, and copy pointers down into each
+	// new part in turn (each copied from the part just below it)
 	table->buckets = realloc(table->buckets, (sizeof *table->buckets) * size);
 	assert(table->buckets);
 	int i;
-	for (i = 0; i < table->size; i++) {
-		table->buckets[table->size + i] = table->buckets[i];
+	for (i = table->size; i < size; i++) {
+		table->buckets[i] = table->buckets[i - table->size];
 	}
 
 	// finally, increase the table size and the depth we are using to hash keys
+	trace_end(table->trace, EVENT_RESIZE, start, table->size, size);
 	table->size = size;
-	table->depth++;
+	table->depth = depth;
 }
 
 
@@ -102,19 +246,58 @@ static void double_table(XtndblNHashTable *table) {
 // that there will definitely be space for this key because it was already
 // inside the hash table previously
 // use 'xtndbln_hash_table_insert()' instead for inserting new keys
-static void reinsert_key(XtndblNHashTable *table, int64 key) {
-	int address = rightmostnbits(table->depth, h1(key));
-	table->buckets[address]->keys[table->buckets[address]->nkeys] = key;
-	table->buckets[address]->nkeys++;
+static void reinsert_key(XtndblNHashTable *table, Bucket *from, int i) {
+	int address = rightmostnbits(table->depth, h1(from->keys[i]));
+	Bucket *bucket = table->buckets[address];
+	copy_entry(bucket, bucket->nkeys, from, i);
+	bucket->nkeys++;
+}
+
+// remove the key at index 'i' of 'bucket' by moving the last key into its place
+static void remove_key(XtndblNHashTable *table, Bucket *bucket, int i) {
+	bucket->nkeys--;
+	copy_entry(bucket, i, bucket, bucket->nkeys);
+	count_stat(table, STAT_KEYS, -1);
+}
+
+// has the key at index 'i' of 'bucket' outlived its ttl?
+static bool is_expired(XtndblNHashTable *table, Bucket *bucket, int i) {
+	return table->ttl > 0 && bucket->expiry[i] - table->now <= 0;
+}
+
+// would splitting another bucket take 'table' past its capacity?
+static bool at_capacity(XtndblNHashTable *table) {
+	return table->capacity > 0
+		&& (table->stats.nbuckets + 1) * table->bucketsize > table->capacity;
+}
+
+// advance the CLOCK hand of a full 'bucket' until it finds a key whose
+// reference bit is clear, clearing reference bits as it passes (giving those
+// keys a second chance), then evict that key by moving the last key into
+// its place. the hand stays put, so the moved key is checked next
+static void evict_key(XtndblNHashTable *table, Bucket *bucket) {
+	while (bucket->refbit[bucket->hand]) {
+		bucket->refbit[bucket->hand] = false;
+		bucket->hand = (bucket->hand + 1) % bucket->nkeys;
+	}
+	int victim = bucket->hand;
+
+	remove_key(table, bucket, victim);
+	bucket->hand = victim < bucket->nkeys ? victim : 0;
+	count_stat(table, STAT_EVICTIONS, 1);
 }
 
 // split the bucket in 'table' at address 'address', growing table if necessary
 static void split_bucket(XtndblNHashTable *table, int address) {
+	long long start = trace_start(table->trace);
+
 	// FIRST,
 	// do we need to grow the table?
 	if (table->buckets[address]->depth == table->depth) {
 		// yep, this bucket is down to its last pointer
-		double_table(table);
+		phase_enter(&table->stats.phases, PHASE_GROW);
+		grow_table(table, table->depth + 1);
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
 	}
 	// either way, now it's time to split this bucket
 	
@@ -130,7 +313,9 @@ static void split_bucket(XtndblNHashTable *table, int address) {
 	// new bucket's first address will be a 1 bit plus the old first address
 	int new_first_address = 1 << depth | first_address;
 	//xtndbln_hash_table_print(table);
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
 	Bucket *newbucket = new_bucket(new_first_address, new_depth, table->bucketsize);
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
 	//xtndbln_hash_table_print(table);
 	table->stats.nbuckets++;
 	// THIRD,
@@ -160,23 +345,67 @@ static void split_bucket(XtndblNHashTable *table, int address) {
 	// filter the key from the old bucket into its rightful place in the new 
 	// table (which may be the old bucket, or may be the new bucket)
 
-	// remove and reinsert the key
-	// remove keys
-	int64 *keys = malloc(sizeof(int64) * table->bucketsize);
-	int count = bucket->nkeys;
-	int i;
-	for (i = count-1; i > -1; i--) {
-		keys[i] = bucket->keys[i];
-		bucket->nkeys--;
-	}
+	// remove keys, by taking the old bucket's arrays and giving it new ones
+	Bucket old = *bucket;
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
+	alloc_entries(bucket, table->bucketsize);
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
 	// reinsert keys
-	for (i = 0; i < count; i++) {
-		reinsert_key(table, keys[i]);
+	int i;
+	for (i = 0; i < old.nkeys; i++) {
+		reinsert_key(table, &old, i);
 	}
-	free(keys);
+	free_entries(&old);
+	trace_end(table->trace, EVENT_SPLIT, start, first_address, new_depth);
+}
+
+
+
+
+// a due timer tagged with the directory address of its key, for sorting
+typedef struct due_timer {
+	int address;
+	Timer timer;
+} DueTimer;
+
+// compare two due timers by directory address, for qsort
+static int compare_due(const void *a, const void *b) {
+	const DueTimer *x = a, *y = b;
+	return (x->address > y->address) - (x->address < y->address);
 }
 
+// remove a batch of keys whose timers have come due from the table (passed
+// as 'data'), visiting them in directory order so that keys sharing a bucket
+// are removed together
+static void expire_timers(void *data, Timer *timers, int ntimers) {
+	XtndblNHashTable *table = data;
 
+	DueTimer *due = malloc(sizeof(DueTimer) * ntimers);
+	assert(due);
+	int i, j;
+	for (i = 0; i < ntimers; i++) {
+		due[i].address = rightmostnbits(table->depth, h1(timers[i].key));
+		due[i].timer = timers[i];
+	}
+	qsort(due, ntimers, sizeof(DueTimer), compare_due);
+
+	for (i = 0; i < ntimers; i++) {
+		// the key may since have been removed, or removed and reinserted with
+		// a later expiry, in which case this timer is stale
+		Bucket *bucket = table->buckets[due[i].address];
+		for (j = 0; j < bucket->nkeys; j++) {
+			if (bucket->keys[j] == due[i].timer.key) {
+				if (bucket->expiry[j] == due[i].timer.deadline
+						&& is_expired(table, bucket, j)) {
+					remove_key(table, bucket, j);
+					count_stat(table, STAT_EXPIRED, 1);
+				}
+				break;
+			}
+		}
+	}
+	free(due);
+}
 
 
 // initialise an extendible hash table with 'bucketsize' keys per bucket
@@ -195,10 +424,29 @@ XtndblNHashTable *new_xtndbln_hash_table(int bucketsize) {
 	// make new bucket of bucketsize
 	table->buckets[0] = new_bucket(0, 0, bucketsize);
 	table->bucketsize = bucketsize;
+	table->capacity = 0;
+	table->ttl = 0;
+	table->now = 0;
+	table->reorder = REORDER_NONE;
+	table->wheel = NULL;
+	table->trace = NULL;
+	table->buffer.keys = NULL;
+	table->buffer.scratch = NULL;
+	table->buffer.nkeys = 0;
+	table->buffer.size = 0;
+	table->buffer.index = NULL;
+	table->buffer.mask = 0;
+	table->split.entries = NULL;
+	table->split.scratch = NULL;
+	table->split.maxentries = 0;
+	table->split.pieces = NULL;
+	table->split.maxpieces = 0;
+	table->split.bucketsize = bucketsize;
 
 	table->stats.nbuckets = 1;
-	table->stats.nkeys = 0;
-	table->stats.time = 0;
+	sharded_counters_init(&table->stats.counters, TABLE_SHARDS);
+	table->stats.merges = 0;
+	phase_costs_init(&table->stats.phases);
 	return table;
 }
 
@@ -212,41 +460,49 @@ void free_xtndbln_hash_table(XtndblNHashTable *table) {
 	int i;
 	for (i = table->size-1; i >= 0; i--) {
 		if (table->buckets[i]->id == i) {
-			free(table->buckets[i]->keys);
+			free_entries(table->buckets[i]);
 			free(table->buckets[i]);
 		}
 	}
 
 	// free the array of bucket pointers
 	free(table->buckets);
+
+	if (table->wheel) {
+		free_timer_wheel(table->wheel);
+	}
+	free(table->buffer.keys);
+	free(table->buffer.scratch);
+	free(table->buffer.index);
+	free(table->split.entries);
+	free(table->split.scratch);
+	free(table->split.pieces);
 	
+	sharded_counters_free(&table->stats.counters);
+	phase_costs_free(&table->stats.phases);
 	// free the table struct itself
 	free(table);
 }
 
 
 
-// insert 'key' into 'table', if it's not in there already
-// returns true if insertion succeeds, false if it was already in there
-bool xtndbln_hash_table_insert(XtndblNHashTable *table, int64 key) {
-	assert(table);
-	int start_time = clock(); // start timing
-	
-	// calculate table address
-	int hash = h1(key);
+// put 'key' (whose h1 hash is 'hash'), which isn't in 'table' yet, into its
+// bucket with count 'initial', first making space by splitting the bucket
+// (or, at capacity, evicting one of its keys)
+static void place_key(XtndblNHashTable *table, int64 key, int hash,
+		uint32_t initial) {
 	int address = rightmostnbits(table->depth, hash);
-	
-	// is this key already there?
-	int i;
-	for (i = 0; i < table->buckets[address]->nkeys; i++) {
-		if (table->buckets[address]->keys[i] == key) {
-			table->stats.time += clock() - start_time; // add time elapsed
-			return false;
-		}
-	} 
 
-	// if not, make space in the table until our target bucket has space
+	// make space in the table until our target bucket has space
 	while (table->buckets[address]->nkeys == table->bucketsize) {
+		if (at_capacity(table)) {
+			// we're not allowed any more buckets, so evict a key that
+			// hasn't been used recently from this one instead
+			phase_enter(&table->stats.phases, PHASE_EVICT);
+			evict_key(table, table->buckets[address]);
+			break;
+		}
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
 		split_bucket(table, address);
 
 		// and recalculate address because we might now need more bits
@@ -254,16 +510,492 @@ bool xtndbln_hash_table_insert(XtndblNHashTable *table, int64 key) {
 	}
 
 	// there's now space! we can insert this key
-	table->buckets[address]->keys[table->buckets[address]->nkeys] = key;
-	table->buckets[address]->nkeys++;
-	table->stats.nkeys++;
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	Bucket *bucket = table->buckets[address];
+	bucket->keys[bucket->nkeys] = key;
+	bucket->refbit[bucket->nkeys] = false;
+	count_array_set(&bucket->counts, bucket->nkeys, initial);
+	if (table->ttl > 0) {
+		// schedule this key's removal once its ttl has passed
+		bucket->expiry[bucket->nkeys] = table->now + table->ttl;
+		timer_wheel_add(table->wheel, key, bucket->expiry[bucket->nkeys]);
+	}
+	bucket->nkeys++;
+	count_stat(table, STAT_KEYS, 1);
+}
+
+
+// plan a piece for the 'n' entries at 'start' in 'plan', whose hashes end in
+// 'depth' bits 'id', splitting it further (by the next bit) while they
+// wouldn't fit into one bucket
+// the entries are partitioned stably, so each piece keeps its keys in order
+static void plan_split(SplitPlan *plan, int start, int n, int id, int depth) {
+	if (n <= plan->bucketsize) {
+		if (plan->npieces == plan->maxpieces) {
+			plan->maxpieces = plan->maxpieces * 2 + 4;
+			plan->pieces = realloc(plan->pieces,
+				sizeof(Piece) * plan->maxpieces);
+			assert(plan->pieces);
+		}
+		Piece *piece = &plan->pieces[plan->npieces++];
+		piece->id = id;
+		piece->depth = depth;
+		piece->start = start;
+		piece->nkeys = n;
+		if (depth > plan->depth) {
+			plan->depth = depth;
+		}
+		return;
+	}
+	assert(depth + 1 < 31 && (1 << (depth + 1)) < MAX_TABLE_SIZE
+		&& "error: table has grown too large!");
+
+	// move the entries with a 0 bit at 'depth' in front of those with a 1
+	SortKey *entries = plan->entries + start;
+	int i, n0 = 0, n1 = 0;
+	for (i = 0; i < n; i++) {
+		if (entries[i].hash >> depth & 1) {
+			plan->scratch[n1++] = entries[i];
+		} else {
+			entries[n0++] = entries[i];
+		}
+	}
+	memcpy(entries + n0, plan->scratch, sizeof(SortKey) * n1);
+
+	plan_split(plan, start, n0, id, depth + 1);
+	plan_split(plan, start + n0, n1, 1 << depth | id, depth + 1);
+}
+
+// put the 'n' keys in 'keys' (with their h1 hashes), which aren't in 'table'
+// yet and all belong in the same bucket, into that bucket with count
+// 'initial'. if they don't all fit, the bucket is split straight into as
+// many buckets as it takes to hold them and its own keys, which are
+// redistributed just once (rather than once for every level of splitting)
+// the buckets come out just as they would from splitting one level at a
+// time; if there isn't capacity for them all, the keys are placed one by one
+static void place_run(XtndblNHashTable *table, const SortKey *keys, int n,
+		uint32_t initial) {
+	Bucket *bucket = table->buckets[rightmostnbits(table->depth, keys[0].hash)];
+	int i, j;
+	if (bucket->nkeys + n <= table->bucketsize) {
+		for (i = 0; i < n; i++) {
+			place_key(table, keys[i].key, keys[i].hash, initial);
+		}
+		return;
+	}
+
+	// plan the split, on the bucket's keys followed by the new ones (an
+	// entry's index says which: the bucket's own keys come first)
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
+	long long start = trace_start(table->trace);
+	int nentries = bucket->nkeys + n;
+	SplitPlan *plan = &table->split;
+	if (nentries > plan->maxentries) {
+		plan->maxentries = nentries;
+		plan->entries = realloc(plan->entries, sizeof(SortKey) * nentries);
+		plan->scratch = realloc(plan->scratch, sizeof(SortKey) * nentries);
+		assert(plan->entries && plan->scratch);
+	}
+	plan->npieces = 0;
+	plan->depth = bucket->depth;
+	for (i = 0; i < bucket->nkeys; i++) {
+		plan->entries[i].hash = h1(bucket->keys[i]);
+		plan->entries[i].index = i;
+		plan->entries[i].key = bucket->keys[i];
+	}
+	for (j = 0; j < n; j++, i++) {
+		plan->entries[i] = keys[j];
+		plan->entries[i].index = i;
+	}
+	plan_split(plan, 0, nentries, bucket->id, bucket->depth);
+
+	if (table->capacity > 0 && (table->stats.nbuckets + plan->npieces - 1)
+			* table->bucketsize > table->capacity) {
+		// splitting all the way would take us past capacity, so go one key
+		// at a time, splitting until we can't and then evicting
+		for (i = 0; i < n; i++) {
+			place_key(table, keys[i].key, keys[i].hash, initial);
+		}
+		return;
+	}
+
+	// grow the table (just once) if the deepest piece needs more bits
+	if (plan->depth > table->depth) {
+		phase_enter(&table->stats.phases, PHASE_GROW);
+		grow_table(table, plan->depth);
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
+	}
+
+	// the first piece keeps the bucket (and its id), but takes new arrays
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
+	Bucket old = *bucket;
+	alloc_entries(bucket, table->bucketsize);
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
+	int p;
+	for (p = 0; p < plan->npieces; p++) {
+		Piece *piece = &plan->pieces[p];
+		Bucket *to = bucket;
+		if (p == 0) {
+			bucket->depth = piece->depth;
+		} else {
+			phase_enter(&table->stats.phases, PHASE_ALLOC);
+			to = new_bucket(piece->id, piece->depth, table->bucketsize);
+			phase_enter(&table->stats.phases, PHASE_SPLIT);
+			table->stats.nbuckets++;
+		}
+
+		// fill it with its keys, old and new
+		for (i = piece->start; i < piece->start + piece->nkeys; i++) {
+			int index = plan->entries[i].index;
+			if (index < old.nkeys) {
+				copy_entry(to, to->nkeys, &old, index);
+			} else {
+				int64 key = plan->entries[i].key;
+				to->keys[to->nkeys] = key;
+				to->refbit[to->nkeys] = false;
+				count_array_set(&to->counts, to->nkeys, initial);
+				if (table->ttl > 0) {
+					// schedule this key's removal once its ttl has passed
+					to->expiry[to->nkeys] = table->now + table->ttl;
+					timer_wheel_add(table->wheel, key, to->expiry[to->nkeys]);
+				}
+			}
+			to->nkeys++;
+		}
+
+		// and point every address ending in its id's bits at it, by joining
+		// all possible prefixes onto the id (the first piece's addresses
+		// already point at the bucket it keeps)
+		int maxprefix = p == 0 ? 0 : 1 << (table->depth - piece->depth);
+		int prefix;
+		for (prefix = 0; prefix < maxprefix; prefix++) {
+			table->buckets[(prefix << piece->depth) | piece->id] = to;
+		}
+	}
+	free_entries(&old);
+	count_stat(table, STAT_KEYS, n);
+	trace_end(table->trace, EVENT_SPLIT, start, old.id, plan->depth);
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+}
+
+
+// look for 'key' in 'bucket', removing it if it's there but has expired
+// returns its index in the bucket, or -1 if it's not there (any more)
+static int find_key(XtndblNHashTable *table, Bucket *bucket, int64 key) {
+	int i;
+	for (i = 0; i < bucket->nkeys; i++) {
+		if (bucket->keys[i] == key) {
+			if (is_expired(table, bucket, i)) {
+				// it's here but has expired, so remove it now
+				remove_key(table, bucket, i);
+				count_stat(table, STAT_EXPIRED, 1);
+				return -1;
+			}
+			return i;
+		}
+	}
+	return -1;
+}
+
+// insert 'key' (whose h1 hash is 'hash') into 'table' with count 'initial'
+// if it's not in there already, or add 'delta' to its count if it is,
+// storing its resulting count in *count
+// returns true if the key was inserted, false if it was already in there
+static bool insert_hashed(XtndblNHashTable *table, int64 key, int hash,
+		uint32_t initial, uint32_t delta, uint32_t *count) {
+	// is this key already there?
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	Bucket *bucket = table->buckets[rightmostnbits(table->depth, hash)];
+	int i = find_key(table, bucket, key);
+	if (i >= 0) {
+		bucket->refbit[i] = true;
+		*count = count_array_add(&bucket->counts, i, delta);
+		promote_key(table, bucket, i);
+		return false;
+	}
+
+	// if not, put it in its bucket
+	place_key(table, key, hash, initial);
+	*count = initial;
+	return true;
+}
+
+// insert 'key' into 'table' with count 'initial' if it's not in there already,
+// or add 'delta' to its count if it is, storing its resulting count in *count
+// returns true if the key was inserted, false if it was already in there
+static bool insert_key(XtndblNHashTable *table, int64 key, uint32_t initial,
+		uint32_t delta, uint32_t *count) {
+	assert(table);
+	int start_time = clock(); // start timing
+	
+	// calculate table address
+	phase_enter(&table->stats.phases, PHASE_HASH);
+	int hash = h1(key);
+
+	bool inserted = insert_hashed(table, key, hash, initial, delta, count);
 
 	// add time elapsed to total CPU time before returning
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return inserted;
+}
+
+// prefetch the bucket of the key a few places after index 'i' of the 'n'
+// sorted keys in 'keys', ready for when that key's turn comes
+// each bucket is reached through three dependent loads, so they are
+// prefetched in stages: the directory entry of the key furthest ahead, then
+// that key's bucket once it's nearer, and then the end of its keys
+static void prefetch_ahead(XtndblNHashTable *table, const SortKey *keys,
+		int i, int n) {
+	if (i + 3 * PREFETCH_DISTANCE < n) {
+		__builtin_prefetch(&table->buckets[rightmostnbits(table->depth,
+			keys[i + 3 * PREFETCH_DISTANCE].hash)]);
+	}
+	if (i + 2 * PREFETCH_DISTANCE < n) {
+		__builtin_prefetch(table->buckets[rightmostnbits(table->depth,
+			keys[i + 2 * PREFETCH_DISTANCE].hash)]);
+	}
+	if (i + PREFETCH_DISTANCE < n) {
+		Bucket *bucket = table->buckets[rightmostnbits(table->depth,
+			keys[i + PREFETCH_DISTANCE].hash)];
+		__builtin_prefetch(&bucket->keys[bucket->nkeys], 1);
+	}
+}
+
+
+/* * * *
+ * write buffer
+ */
+
+// is 'key' (whose h1 hash is 'hash') waiting in the write buffer of 'table'?
+static bool buffer_find(XtndblNHashTable *table, int64 key, int hash) {
+	WriteBuffer *buffer = &table->buffer;
+	int slot = hash & buffer->mask;
+	while (buffer->index[slot] != 0) {
+		if (buffer->keys[buffer->index[slot] - 1].key == key) {
+			return true;
+		}
+		slot = (slot + 1) & buffer->mask;
+	}
+	return false;
+}
+
+// merge the keys waiting in the write buffer of 'table' into their buckets,
+// sorted so that all of the keys bound for each bucket are placed together,
+// while the bucket is in cache, splitting it just once to whatever depth
+// they call for. keys that turn out to be in their bucket already are only
+// marked as hit
+static void merge_buffer(XtndblNHashTable *table) {
+	WriteBuffer *buffer = &table->buffer;
+	if (buffer->nkeys == 0) {
+		return;
+	}
+	int start_time = clock(); // start timing
+	long long start = trace_start(table->trace);
+	int nbuckets = table->stats.nbuckets;
+
+	Phase outer = phase_enter(&table->stats.phases, PHASE_PROBE);
+	int i;
+	for (i = 0; i < buffer->nkeys; i++) {
+		buffer->keys[i].order = dirsort_order(buffer->keys[i].hash);
+	}
+	dirsort(buffer->keys, buffer->scratch, buffer->nkeys, table->depth);
+	int end;
+	for (i = 0; i < buffer->nkeys; i = end) {
+		// drop the keys in the run bound for this key's bucket that are in it
+		// already, moving the rest up (the buffer holds no repeats)
+		Bucket *bucket = table->buckets[rightmostnbits(table->depth,
+			buffer->keys[i].hash)];
+		SortKey *fresh = buffer->keys + i;
+		int nfresh = 0;
+		for (end = i; end < buffer->nkeys && table->buckets[rightmostnbits(
+				table->depth, buffer->keys[end].hash)] == bucket; end++) {
+			prefetch_ahead(table, buffer->keys, end, buffer->nkeys);
+			int k = find_key(table, bucket, buffer->keys[end].key);
+			if (k >= 0) {
+				bucket->refbit[k] = true;
+				promote_key(table, bucket, k);
+			} else {
+				fresh[nfresh++] = buffer->keys[end];
+			}
+		}
+
+		// then place the rest all together
+		if (nfresh > 0) {
+			place_run(table, fresh, nfresh, 1);
+		}
+	}
+	phase_enter(&table->stats.phases, outer);
+
+	trace_end(table->trace, EVENT_MERGE, start, buffer->nkeys,
+		table->stats.nbuckets - nbuckets);
+	buffer->nkeys = 0;
+	memset(buffer->index, 0, sizeof(int) * (buffer->mask + 1));
+	table->stats.merges++;
+
+	// add time elapsed to total CPU time
+	count_stat(table, STAT_TIME, clock() - start_time);
+}
+
+// insert 'key' into 'table' through its write buffer: if it's not in the
+// buffer already, it waits there, without its bucket being visited, until
+// the buffer fills and is merged into the buckets (which is when a key that
+// was in its bucket all along is found out)
+// returns true if the key was newly buffered, false if it was already waiting
+static bool buffer_insert(XtndblNHashTable *table, int64 key) {
+	int start_time = clock(); // start timing
+
+	phase_enter(&table->stats.phases, PHASE_HASH);
+	int hash = h1(key);
+
+	// is this key already waiting?
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	if (buffer_find(table, key, hash)) {
+		count_stat(table, STAT_TIME, clock() - start_time); // add time elapsed
+		return false;
+	}
+
+	// if not, add it to the buffer
+	WriteBuffer *buffer = &table->buffer;
+	SortKey *pending = &buffer->keys[buffer->nkeys];
+	pending->hash = hash;
+	pending->key = key;
+	int slot = hash & buffer->mask;
+	while (buffer->index[slot] != 0) {
+		slot = (slot + 1) & buffer->mask;
+	}
+	buffer->index[slot] = ++buffer->nkeys;
+
+	// add time elapsed to total CPU time (merging counts its own)
+	count_stat(table, STAT_TIME, clock() - start_time);
+	if (buffer->nkeys == buffer->size) {
+		merge_buffer(table);
+	}
 	return true;
 }
 
 
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+// (with a write buffer: true if the key wasn't already waiting in it)
+bool xtndbln_hash_table_insert(XtndblNHashTable *table, int64 key) {
+	assert(table);
+	uint32_t count;
+	// (insert_key will enter each phase once it has started timing)
+	Phase outer = phase_enter(&table->stats.phases, PHASE_NONE);
+	bool inserted;
+	if (table->buffer.size > 0) {
+		inserted = buffer_insert(table, key);
+	} else {
+		inserted = insert_key(table, key, 1, 0, &count);
+	}
+	phase_enter(&table->stats.phases, outer);
+	return inserted;
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', recording whether each
+// one was newly inserted in 'inserted' (unless 'inserted' is NULL)
+// the keys are all hashed first, and then radix sorted into directory order
+// so that the keys bound for each bucket are placed together, while the
+// bucket is in cache, splitting it just once to whatever depth they call for
+// returns the number of keys newly inserted
+int xtndbln_hash_table_insert_batch(XtndblNHashTable *table,
+		const int64 *keys, int n, bool *inserted) {
+	assert(table);
+	assert(n >= 0);
+	// (the batch is sorted as a merge is, so merge any buffered keys first)
+	Phase outer = phase_enter(&table->stats.phases, PHASE_NONE);
+	merge_buffer(table);
+	if (n == 0) {
+		phase_enter(&table->stats.phases, outer);
+		return 0;
+	}
+	int start_time = clock(); // start timing
+
+	phase_enter(&table->stats.phases, PHASE_HASH);
+	SortKey *sorted = malloc(sizeof(SortKey) * n);
+	SortKey *scratch = malloc(sizeof(SortKey) * n);
+	int *hashes = malloc(sizeof(int) * n);
+	assert(sorted && scratch && hashes);
+	hash_batch(HASH_H1, keys, n, hashes);
+	int i;
+	for (i = 0; i < n; i++) {
+		sorted[i].order = dirsort_order(hashes[i]);
+		sorted[i].hash = hashes[i];
+		sorted[i].index = i;
+		sorted[i].key = keys[i];
+	}
+	// (sorting on every bit puts any repeats of a key, which share its hash,
+	// next to one another)
+	dirsort(sorted, scratch, n, 31);
+
+	int ninserted = 0;
+	int end, j;
+	for (i = 0; i < n; i = end) {
+		// gather the keys in the run bound for this key's bucket that aren't
+		// in it already, or earlier in the run, into 'scratch'
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		Bucket *bucket = table->buckets[rightmostnbits(table->depth,
+			sorted[i].hash)];
+		int nfresh = 0;
+		for (end = i; end < n && table->buckets[rightmostnbits(table->depth,
+				sorted[end].hash)] == bucket; end++) {
+			prefetch_ahead(table, sorted, end, n);
+			bool new = true;
+			int k = find_key(table, bucket, sorted[end].key);
+			if (k >= 0) {
+				bucket->refbit[k] = true;
+				promote_key(table, bucket, k);
+				new = false;
+			}
+			for (j = nfresh - 1; new && j >= 0
+					&& scratch[j].hash == sorted[end].hash; j--) {
+				new = scratch[j].key != sorted[end].key;
+			}
+			if (new) {
+				scratch[nfresh++] = sorted[end];
+			}
+			if (inserted) {
+				inserted[sorted[end].index] = new;
+			}
+		}
+
+		// then place them all at once
+		if (nfresh > 0) {
+			place_run(table, scratch, nfresh, 1);
+		}
+		ninserted += nfresh;
+	}
+	free(sorted);
+	free(scratch);
+	free(hashes);
+	phase_enter(&table->stats.phases, outer);
+
+	// add time elapsed to total CPU time before returning
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return ninserted;
+}
+
+
+// add 'delta' to the count of 'key' in 'table', inserting it with count
+// 'delta' if it's not in there already, all in a single bucket scan
+// ('delta' must be at least 1)
+// returns the key's new count
+uint32_t xtndbln_hash_table_increment(XtndblNHashTable *table, int64 key,
+		uint32_t delta) {
+	assert(table);
+	assert(delta > 0);
+	uint32_t count;
+	// (insert_key will enter each phase once it has started timing)
+	Phase outer = phase_enter(&table->stats.phases, PHASE_NONE);
+	// (a buffered key could be anywhere, so settle them all first)
+	merge_buffer(table);
+	insert_key(table, key, delta, delta, &count);
+	phase_enter(&table->stats.phases, outer);
+	return count;
+}
+
+
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool xtndbln_hash_table_lookup(XtndblNHashTable *table, int64 key) {
@@ -271,24 +1003,198 @@ bool xtndbln_hash_table_lookup(XtndblNHashTable *table, int64 key) {
 	int start_time = clock(); // start timing
 
 	// calculate table address for this key
-	int address = rightmostnbits(table->depth, h1(key));
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+	int hash = h1(key);
+	int address = rightmostnbits(table->depth, hash);
 	
-	// look for the key in that bucket (unless it's empty)
-	bool found = false;
-	int i;
-	for (i = 0; i < table->buckets[address]->nkeys; i++) {
-		if (table->buckets[address]->keys[i] == key) {
+	// look for the key in the write buffer, and then in its bucket (unless
+	// it's empty)
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	Bucket *bucket = table->buckets[address];
+	bool found = table->buffer.nkeys > 0 && buffer_find(table, key, hash);
+	int i, compares = 0;
+	for (i = 0; i < bucket->nkeys && !found; i++) {
+		compares++;
+		if (bucket->keys[i] == key) {
+			if (is_expired(table, bucket, i)) {
+				// it's here but has expired, so remove it now
+				remove_key(table, bucket, i);
+				count_stat(table, STAT_EXPIRED, 1);
+				break;
+			}
 			// found it!
+			bucket->refbit[i] = true;
 			found = true;
+			promote_key(table, bucket, i);
+			break;
 		}
 	}
+	count_stat(table, STAT_LOOKUPS, 1);
+	count_stat(table, STAT_COMPARES, compares);
+	phase_enter(&table->stats.phases, outer);
 
 	// add time elapsed to total CPU time before returning result
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return found;
 }
 
 
+// return the count of 'key' in 'table', or 0 if it's not in there
+uint32_t xtndbln_hash_table_count(XtndblNHashTable *table, int64 key) {
+	assert(table);
+	int hash = h1(key);
+	// (a buffered key may be in its bucket too, and counted there)
+	Bucket *bucket = table->buckets[rightmostnbits(table->depth, hash)];
+	int i;
+	for (i = 0; i < bucket->nkeys; i++) {
+		if (bucket->keys[i] == key && !is_expired(table, bucket, i)) {
+			return count_array_get(&bucket->counts, i);
+		}
+	}
+	if (table->buffer.nkeys > 0 && buffer_find(table, key, hash)) {
+		// buffered keys were inserted, not counted
+		return 1;
+	}
+	return 0;
+}
+
+
+// find the (up to) 'k' keys in 'table' with the highest counts, storing them
+// in 'keys' and their counts in 'counts' in descending order of count
+// returns the number of keys found
+int xtndbln_hash_table_top(XtndblNHashTable *table, int k, int64 *keys,
+		uint32_t *counts) {
+	assert(table);
+	merge_buffer(table);
+	TopCounts top;
+	top_counts_init(&top, keys, counts, k);
+
+	// visit each bucket once, at its first reference
+	int i, j;
+	for (i = 0; i < table->size; i++) {
+		Bucket *bucket = table->buckets[i];
+		if (bucket->id != i) {
+			continue;
+		}
+		for (j = 0; j < bucket->nkeys; j++) {
+			if (!is_expired(table, bucket, j)) {
+				top_counts_offer(&top, bucket->keys[j],
+					count_array_get(&bucket->counts, j));
+			}
+		}
+	}
+	return top_counts_finish(&top);
+}
+
+
+// bound 'table' to at most 'capacity' keys: once another bucket split would
+// exceed this, inserting into a full bucket evicts one of its keys using
+// CLOCK (second-chance) replacement instead of splitting
+void xtndbln_hash_table_set_capacity(XtndblNHashTable *table, int capacity) {
+	assert(table);
+	assert(capacity >= table->bucketsize);
+	merge_buffer(table);
+	table->capacity = capacity;
+}
+
+// the smallest capacity 'table' can be bounded to: a single full bucket
+int xtndbln_hash_table_min_capacity(XtndblNHashTable *table) {
+	assert(table);
+	return table->bucketsize;
+}
+
+
+// move keys in 'table' forward in their bucket whenever they are hit (or
+// counted), as 'policy' says, so that hot keys are found sooner
+void xtndbln_hash_table_set_reorder(XtndblNHashTable *table, Reorder policy) {
+	assert(table);
+	table->reorder = policy;
+}
+
+
+// hold up to 'nkeys' newly inserted keys in a write buffer, merging them into
+// their buckets (sorted so that each bucket is visited once) when it fills,
+// or insert keys straight into their buckets if 'nkeys' is 0
+void xtndbln_hash_table_set_buffer(XtndblNHashTable *table, int nkeys) {
+	assert(table);
+	assert(nkeys >= 0);
+	merge_buffer(table);
+	free(table->buffer.keys);
+	free(table->buffer.scratch);
+	free(table->buffer.index);
+	table->buffer.keys = NULL;
+	table->buffer.scratch = NULL;
+	table->buffer.index = NULL;
+	table->buffer.size = nkeys;
+	table->buffer.mask = 0;
+	if (nkeys > 0) {
+		table->buffer.keys = malloc(sizeof(SortKey) * nkeys);
+		assert(table->buffer.keys);
+		table->buffer.scratch = malloc(sizeof(SortKey) * nkeys);
+		assert(table->buffer.scratch);
+		// keep the index at most half full, so probes stay short
+		int nslots = 1;
+		while (nslots < 2 * nkeys) {
+			nslots *= 2;
+		}
+		table->buffer.index = calloc(nslots, sizeof(int));
+		assert(table->buffer.index);
+		table->buffer.mask = nslots - 1;
+	}
+}
+
+
+// give keys inserted into 'table' from now on a time-to-live of 'ttl' ticks,
+// after which they are treated as absent and removed
+// (keys already in a table without a ttl get theirs from now)
+void xtndbln_hash_table_set_ttl(XtndblNHashTable *table, int ttl) {
+	assert(table);
+	assert(ttl > 0);
+	merge_buffer(table);
+	if (table->wheel == NULL) {
+		table->wheel = new_timer_wheel(table->now);
+	}
+	if (table->ttl == 0) {
+		// the keys already here were inserted without an expiry, so give
+		// them one, and schedule their removal
+		// (visiting each bucket only at its first reference)
+		int i, j;
+		for (i = 0; i < table->size; i++) {
+			Bucket *bucket = table->buckets[i];
+			if (bucket->id != i) {
+				continue;
+			}
+			for (j = 0; j < bucket->nkeys; j++) {
+				bucket->expiry[j] = table->now + ttl;
+				timer_wheel_add(table->wheel, bucket->keys[j], bucket->expiry[j]);
+			}
+		}
+	}
+	table->ttl = ttl;
+}
+
+
+// advance the clock of 'table' to tick 'now', sweeping out any keys whose
+// ttl has passed along the way
+void xtndbln_hash_table_advance(XtndblNHashTable *table, int now) {
+	assert(table);
+	assert(now >= table->now && "error: clock can't go backwards");
+	// (buffered keys expire from when they are merged, so merge them now)
+	merge_buffer(table);
+	table->now = now;
+	if (table->wheel) {
+		timer_wheel_advance(table->wheel, now, expire_timers, table);
+	}
+}
+
+
+// record structural events in 'table' in 'trace' from now on, or stop
+// recording them if 'trace' is NULL
+void xtndbln_hash_table_set_trace(XtndblNHashTable *table, TraceRing *trace) {
+	assert(table != NULL);
+	table->trace = trace;
+}
+
 // print the contents of 'table' to stdout
 void xtndbln_hash_table_print(XtndblNHashTable *table) {
 	assert(table);
@@ -323,10 +1229,48 @@ void xtndbln_hash_table_print(XtndblNHashTable *table) {
 		printf("\n");
 	}
 
+	// and any keys still waiting to be merged into their buckets (printing
+	// mustn't merge them, or it would change the table)
+	if (table->buffer.nkeys > 0) {
+		printf("  buffered: [");
+		for (i = 0; i < table->buffer.nkeys; i++) {
+			printf(" %llu", table->buffer.keys[i].key);
+		}
+		printf(" ]\n");
+	}
+
 	printf("--- end table ---\n");
 }
 
 
+// histograms of the shape of a table: how full its buckets are, how many
+// hash bits each one uses, and how many directory entries point to it
+typedef struct shape {
+	Histogram occupancy, depths, aliases;
+} Shape;
+
+// fill 'shape' with histograms of the shape of 'table'
+static void table_shape(XtndblNHashTable *table, Shape *shape) {
+	int nbins = table->bucketsize + 1;
+	histogram_init(&shape->occupancy,
+		nbins < HISTOGRAM_BINS ? nbins : HISTOGRAM_BINS, false);
+	nbins = table->depth + 1;
+	histogram_init(&shape->depths,
+		nbins < HISTOGRAM_BINS ? nbins : HISTOGRAM_BINS, false);
+	histogram_init(&shape->aliases, HISTOGRAM_BINS, true);
+
+	// visit each bucket once, at its first reference
+	int i;
+	for (i = 0; i < table->size; i++) {
+		Bucket *bucket = table->buckets[i];
+		if (bucket->id == i) {
+			histogram_add(&shape->occupancy, bucket->nkeys);
+			histogram_add(&shape->depths, bucket->depth);
+			histogram_add(&shape->aliases, 1 << (table->depth - bucket->depth));
+		}
+	}
+}
+
 // print some statistics about 'table' to stdout
 void xtndbln_hash_table_stats(XtndblNHashTable *table) {
 	assert(table);
@@ -335,12 +1279,68 @@ void xtndbln_hash_table_stats(XtndblNHashTable *table) {
 
 	// print some stats about state of the table
 	printf("current table size: %d\n", table->size);
-	printf("    number of keys: %d\n", table->stats.nkeys);
+	printf("    number of keys: %lld\n", stat_total(table, STAT_KEYS));
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
+	if (table->capacity > 0) {
+		printf("          capacity: %d keys\n", table->capacity);
+		printf("         evictions: %lld\n",
+			stat_total(table, STAT_EVICTIONS));
+	}
+	if (table->ttl > 0) {
+		printf("               ttl: %d ticks\n", table->ttl);
+		printf("           expired: %lld\n", stat_total(table, STAT_EXPIRED));
+	}
+
+	if (table->buffer.size > 0) {
+		printf("      write buffer: %d keys\n", table->buffer.size);
+		printf("     buffered keys: %d\n", table->buffer.nkeys);
+		printf("     buffer merges: %d\n", table->stats.merges);
+	}
+
+	long long lookups = stat_total(table, STAT_LOOKUPS);
+	if (lookups > 0) {
+		printf("   keys per lookup: %.3f\n",
+			(double)stat_total(table, STAT_COMPARES) / lookups);
+	}
 
 	// also calculate CPU usage in seconds and print this
-	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	float seconds = stat_total(table, STAT_TIME) * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
 	
+	Shape shape;
+	table_shape(table, &shape);
+	histogram_print(&shape.occupancy, "bucket occupancy");
+	histogram_print(&shape.depths, "local depths");
+	histogram_print(&shape.aliases, "directory aliases");
+	phase_costs_print(&table->stats.phases);
 	printf("--- end stats ---\n");
 }
+
+// fill 'report' with the statistics of 'table'
+void xtndbln_hash_table_report(XtndblNHashTable *table, StatsReport *report) {
+	assert(table);
+	stats_report_init(report, "xtndbln");
+	stats_report_counter(report, "size_entries", table->size);
+	stats_report_counter(report, "depth_bits", table->depth);
+	stats_report_counter(report, "bucket_size_keys", table->bucketsize);
+	stats_report_counter(report, "load_keys", stat_total(table, STAT_KEYS));
+	stats_report_counter(report, "buckets", table->stats.nbuckets);
+	stats_report_counter(report, "capacity_keys", table->capacity);
+	stats_report_counter(report, "evictions",
+		stat_total(table, STAT_EVICTIONS));
+	stats_report_counter(report, "expired", stat_total(table, STAT_EXPIRED));
+	stats_report_counter(report, "buffer_keys", table->buffer.size);
+	stats_report_counter(report, "buffered_keys", table->buffer.nkeys);
+	stats_report_counter(report, "buffer_merges", table->stats.merges);
+	stats_report_counter(report, "lookups", stat_total(table, STAT_LOOKUPS));
+	stats_report_counter(report, "lookup_compares",
+		stat_total(table, STAT_COMPARES));
+	stats_report_counter(report, "cpu_time_usec",
+		stat_total(table, STAT_TIME) * 1000000LL / CLOCKS_PER_SEC);
+	stats_report_phases(report, &table->stats.phases);
+	Shape shape;
+	table_shape(table, &shape);
+	stats_report_histogram(report, "bucket_occupancy", &shape.occupancy);
+	stats_report_histogram(report, "local_depths", &shape.depths);
+	stats_report_histogram(report, "directory_aliases", &shape.aliases);
+}
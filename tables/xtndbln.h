@@ -10,7 +10,11 @@
 #define XTNDBLN_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "../inthash.h"
+#include "../trace.h"
+#include "../report.h"
+#include "../reorder.h"
 
 typedef struct xtndbln_table XtndblNHashTable;
 
@@ -22,16 +26,81 @@ void free_xtndbln_hash_table(XtndblNHashTable *table);
 
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
+// (with a write buffer, false only if it was already waiting in the buffer)
 bool xtndbln_hash_table_insert(XtndblNHashTable *table, int64 key);
 
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool xtndbln_hash_table_lookup(XtndblNHashTable *table, int64 key);
 
+// insert each of the 'n' keys in 'keys' into 'table', recording whether each
+// one was newly inserted in 'inserted' (unless 'inserted' is NULL)
+// the keys are all hashed first, and then radix sorted into directory order
+// so that the keys bound for each bucket (and the splits they call for) are
+// dealt with together, while the bucket is in cache
+// returns the number of keys newly inserted
+int xtndbln_hash_table_insert_batch(XtndblNHashTable *table,
+	const int64 *keys, int n, bool *inserted);
+
+// add 'delta' to the count of 'key' in 'table', inserting it with count
+// 'delta' if it's not in there already, all in a single bucket scan
+// ('delta' must be at least 1)
+// returns the key's new count
+uint32_t xtndbln_hash_table_increment(XtndblNHashTable *table, int64 key,
+	uint32_t delta);
+
+// return the count of 'key' in 'table', or 0 if it's not in there
+uint32_t xtndbln_hash_table_count(XtndblNHashTable *table, int64 key);
+
+// find the (up to) 'k' keys in 'table' with the highest counts, storing them
+// in 'keys' and their counts in 'counts' in descending order of count
+// returns the number of keys found
+int xtndbln_hash_table_top(XtndblNHashTable *table, int k, int64 *keys,
+	uint32_t *counts);
+
+// bound 'table' to at most 'capacity' keys: once another bucket split would
+// exceed this, inserting into a full bucket evicts one of its keys using
+// CLOCK (second-chance) replacement instead of splitting
+void xtndbln_hash_table_set_capacity(XtndblNHashTable *table, int capacity);
+
+// the smallest capacity 'table' can be bounded to: a single full bucket
+int xtndbln_hash_table_min_capacity(XtndblNHashTable *table);
+
+// move keys in 'table' forward in their bucket whenever they are hit (or
+// counted), as 'policy' says, so that hot keys are found sooner
+void xtndbln_hash_table_set_reorder(XtndblNHashTable *table, Reorder policy);
+
+// hold up to 'nkeys' newly inserted keys in a write buffer, merging them into
+// their buckets (sorted so that each bucket is visited once) when it fills,
+// or insert keys straight into their buckets if 'nkeys' is 0
+// buffered keys are visible to lookups, and operations other than inserts
+// and lookups merge the buffer first
+// an insert only checks the buffer, leaving the key's bucket to be checked
+// when it is merged, so it returns true if the key wasn't already waiting in
+// the buffer, even if it was in its bucket all along
+void xtndbln_hash_table_set_buffer(XtndblNHashTable *table, int nkeys);
+
+// give keys inserted into 'table' from now on a time-to-live of 'ttl' ticks,
+// after which they are treated as absent and removed
+// (keys already in a table without a ttl get theirs from now)
+void xtndbln_hash_table_set_ttl(XtndblNHashTable *table, int ttl);
+
+// advance the clock of 'table' to tick 'now', sweeping out any keys whose
+// ttl has passed along the way
+// ('now' must not be before the tick it was last advanced to)
+void xtndbln_hash_table_advance(XtndblNHashTable *table, int now);
+
+// record structural events in 'table' (such as resizes) in 'trace' from now
+// on, or stop recording them if 'trace' is NULL
+void xtndbln_hash_table_set_trace(XtndblNHashTable *table, TraceRing *trace);
+
 // print the contents of 'table' to stdout
 void xtndbln_hash_table_print(XtndblNHashTable *table);
 
 // print some statistics about 'table' to stdout
 void xtndbln_hash_table_stats(XtndblNHashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table'
+void xtndbln_hash_table_report(XtndblNHashTable *table, StatsReport *report);
+
 #endif
\ No newline at end of file
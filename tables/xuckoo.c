@@ -14,6 +14,9 @@
 #include <assert.h>
 #include <time.h>
 #include "xuckoo.h"
+#include "../phases.h"
+#include "../histogram.h"
+#include "../shards.h"
 /*
 // Use colours for debugging
 #include <windows.h>
@@ -42,11 +45,19 @@ typedef struct bucket {
 
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
-	int nkeys;		// how many keys are being stored in the table
-	int time;		// how much CPU time has been used to insert/lookup keys
-					// in this table
+	PhaseCosts phases;	// how many cycles each phase of an operation took
+	Histogram chains;	// how many keys each insertion displaced
+	ShardedCounters counters;	// keys and time (see below)
 } Stats;
 
+// the statistics every operation updates, which each thread counts in its
+// own shard of the table's counters (see shards.h)
+enum stat_counter {
+	STAT_KEYS,	// how many keys are being stored in the table
+	STAT_TIME	// how much CPU time has been used to insert/lookup keys
+				// in this table
+};
+
 // an inner table is an extendible hash table with an array of slots pointing 
 // to buckets holding up to 1 key, along with some information about the number 
 // of hash value bits to use for addressing
@@ -61,9 +72,21 @@ typedef struct inner_table {
 struct xuckoo_table {
 	InnerTable *table1;
 	InnerTable *table2;
+	TraceRing *trace;	// where to record resizes, splits and cycles, or NULL
+	Reorder reorder;	// whether hit keys move to their first table
 	Stats stats;
 };
 
+// add 'delta' to statistic 'counter' of 'table', in the calling thread's shard
+static void count_stat(XuckooHashTable *table, int counter, long long delta) {
+	sharded_counter_count(&table->stats.counters, counter, delta);
+}
+
+// the total of statistic 'counter' of 'table', across every thread's shard
+static long long stat_total(XuckooHashTable *table, int counter) {
+	return sharded_counter_total(&table->stats.counters, counter);
+}
+
 
 bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos, 
 						int64 orig_key, int loop, int orig_table);
@@ -137,6 +160,8 @@ static void reinsert_key(InnerTable *table, int64 key, int table_no) {
 
 // split the bucket in 'table' at address 'address', growing table if necessary
 static void split_bucket(XuckooHashTable *table, int address, int table_no) {
+	long long start = trace_start(table->trace);
+
 	// set the inner table depending on the table_no for later code
 	InnerTable *inner_table;
 	if (table_no == 1) {
@@ -150,7 +175,12 @@ static void split_bucket(XuckooHashTable *table, int address, int table_no) {
 	// do we need to grow the table?
 	if (inner_table->buckets[address]->depth == inner_table->depth) {
 		// yep, this bucket is down to its last pointer
+		long long resize_start = trace_start(table->trace);
+		phase_enter(&table->stats.phases, PHASE_GROW);
 		double_table(inner_table);
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
+		trace_end(table->trace, EVENT_RESIZE, resize_start,
+			inner_table->size / 2, inner_table->size);
 	}
 	// either way, now it's time to split this bucket
 
@@ -165,7 +195,9 @@ static void split_bucket(XuckooHashTable *table, int address, int table_no) {
 
 	// new bucket's first address will be a 1 bit plus the old first address
 	int new_first_address = 1 << depth | first_address;
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
 	Bucket *newbucket = new_bucket(new_first_address, new_depth);
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
 	
 	// THIRD,
 	// redirect every second address pointing to this bucket to the new bucket
@@ -200,6 +232,7 @@ static void split_bucket(XuckooHashTable *table, int address, int table_no) {
 	bucket->full = false;
 	reinsert_key(inner_table, key, table_no);
 	table->stats.nbuckets++;
+	trace_end(table->trace, EVENT_SPLIT, start, first_address, new_depth);
 }
 
 // initialise an extendible cuckoo hash table
@@ -214,8 +247,11 @@ XuckooHashTable *new_xuckoo_hash_table() {
 	// Then create a cuckoo table and link these to the inner tables
 	//printf("Successfully made cuckoo table!\n");
 	// set 
-	cuckoo->stats.time = 0;
-	cuckoo->stats.nkeys = 0;
+	cuckoo->trace = NULL;
+	cuckoo->reorder = REORDER_NONE;
+	sharded_counters_init(&cuckoo->stats.counters, TABLE_SHARDS);
+	phase_costs_init(&cuckoo->stats.phases);
+	histogram_init(&cuckoo->stats.chains, 16, true);
 	cuckoo->stats.nbuckets = 0;
 	return cuckoo;
 }
@@ -246,6 +282,8 @@ void free_xuckoo_hash_table(XuckooHashTable *table) {
 	free(table->table1);
 	free(table->table2);
 	
+	sharded_counters_free(&table->stats.counters);
+	phase_costs_free(&table->stats.phases);
 	// free the table struct itself
 	free(table);	
 }
@@ -260,6 +298,7 @@ bool xuckoo_hash_table_insert(XuckooHashTable *table, int64 key) {
 	if (xuckoo_hash_table_lookup(table, key) == true) {
 		return false;
 	}
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	// Initialise variables
 	int hash;
 	int address;
@@ -268,15 +307,18 @@ bool xuckoo_hash_table_insert(XuckooHashTable *table, int64 key) {
 	if (table->table1->nkeys <= table->table2->nkeys) {
 		hash = h1(key);
 		address = rightmostnbits(table->table1->depth, hash);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
 		try_xuck_insert(table, key, address, key, 0, 1);
 	}
 	else {
 		hash = h2(key);
 		address = rightmostnbits(table->table2->depth, hash);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
 		try_xuck_insert(table, key, address, key, 1, 2);
 	}
+	phase_enter(&table->stats.phases, outer);
 	// add time elapsed to total CPU time before returning
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return true;
 }
 
@@ -288,9 +330,11 @@ bool xuckoo_hash_table_lookup(XuckooHashTable *table, int64 key) {
 	int start_time = clock(); // start timing
 
 	// calculate table address for this key
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	int address = rightmostnbits(table->table1->depth, h1(key));
 	int address2 = rightmostnbits(table->table2->depth, h2(key));
 	// look for the key in that bucket (unless it's empty)
+	phase_enter(&table->stats.phases, PHASE_PROBE);
 	bool found = false;
 	if (table->table1->buckets[address]->full) {
 		// found it?
@@ -299,14 +343,69 @@ bool xuckoo_hash_table_lookup(XuckooHashTable *table, int64 key) {
 	if (table->table2->buckets[address2]->full && found == false) {
 		// found it?
 		found = table->table2->buckets[address2]->key == key;
+		// if so, move it to its first table if there's room there, where
+		// the next lookup will find it sooner
+		if (found && table->reorder != REORDER_NONE
+				&& !table->table1->buckets[address]->full) {
+			table->table1->buckets[address]->key = key;
+			table->table1->buckets[address]->full = true;
+			table->table2->buckets[address2]->full = false;
+			// (inserts choose a table by these counts, so keep them right)
+			table->table1->nkeys++;
+			table->table2->nkeys--;
+		}
 	}
+	phase_enter(&table->stats.phases, outer);
+
+	// add time elapsed to total CPU time before returning result
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return found;
+}
+
+
+// as xuckoo_hash_table_lookup, but without branching on the first bucket:
+// both buckets are loaded before either is checked, so that a miss waits for
+// memory once rather than twice
+bool xuckoo_hash_table_lookup_branchless(XuckooHashTable *table, int64 key) {
+	assert(table);
+	int start_time = clock(); // start timing
+
+	// calculate table address for this key
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+	int address = rightmostnbits(table->table1->depth, h1(key));
+	int address2 = rightmostnbits(table->table2->depth, h2(key));
+
+	// fetch both buckets, then check both (an empty bucket's key can't match,
+	// since it's masked out by 'full')
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	Bucket *bucket1 = table->table1->buckets[address];
+	Bucket *bucket2 = table->table2->buckets[address2];
+	__builtin_prefetch(bucket1);
+	__builtin_prefetch(bucket2);
+	bool found = (bucket1->full & (bucket1->key == key))
+		| (bucket2->full & (bucket2->key == key));
+	phase_enter(&table->stats.phases, outer);
 
 	// add time elapsed to total CPU time before returning result
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return found;
 }
 
 
+// record structural events in 'table' in 'trace' from now on, or stop
+// recording them if 'trace' is NULL
+void xuckoo_hash_table_set_trace(XuckooHashTable *table, TraceRing *trace) {
+	assert(table != NULL);
+	table->trace = trace;
+}
+
+// move keys hit in their second table into their first whenever that bucket
+// is empty, unless 'policy' is REORDER_NONE
+void xuckoo_hash_table_set_reorder(XuckooHashTable *table, Reorder policy) {
+	assert(table != NULL);
+	table->reorder = policy;
+}
+
 // print the contents of 'table' to stdout
 void xuckoo_hash_table_print(XuckooHashTable *table) {
 	assert(table != NULL);
@@ -347,6 +446,61 @@ void xuckoo_hash_table_print(XuckooHashTable *table) {
 }
 
 
+// the shape of an inner table: how many keys it holds, how many hash bits
+// each bucket uses, and how many directory entries point to each bucket
+typedef struct inner_shape {
+	int nkeys;
+	Histogram depths, aliases;
+} InnerShape;
+
+// fill 'shape' with the shape of inner table 'table'
+static void inner_shape(InnerTable *table, InnerShape *shape) {
+	int nbins = table->depth + 1;
+	histogram_init(&shape->depths,
+		nbins < HISTOGRAM_BINS ? nbins : HISTOGRAM_BINS, false);
+	histogram_init(&shape->aliases, HISTOGRAM_BINS, true);
+
+	// visit each bucket once, at its first reference
+	shape->nkeys = 0;
+	int i;
+	for (i = 0; i < table->size; i++) {
+		Bucket *bucket = table->buckets[i];
+		if (bucket->id == i) {
+			shape->nkeys += bucket->full;
+			histogram_add(&shape->depths, bucket->depth);
+			histogram_add(&shape->aliases, 1 << (table->depth - bucket->depth));
+		}
+	}
+}
+
+// print the shape of inner table 'table_no' of a xuckoo table
+static void print_inner_shape(InnerTable *table, int table_no) {
+	InnerShape shape;
+	inner_shape(table, &shape);
+	char title[64];
+	printf("    table %d keys: %d\n", table_no, shape.nkeys);
+	snprintf(title, sizeof title, "table %d local depths", table_no);
+	histogram_print(&shape.depths, title);
+	snprintf(title, sizeof title, "table %d directory aliases", table_no);
+	histogram_print(&shape.aliases, title);
+}
+
+// add the shape of inner table 'table_no' to 'report'
+static void report_inner_shape(InnerTable *table, int table_no,
+		StatsReport *report) {
+	InnerShape shape;
+	inner_shape(table, &shape);
+	char name[REPORT_NAME_LEN];
+	snprintf(name, sizeof name, "table%d_size_entries", table_no);
+	stats_report_counter(report, name, table->size);
+	snprintf(name, sizeof name, "table%d_keys", table_no);
+	stats_report_counter(report, name, shape.nkeys);
+	snprintf(name, sizeof name, "table%d_local_depths", table_no);
+	stats_report_histogram(report, name, &shape.depths);
+	snprintf(name, sizeof name, "table%d_directory_aliases", table_no);
+	stats_report_histogram(report, name, &shape.aliases);
+}
+
 // print some statistics about 'table' to stdout
 void xuckoo_hash_table_stats(XuckooHashTable *table) {
 	assert(table);
@@ -356,16 +510,35 @@ void xuckoo_hash_table_stats(XuckooHashTable *table) {
 	// print some stats about state of the table
 	printf("current tab 1 size: %d\n", table->table1->size);
 	printf("current tab 2 size: %d\n", table->table2->size);
-	printf("    number of keys: %d\n", table->stats.nkeys);
+	printf("    number of keys: %lld\n", stat_total(table, STAT_KEYS));
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
 
 	// also calculate CPU usage in seconds and print this
-	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	float seconds = stat_total(table, STAT_TIME) * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
 	
+	print_inner_shape(table->table1, 1);
+	print_inner_shape(table->table2, 2);
+	histogram_print(&table->stats.chains, "eviction chain lengths");
+	phase_costs_print(&table->stats.phases);
 	printf("--- end stats ---\n");
 }
 
+// fill 'report' with the statistics of 'table'
+void xuckoo_hash_table_report(XuckooHashTable *table, StatsReport *report) {
+	assert(table);
+	stats_report_init(report, "xuckoo");
+	stats_report_counter(report, "load_keys", stat_total(table, STAT_KEYS));
+	stats_report_counter(report, "buckets", table->stats.nbuckets);
+	stats_report_counter(report, "cpu_time_usec",
+		stat_total(table, STAT_TIME) * 1000000LL / CLOCKS_PER_SEC);
+	report_inner_shape(table->table1, 1, report);
+	report_inner_shape(table->table2, 2, report);
+	stats_report_phases(report, &table->stats.phases);
+	stats_report_histogram(report, "eviction_chain_lengths",
+		&table->stats.chains);
+}
+
 // Recursive function which performs cuckoo hash
 bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos, 
 						int64 orig_key, int loop, int orig_table){
@@ -390,7 +563,9 @@ bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos,
 	// If there is a long cuckoo chain (according to spec) then split.
 	if (((address == orig_pos) && (key == orig_key) && loop > 3) || 
 		loop > table->table1->size+table->table2->size) {
+		trace_instant(table->trace, EVENT_CYCLE, loop, 0);
 		// split bucket in the current table
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
 		split_bucket(table, address, table_no);
 
 		// and recalculate address because we might now need more bits
@@ -405,6 +580,7 @@ bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos,
 	if (inner_table->buckets[address]->full == true){
 		int64 rehash_key = inner_table->buckets[address]->key;
 		inner_table->buckets[address]->key = key;
+		phase_enter(&table->stats.phases, PHASE_EVICT);
 		return try_xuck_insert(table, rehash_key, orig_pos, orig_key, 
 							loop, orig_table);
 	}
@@ -413,7 +589,8 @@ bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos,
 		inner_table->buckets[address]->key = key;
 		inner_table->buckets[address]->full = true;
 		inner_table->nkeys++;
-		table->stats.nkeys++;
+		count_stat(table, STAT_KEYS, 1);
+		histogram_add(&table->stats.chains, loop - orig_table);
 		return true;
 	}
 	//return true;
@@ -13,6 +13,9 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "../trace.h"
+#include "../report.h"
+#include "../reorder.h"
 
 typedef struct xuckoo_table XuckooHashTable;
 
@@ -30,10 +33,26 @@ bool xuckoo_hash_table_insert(XuckooHashTable *table, int64 key);
 // returns true if found, false if not
 bool xuckoo_hash_table_lookup(XuckooHashTable *table, int64 key);
 
+// as xuckoo_hash_table_lookup, but without branching on the first bucket:
+// both buckets are loaded before either is checked, so that a miss waits for
+// memory once rather than twice
+bool xuckoo_hash_table_lookup_branchless(XuckooHashTable *table, int64 key);
+
+// record structural events in 'table' (such as resizes) in 'trace' from now
+// on, or stop recording them if 'trace' is NULL
+void xuckoo_hash_table_set_trace(XuckooHashTable *table, TraceRing *trace);
+
+// move keys hit in their second table into their first whenever that bucket
+// is empty, unless 'policy' is REORDER_NONE
+void xuckoo_hash_table_set_reorder(XuckooHashTable *table, Reorder policy);
+
 // print the contents of 'table' to stdout
 void xuckoo_hash_table_print(XuckooHashTable *table);
 
 // print some statistics about 'table' to stdout
 void xuckoo_hash_table_stats(XuckooHashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table'
+void xuckoo_hash_table_report(XuckooHashTable *table, StatsReport *report);
+
 #endif
@@ -14,6 +14,10 @@
 #include <assert.h>
 #include <time.h>
 #include "xuckoon.h"
+#include "../phases.h"
+#include "../histogram.h"
+#include "../shards.h"
+#include "../dirsort.h"
 /*
 // Colours for debugging
 #include <windows.h>
@@ -26,15 +30,27 @@
 #define RESET   "\x1b[0m"
 */
 #define EMPTY 0
+// how many keys ahead batch inserts prefetch
+#define PREFETCH_DISTANCE 8
 // macro to calculate the rightmost n bits of a number x
 #define rightmostnbits(n, x) (x) & ((1 << (n)) - 1)
 
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
-	int nkeys;		// how many keys are being stored in the table
-	int time;		// how much CPU time has been used to insert/lookup keys
-					// in this table
+	PhaseCosts phases;	// how many cycles each phase of an operation took
+	Histogram chains;	// how many keys each insertion displaced
+	ShardedCounters counters;	// keys, time and lookups (see below)
 } Stats;
+
+// the statistics every operation updates, which each thread counts in its
+// own shard of the table's counters (see shards.h)
+enum stat_counter {
+	STAT_KEYS,		// how many keys are being stored in the table
+	STAT_TIME,		// how much CPU time has been used to insert/lookup keys
+					// in this table
+	STAT_LOOKUPS,	// how many lookups there have been
+	STAT_COMPARES	// how many keys those lookups have compared against
+};
 // a bucket stores a single key (full=true) or is empty (full=false)
 // it also knows how many bits are shared between possible keys, and the first 
 // table address that references it
@@ -60,12 +76,57 @@ typedef struct inner_table {
 struct xuckoon_table {
 	InnerTable *table1;
 	InnerTable *table2;
+	TraceRing *trace;	// where to record resizes, splits and cycles, or NULL
+	Reorder reorder;	// how hit keys move forward
 	Stats stats;
 };
 
+// add 'delta' to statistic 'counter' of 'table', in the calling thread's shard
+static void count_stat(XuckoonHashTable *table, int counter, long long delta) {
+	sharded_counter_count(&table->stats.counters, counter, delta);
+}
+
+// the total of statistic 'counter' of 'table', across every thread's shard
+static long long stat_total(XuckoonHashTable *table, int counter) {
+	return sharded_counter_total(&table->stats.counters, counter);
+}
+
 
 void try_xuckoon_insert(XuckoonHashTable *table, int64 key, int orig_pos, 
 						int64 orig_key, int loop, int orig_table);
+static void try_insert_hashed(XuckoonHashTable *table, int64 key, int hash,
+		int orig_pos, int64 orig_key, int loop, int orig_table);
+static bool lookup_hashed(XuckoonHashTable *table, int64 key, int hash1,
+		int hash2);
+
+// move the key at index 'i' of 'bucket', which has just been hit, forward as
+// far as the reorder policy of 'table' says
+static void promote_key(XuckoonHashTable *table, Bucket *bucket, int i) {
+	int64 key = bucket->keys[i];
+	switch (table->reorder) {
+		case REORDER_TRANSPOSE:
+			if (i > 0) {
+				bucket->keys[i] = bucket->keys[i - 1];
+				bucket->keys[i - 1] = key;
+			}
+			break;
+		case REORDER_FRONT:
+			for (; i > 0; i--) {
+				bucket->keys[i] = bucket->keys[i - 1];
+			}
+			bucket->keys[0] = key;
+			break;
+		default:
+			break;
+	}
+}
+
+// remove the key at index 'i' of 'bucket' by moving the last key into its
+// place
+static void remove_from_bucket(Bucket *bucket, int i) {
+	bucket->nkeys--;
+	bucket->keys[i] = bucket->keys[bucket->nkeys];
+}
 
 // create a new bucket first referenced from 'first_address', based on 'depth'
 // bits of its keys' hash values
@@ -130,6 +191,7 @@ static void reinsert_key(XuckoonHashTable *table, int64 key, int table_no) {
 
 // split the bucket in 'table' at address 'address', growing table if necessary
 static void split_bucket(XuckoonHashTable *table, int address, int table_no) {
+	long long start = trace_start(table->trace);
 	//printf("split bucket\n");
 
 	InnerTable *inner_table;
@@ -143,7 +205,12 @@ static void split_bucket(XuckoonHashTable *table, int address, int table_no) {
 	// do we need to grow the table?
 	if (inner_table->buckets[address]->depth == inner_table->depth) {
 		// yep, this bucket is down to its last pointer
+		long long resize_start = trace_start(table->trace);
+		phase_enter(&table->stats.phases, PHASE_GROW);
 		double_table(inner_table);
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
+		trace_end(table->trace, EVENT_RESIZE, resize_start,
+			inner_table->size / 2, inner_table->size);
 	}
 	// either way, now it's time to split this bucket
 
@@ -159,7 +226,9 @@ static void split_bucket(XuckoonHashTable *table, int address, int table_no) {
 
 	// new bucket's first address will be a 1 bit plus the old first address
 	int new_first_address = 1 << depth | first_address;
+	phase_enter(&table->stats.phases, PHASE_ALLOC);
 	Bucket *newbucket = new_bucket(new_first_address, new_depth, inner_table->bucketsize);
+	phase_enter(&table->stats.phases, PHASE_SPLIT);
 	
 	// THIRD,
 	// redirect every second address pointing to this bucket to the new bucket
@@ -199,6 +268,7 @@ static void split_bucket(XuckoonHashTable *table, int address, int table_no) {
 	for (i = 0; i < count; i++) {
 		reinsert_key(table, keys[i], table_no);
 	}
+	trace_end(table->trace, EVENT_SPLIT, start, first_address, new_depth);
 	//xuckoon_hash_table_print(table);
 }
 
@@ -213,9 +283,12 @@ XuckoonHashTable *new_xuckoon_hash_table(int bucketsize) {
 	//printf("Successfully made table 2!\n");
 	// Then create a cuckoo table and link these to the inner tables
 	//printf("Successfully made cuckoo table!\n");
+	cuckoo->trace = NULL;
 	cuckoo->stats.nbuckets = 1;
-	cuckoo->stats.nkeys = 0;
-	cuckoo->stats.time = 0;
+	sharded_counters_init(&cuckoo->stats.counters, TABLE_SHARDS);
+	cuckoo->reorder = REORDER_NONE;
+	phase_costs_init(&cuckoo->stats.phases);
+	histogram_init(&cuckoo->stats.chains, 16, true);
 	return cuckoo;
 }
 
@@ -245,6 +318,8 @@ void free_xuckoon_hash_table(XuckoonHashTable *table) {
 	free(table->table1);
 	free(table->table2);
 	
+	sharded_counters_free(&table->stats.counters);
+	phase_costs_free(&table->stats.phases);
 	// free the table struct itself
 	free(table);	
 }
@@ -258,9 +333,10 @@ bool xuckoon_hash_table_insert(XuckoonHashTable *table, int64 key) {
 
 	// is this key already there?
 	if (xuckoon_hash_table_lookup(table, key) == true) {
-		table->stats.time += clock() - start_time;
+		count_stat(table, STAT_TIME, clock() - start_time);
 		return false;
 	}
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	// initialise variables
 	int hash;
 	int address;
@@ -269,49 +345,209 @@ bool xuckoon_hash_table_insert(XuckoonHashTable *table, int64 key) {
 	if (table->table1->size <= table->table2->size) {
 		hash = h1(key);
 		address = rightmostnbits(table->table1->depth, hash);
-		try_xuckoon_insert(table, key, address, key, 0, 1);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		try_insert_hashed(table, key, hash, address, key, 0, 1);
 	}
 	else {
 		hash = h2(key);
 		address = rightmostnbits(table->table2->depth, hash);
-		try_xuckoon_insert(table, key, address, key, 1, 2);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		try_insert_hashed(table, key, hash, address, key, 1, 2);
 	}
+	phase_enter(&table->stats.phases, outer);
 	// add time elapsed to total CPU time before returning
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return true;
 }
 
+// insert each of the 'n' keys in 'keys' into 'table', recording whether each
+// one was newly inserted in 'inserted' (unless 'inserted' is NULL)
+// the keys are all hashed first, for both inner tables, and then radix sorted
+// into the directory order of the table new keys are going into, so that the
+// keys bound for each bucket are looked up and inserted one after another,
+// with no more hashing
+// returns the number of keys newly inserted
+int xuckoon_hash_table_insert_batch(XuckoonHashTable *table,
+		const int64 *keys, int n, bool *inserted) {
+	assert(table);
+	assert(n >= 0);
+	if (n == 0) {
+		return 0;
+	}
+	int start_time = clock(); // start timing
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+
+	// new keys go into the table with fewer keys, which won't change until
+	// that table doubles, so sort by its hash
+	int *hashes1 = malloc(sizeof(int) * n);
+	int *hashes2 = malloc(sizeof(int) * n);
+	assert(hashes1 && hashes2);
+	hash_batch(HASH_H1, keys, n, hashes1);
+	hash_batch(HASH_H2, keys, n, hashes2);
+	bool first = table->table1->size <= table->table2->size;
+	InnerTable *inner_table = first ? table->table1 : table->table2;
+	SortKey *sorted = malloc(sizeof(SortKey) * n);
+	SortKey *scratch = malloc(sizeof(SortKey) * n);
+	assert(sorted && scratch);
+	int i;
+	for (i = 0; i < n; i++) {
+		sorted[i].hash = first ? hashes1[i] : hashes2[i];
+		sorted[i].order = dirsort_order(sorted[i].hash);
+		sorted[i].index = i;
+		sorted[i].key = keys[i];
+	}
+	dirsort(sorted, scratch, n, inner_table->depth);
+	free(scratch);
+
+	int ninserted = 0;
+	for (i = 0; i < n; i++) {
+		// fetch the bucket of a key further on while this one is inserted
+		if (i + PREFETCH_DISTANCE < n) {
+			__builtin_prefetch(inner_table->buckets[rightmostnbits(
+				inner_table->depth, sorted[i + PREFETCH_DISTANCE].hash)]);
+		}
+		int64 key = sorted[i].key;
+		int hash1 = hashes1[sorted[i].index];
+		int hash2 = hashes2[sorted[i].index];
+
+		// is this key already there (or earlier in the batch)?
+		phase_enter(&table->stats.phases, PHASE_PROBE);
+		bool new = !lookup_hashed(table, key, hash1, hash2);
+		if (new) {
+			// if not, insert it into the table with less keys (which may
+			// not be the one we sorted for, if that table has doubled since)
+			if (table->table1->size <= table->table2->size) {
+				try_insert_hashed(table, key, hash1,
+					rightmostnbits(table->table1->depth, hash1), key, 0, 1);
+			} else {
+				try_insert_hashed(table, key, hash2,
+					rightmostnbits(table->table2->depth, hash2), key, 1, 2);
+			}
+		}
+		if (inserted) {
+			inserted[sorted[i].index] = new;
+		}
+		ninserted += new;
+	}
+	free(sorted);
+	free(hashes1);
+	free(hashes2);
+	phase_enter(&table->stats.phases, outer);
+
+	// add time elapsed to total CPU time before returning
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return ninserted;
+}
+
+// look for 'key' (whose h1 and h2 hashes are 'hash1' and 'hash2') in 'table'
+// returns true if found, false if not
+static bool lookup_hashed(XuckoonHashTable *table, int64 key, int hash1,
+		int hash2) {
+	int address1 = rightmostnbits(table->table1->depth, hash1);
+	int address2 = rightmostnbits(table->table2->depth, hash2);
+
+	// look for the key in its first bucket, then its second
+	Bucket *bucket1 = table->table1->buckets[address1];
+	Bucket *bucket2 = table->table2->buckets[address2];
+	bool found = false;
+	int i, compares = 0;
+	for (i = 0; i < bucket1->nkeys && !found; i++) {
+		compares++;
+		if (bucket1->keys[i] == key) {
+			// found it!
+			found = true;
+			promote_key(table, bucket1, i);
+		}
+	}
+	for (i = 0; i < bucket2->nkeys && !found; i++) {
+		compares++;
+		if (bucket2->keys[i] == key) {
+			// found it! move it into its first bucket if there's room there,
+			// where the next lookup will find it sooner
+			found = true;
+			if (table->reorder != REORDER_NONE
+					&& bucket1->nkeys < table->table1->bucketsize) {
+				remove_from_bucket(bucket2, i);
+				bucket1->keys[bucket1->nkeys++] = key;
+				promote_key(table, bucket1, bucket1->nkeys - 1);
+			} else {
+				promote_key(table, bucket2, i);
+			}
+		}
+	}
+	count_stat(table, STAT_LOOKUPS, 1);
+	count_stat(table, STAT_COMPARES, compares);
+	return found;
+}
+
 // Function looks up value in the hash table
 bool xuckoon_hash_table_lookup(XuckoonHashTable *table, int64 key) {
 	assert(table);
 	int start_time = clock(); // start timing
 
+	// calculate table addresses for this key, and look for it there
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
+	int hash1 = h1(key);
+	int hash2 = h2(key);
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	bool found = lookup_hashed(table, key, hash1, hash2);
+
+	phase_enter(&table->stats.phases, outer);
+
+	// add time elapsed to total CPU time before returning result
+	count_stat(table, STAT_TIME, clock() - start_time);
+	return found;
+}
+
+
+// as xuckoon_hash_table_lookup, but without branching on each key compared:
+// both buckets are fetched before either is scanned, and matches are
+// combined with bitwise ors
+bool xuckoon_hash_table_lookup_branchless(XuckoonHashTable *table, int64 key) {
+	assert(table);
+	int start_time = clock(); // start timing
+
 	// calculate table address for this key
+	Phase outer = phase_enter(&table->stats.phases, PHASE_HASH);
 	int address1 = rightmostnbits(table->table1->depth, h1(key));
 	int address2 = rightmostnbits(table->table2->depth, h2(key));
-	
-	// look for the key in that bucket (unless it's empty)
+
+	phase_enter(&table->stats.phases, PHASE_PROBE);
+	Bucket *bucket1 = table->table1->buckets[address1];
+	Bucket *bucket2 = table->table2->buckets[address2];
+	__builtin_prefetch(bucket1->keys);
+	__builtin_prefetch(bucket2->keys);
 	bool found = false;
 	int i;
-	for (i = 0; i < table->table1->buckets[address1]->nkeys; i++) {
-		if (table->table1->buckets[address1]->keys[i] == key) {
-			// found it!
-			found = true;
-		}
+	for (i = 0; i < bucket1->nkeys; i++) {
+		found |= bucket1->keys[i] == key;
 	}
-	for (i = 0; i < table->table2->buckets[address2]->nkeys; i++) {
-		if (table->table2->buckets[address2]->keys[i] == key) {
-			// found it!
-			found = true;
-		}
+	for (i = 0; i < bucket2->nkeys; i++) {
+		found |= bucket2->keys[i] == key;
 	}
+	phase_enter(&table->stats.phases, outer);
 
 	// add time elapsed to total CPU time before returning result
-	table->stats.time += clock() - start_time;
+	count_stat(table, STAT_TIME, clock() - start_time);
 	return found;
 }
 
 
+// record structural events in 'table' in 'trace' from now on, or stop
+// recording them if 'trace' is NULL
+void xuckoon_hash_table_set_trace(XuckoonHashTable *table, TraceRing *trace) {
+	assert(table != NULL);
+	table->trace = trace;
+}
+
+// move keys in 'table' forward whenever they are hit, as 'policy' says: within
+// their bucket, and from their second table to their first where there's
+// room, so that hot keys are found sooner
+void xuckoon_hash_table_set_reorder(XuckoonHashTable *table, Reorder policy) {
+	assert(table != NULL);
+	table->reorder = policy;
+}
+
 // print the contents of 'table' to stdout
 void xuckoon_hash_table_print(XuckoonHashTable *table) {
 	assert(table != NULL);
@@ -357,6 +593,70 @@ void xuckoon_hash_table_print(XuckoonHashTable *table) {
 	printf("--- end table ---\n");
 }
 
+// the shape of an inner table: how many keys it holds, how full its buckets
+// are, how many hash bits each bucket uses, and how many directory entries
+// point to each bucket
+typedef struct inner_shape {
+	int nkeys;
+	Histogram occupancy, depths, aliases;
+} InnerShape;
+
+// fill 'shape' with the shape of inner table 'table'
+static void inner_shape(InnerTable *table, InnerShape *shape) {
+	int nbins = table->bucketsize + 1;
+	histogram_init(&shape->occupancy,
+		nbins < HISTOGRAM_BINS ? nbins : HISTOGRAM_BINS, false);
+	nbins = table->depth + 1;
+	histogram_init(&shape->depths,
+		nbins < HISTOGRAM_BINS ? nbins : HISTOGRAM_BINS, false);
+	histogram_init(&shape->aliases, HISTOGRAM_BINS, true);
+
+	// visit each bucket once, at its first reference
+	shape->nkeys = 0;
+	int i;
+	for (i = 0; i < table->size; i++) {
+		Bucket *bucket = table->buckets[i];
+		if (bucket->id == i) {
+			shape->nkeys += bucket->nkeys;
+			histogram_add(&shape->occupancy, bucket->nkeys);
+			histogram_add(&shape->depths, bucket->depth);
+			histogram_add(&shape->aliases, 1 << (table->depth - bucket->depth));
+		}
+	}
+}
+
+// print the shape of inner table 'table_no' of a xuckoon table
+static void print_inner_shape(InnerTable *table, int table_no) {
+	InnerShape shape;
+	inner_shape(table, &shape);
+	char title[64];
+	printf("    table %d keys: %d\n", table_no, shape.nkeys);
+	snprintf(title, sizeof title, "table %d bucket occupancy", table_no);
+	histogram_print(&shape.occupancy, title);
+	snprintf(title, sizeof title, "table %d local depths", table_no);
+	histogram_print(&shape.depths, title);
+	snprintf(title, sizeof title, "table %d directory aliases", table_no);
+	histogram_print(&shape.aliases, title);
+}
+
+// add the shape of inner table 'table_no' to 'report'
+static void report_inner_shape(InnerTable *table, int table_no,
+		StatsReport *report) {
+	InnerShape shape;
+	inner_shape(table, &shape);
+	char name[REPORT_NAME_LEN];
+	snprintf(name, sizeof name, "table%d_size_entries", table_no);
+	stats_report_counter(report, name, table->size);
+	snprintf(name, sizeof name, "table%d_keys", table_no);
+	stats_report_counter(report, name, shape.nkeys);
+	snprintf(name, sizeof name, "table%d_bucket_occupancy", table_no);
+	stats_report_histogram(report, name, &shape.occupancy);
+	snprintf(name, sizeof name, "table%d_local_depths", table_no);
+	stats_report_histogram(report, name, &shape.depths);
+	snprintf(name, sizeof name, "table%d_directory_aliases", table_no);
+	stats_report_histogram(report, name, &shape.aliases);
+}
+
 // print some statistics about 'table' to stdout
 void xuckoon_hash_table_stats(XuckoonHashTable *table) {
 	assert(table);
@@ -366,21 +666,57 @@ void xuckoon_hash_table_stats(XuckoonHashTable *table) {
 	// print some stats about state of the table
 	printf("current tab 1 size: %d\n", table->table1->size);
 	printf("current tab 2 size: %d\n", table->table2->size);
-	printf("    number of keys: %d\n", table->stats.nkeys);
+	printf("    number of keys: %lld\n", stat_total(table, STAT_KEYS));
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
 
+	long long lookups = stat_total(table, STAT_LOOKUPS);
+	if (lookups > 0) {
+		printf("   keys per lookup: %.3f\n",
+			(double)stat_total(table, STAT_COMPARES) / lookups);
+	}
+
 	// also calculate CPU usage in seconds and print this
-	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	float seconds = stat_total(table, STAT_TIME) * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
 	
+	print_inner_shape(table->table1, 1);
+	print_inner_shape(table->table2, 2);
+	histogram_print(&table->stats.chains, "eviction chain lengths");
+	phase_costs_print(&table->stats.phases);
 	printf("--- end stats ---\n");
 }
 
+// fill 'report' with the statistics of 'table'
+void xuckoon_hash_table_report(XuckoonHashTable *table, StatsReport *report) {
+	assert(table);
+	stats_report_init(report, "xuckoon");
+	stats_report_counter(report, "load_keys", stat_total(table, STAT_KEYS));
+	stats_report_counter(report, "buckets", table->stats.nbuckets);
+	stats_report_counter(report, "lookups", stat_total(table, STAT_LOOKUPS));
+	stats_report_counter(report, "lookup_compares",
+		stat_total(table, STAT_COMPARES));
+	stats_report_counter(report, "cpu_time_usec",
+		stat_total(table, STAT_TIME) * 1000000LL / CLOCKS_PER_SEC);
+	report_inner_shape(table->table1, 1, report);
+	report_inner_shape(table->table2, 2, report);
+	stats_report_phases(report, &table->stats.phases);
+	stats_report_histogram(report, "eviction_chain_lengths",
+		&table->stats.chains);
+}
+
 // Recursive function which performs cuckoo hash
 void try_xuckoon_insert(XuckoonHashTable *table, int64 key, int orig_pos, 
 							int64 orig_key, int loop, int orig_table){
+	// hash the key for the table this step of the chain is in
+	int hash = (loop + 1) % 2 == 0 ? h2(key) : h1(key);
+	try_insert_hashed(table, key, hash, orig_pos, orig_key, loop, orig_table);
+}
+
+// as try_xuckoon_insert, for a 'key' whose hash for the table this step of
+// the chain is in ('hash') is already known
+static void try_insert_hashed(XuckoonHashTable *table, int64 key, int hash,
+		int orig_pos, int64 orig_key, int loop, int orig_table) {
 	int address; 
-	int hash;
 	int table_no;
 	// Check which table the function is currently in. Assign variables
 	// accordingly.
@@ -388,25 +724,26 @@ void try_xuckoon_insert(XuckoonHashTable *table, int64 key, int orig_pos,
 	InnerTable *inner_table;
 	if (loop % 2 == 0) {
 		inner_table = table->table2;
-		hash = h2(key);
 		table_no = 2;
 	}
 	else {
 		inner_table = table->table1;
-		hash = h1(key);
 		table_no = 1;
 	}
 	
 	address = rightmostnbits(inner_table->depth, hash);
 	// If bucket is full, then split before doing anything until there is space
 	while (inner_table->buckets[address]->nkeys == inner_table->bucketsize) {
+		phase_enter(&table->stats.phases, PHASE_SPLIT);
 		split_bucket(table, address, table_no);
+		phase_enter(&table->stats.phases, PHASE_PROBE);
 		// recalculate address
 		address = rightmostnbits(inner_table->depth, hash);
 	}
 		// If there is a long cuckoo chain (according to spec) then split.
 	if (((address == orig_pos) && (key == orig_key) && loop > 2) || 
 		(loop > (100))) {
+		trace_instant(table->trace, EVENT_CYCLE, loop, 0);
 		while (inner_table->buckets[address]->nkeys == inner_table->bucketsize) {
 			// split bucket
 			split_bucket(table, address, table_no);
@@ -423,6 +760,7 @@ void try_xuckoon_insert(XuckoonHashTable *table, int64 key, int orig_pos,
 		// rehashed and try inserting the rehash key into the opposite table
 		int64 rehash_key = inner_table->buckets[address]->keys[inner_table->buckets[address]->nkeys];
 		inner_table->buckets[address]->keys[inner_table->buckets[address]->nkeys] = key;
+		phase_enter(&table->stats.phases, PHASE_EVICT);
 		try_xuckoon_insert(table, rehash_key, orig_pos, orig_key, loop, orig_table);
 		return;
 	}
@@ -430,7 +768,11 @@ void try_xuckoon_insert(XuckoonHashTable *table, int64 key, int orig_pos,
 		// otherwise, just insert the key and return true
 		inner_table->buckets[address]->keys[inner_table->buckets[address]->nkeys] = key;
 		inner_table->buckets[address]->nkeys++;
-		table->stats.nkeys++;
+		count_stat(table, STAT_KEYS, 1);
+		// (after a cycle restarts the chain from table 1, 'loop' no longer
+		// tells us how long it was, so count it as direct)
+		histogram_add(&table->stats.chains,
+			loop > orig_table ? loop - orig_table : 0);
 		return;
 	}
 }
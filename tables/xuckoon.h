@@ -13,6 +13,9 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "../trace.h"
+#include "../report.h"
+#include "../reorder.h"
 
 typedef struct xuckoon_table XuckoonHashTable;
 
@@ -26,14 +29,40 @@ void free_xuckoon_hash_table(XuckoonHashTable *table);
 // returns true if insertion succeeds, false if it was already in there
 bool xuckoon_hash_table_insert(XuckoonHashTable *table, int64 key);
 
+// insert each of the 'n' keys in 'keys' into 'table', recording whether each
+// one was newly inserted in 'inserted' (unless 'inserted' is NULL)
+// the keys are all hashed first for the inner table they will go into, and
+// then radix sorted into its directory order, so that the keys bound for
+// each bucket are inserted one after another
+// returns the number of keys newly inserted
+int xuckoon_hash_table_insert_batch(XuckoonHashTable *table,
+	const int64 *keys, int n, bool *inserted);
+
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool xuckoon_hash_table_lookup(XuckoonHashTable *table, int64 key);
 
+// as xuckoon_hash_table_lookup, but without branching on each key compared:
+// both buckets are fetched before either is scanned, and matches are
+// combined with bitwise ors
+bool xuckoon_hash_table_lookup_branchless(XuckoonHashTable *table, int64 key);
+
+// move keys in 'table' forward whenever they are hit, as 'policy' says: within
+// their bucket, and from their second table to their first where there's
+// room, so that hot keys are found sooner
+void xuckoon_hash_table_set_reorder(XuckoonHashTable *table, Reorder policy);
+
+// record structural events in 'table' (such as resizes) in 'trace' from now
+// on, or stop recording them if 'trace' is NULL
+void xuckoon_hash_table_set_trace(XuckoonHashTable *table, TraceRing *trace);
+
 // print the contents of 'table' to stdout
 void xuckoon_hash_table_print(XuckoonHashTable *table);
 
 // print some statistics about 'table' to stdout
 void xuckoon_hash_table_stats(XuckoonHashTable *table);
 
+// fill 'report' with a snapshot of the statistics of 'table'
+void xuckoon_hash_table_report(XuckoonHashTable *table, StatsReport *report);
+
 #endif
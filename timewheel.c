@@ -0,0 +1,192 @@
+/* * * * * * * * *
+ * Hierarchical timer wheel for scheduling the expiry of hash table keys
+ *
+ * keys are filed into one of 64 slots on the lowest level whose span covers
+ * their deadline; as the clock advances, the slots of the higher levels are
+ * cascaded down, so each timer is touched at most once per level. the clock
+ * jumps over runs of ticks whose slots are all empty, rather than visiting
+ * each one
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "timewheel.h"
+
+// each level has 2^SLOT_BITS slots, each spanning 2^(SLOT_BITS*level) ticks
+#define SLOT_BITS 6
+#define NSLOTS (1 << SLOT_BITS)
+#define NLEVELS 4
+
+// a slot is a growable array of timers
+typedef struct slot {
+	Timer *timers;	// the timers filed in this slot
+	int ntimers;	// how many timers are in this slot
+	int size;		// how many timers this slot has space for
+} Slot;
+
+struct timer_wheel {
+	Slot slots[NLEVELS][NSLOTS];
+	int now;		// the current tick; every timer due at or before this
+					// has been expired
+	int ntimers;	// how many timers are scheduled in total
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// the span of ticks covered by a single slot on 'level'
+static int slot_span(int level) {
+	return 1 << (SLOT_BITS * level);
+}
+
+// append 'timer' to 'slot', growing its array if necessary
+static void slot_push(Slot *slot, Timer timer) {
+	if (slot->ntimers == slot->size) {
+		slot->size = slot->size ? slot->size * 2 : 4;
+		slot->timers = realloc(slot->timers, sizeof *slot->timers * slot->size);
+		assert(slot->timers);
+	}
+	slot->timers[slot->ntimers++] = timer;
+}
+
+// file 'timer' into the lowest level whose span reaches its deadline
+static void file_timer(TimerWheel *wheel, Timer timer) {
+	int tick = timer.deadline;
+	int delta = tick - wheel->now;
+	if (delta <= 0) {
+		// overdue timers go in the very next slot
+		tick = wheel->now + 1;
+		delta = 1;
+	}
+
+	// each level reaches NSLOTS of its own slots ahead of the clock
+	int level = 0;
+	while (level < NLEVELS - 1 && delta >= slot_span(level + 1)) {
+		level++;
+	}
+	if (delta >= slot_span(NLEVELS)) {
+		// too far in the future even for the top level: park it in the
+		// furthest top level slot, it will be re-filed when that cascades
+		tick = wheel->now + slot_span(NLEVELS - 1) * (NSLOTS - 1);
+	}
+
+	int index = (tick >> (SLOT_BITS * level)) & (NSLOTS - 1);
+	slot_push(&wheel->slots[level][index], timer);
+}
+
+// re-file every timer in the slot 'index' on 'level' into lower levels
+static void cascade(TimerWheel *wheel, int level, int index) {
+	Slot *slot = &wheel->slots[level][index];
+	Timer *timers = slot->timers;
+	int ntimers = slot->ntimers;
+
+	// detach the array first, as re-filing may put timers back in this slot
+	slot->timers = NULL;
+	slot->ntimers = 0;
+	slot->size = 0;
+
+	int i;
+	for (i = 0; i < ntimers; i++) {
+		file_timer(wheel, timers[i]);
+	}
+	free(timers);
+}
+
+// the first tick after the clock of 'wheel', and no later than 'limit', at
+// which a slot comes round that has timers to cascade or expire. every tick
+// before it would only visit empty slots, so the clock can jump straight there
+static int next_due_tick(TimerWheel *wheel, int limit) {
+	int next = limit;
+	int level;
+	for (level = 0; level < NLEVELS; level++) {
+		// a slot on this level comes round at each multiple of its span
+		int span = slot_span(level);
+		int tick = (wheel->now & ~(span - 1)) + span;
+		int i;
+		for (i = 0; i < NSLOTS && tick < next; i++, tick += span) {
+			int index = (tick >> (SLOT_BITS * level)) & (NSLOTS - 1);
+			if (wheel->slots[level][index].ntimers > 0) {
+				next = tick;
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+/* * * *
+ * all functions
+ */
+
+// create a new timer wheel whose clock starts at tick 'now'
+TimerWheel *new_timer_wheel(int now) {
+	TimerWheel *wheel = calloc(1, sizeof *wheel);
+	assert(wheel);
+	wheel->now = now;
+	return wheel;
+}
+
+// free all memory associated with 'wheel'
+void free_timer_wheel(TimerWheel *wheel) {
+	assert(wheel);
+	int level, index;
+	for (level = 0; level < NLEVELS; level++) {
+		for (index = 0; index < NSLOTS; index++) {
+			free(wheel->slots[level][index].timers);
+		}
+	}
+	free(wheel);
+}
+
+// schedule 'key' to expire at tick 'deadline'
+void timer_wheel_add(TimerWheel *wheel, int64 key, int deadline) {
+	assert(wheel);
+	Timer timer = { .key = key, .deadline = deadline };
+	file_timer(wheel, timer);
+	wheel->ntimers++;
+}
+
+// advance the clock of 'wheel' to tick 'now', calling 'expire' with each
+// slot's worth of timers whose deadlines have passed
+void timer_wheel_advance(TimerWheel *wheel, int now,
+		ExpireFunction expire, void *data) {
+	assert(wheel);
+
+	while (wheel->now < now) {
+		// nothing scheduled? then there's nothing to do between here and now
+		if (wheel->ntimers == 0) {
+			wheel->now = now;
+			break;
+		}
+		// skip the ticks that would only visit empty slots
+		wheel->now = next_due_tick(wheel, now);
+
+		// whenever a lower level wraps around, cascade the next slot of the
+		// level above it down into the levels below
+		int level;
+		for (level = 1; level < NLEVELS; level++) {
+			if (wheel->now & (slot_span(level) - 1)) {
+				break;
+			}
+			cascade(wheel, level,
+				(wheel->now >> (SLOT_BITS * level)) & (NSLOTS - 1));
+		}
+
+		// then everything in the current lowest level slot is due
+		Slot *slot = &wheel->slots[0][wheel->now & (NSLOTS - 1)];
+		if (slot->ntimers > 0) {
+			Timer *timers = slot->timers;
+			int ntimers = slot->ntimers;
+			slot->timers = NULL;
+			slot->ntimers = 0;
+			slot->size = 0;
+
+			wheel->ntimers -= ntimers;
+			expire(data, timers, ntimers);
+			free(timers);
+		}
+	}
+}
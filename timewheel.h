@@ -0,0 +1,41 @@
+/* * * * * * * * *
+ * Hierarchical timer wheel for scheduling the expiry of hash table keys
+ *
+ * keys are filed into one of 64 slots on the lowest level whose span covers
+ * their deadline; as the clock advances, the slots of the higher levels are
+ * cascaded down, so each timer is touched at most once per level. the clock
+ * jumps over runs of ticks whose slots are all empty, rather than visiting
+ * each one
+ */
+
+#ifndef TIMEWHEEL_H
+#define TIMEWHEEL_H
+
+#include "inthash.h"
+
+// a timer: a key and the tick at which it expires
+typedef struct timer {
+	int64 key;
+	int deadline;
+} Timer;
+
+typedef struct timer_wheel TimerWheel;
+
+// function called with each batch of timers that have come due
+typedef void (*ExpireFunction)(void *data, Timer *timers, int ntimers);
+
+// create a new timer wheel whose clock starts at tick 'now'
+TimerWheel *new_timer_wheel(int now);
+
+// free all memory associated with 'wheel'
+void free_timer_wheel(TimerWheel *wheel);
+
+// schedule 'key' to expire at tick 'deadline'
+void timer_wheel_add(TimerWheel *wheel, int64 key, int deadline);
+
+// advance the clock of 'wheel' to tick 'now', calling 'expire' with each
+// slot's worth of timers whose deadlines have passed
+void timer_wheel_advance(TimerWheel *wheel, int now,
+	ExpireFunction expire, void *data);
+
+#endif
@@ -0,0 +1,146 @@
+/* * * * * * * * *
+ * Ring buffer of timestamped structural events in a hash table (resizes,
+ * bucket splits, cuckoo cycles and write buffer merges), which can be written
+ * out as Chrome trace JSON for viewing in chrome://tracing or Perfetto
+ *
+ * the ring keeps only its most recent events, overwriting the oldest ones,
+ * so a table can be traced for as long as it runs with fixed memory. all of
+ * the recording functions do nothing when given a NULL ring, so tables can
+ * call them unconditionally whether or not they are being traced
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "trace.h"
+
+// a single recorded event
+typedef struct trace_event {
+	EventKind kind;
+	long long start;	// when it began, in nanoseconds
+	long long duration;	// how long it took, in nanoseconds (-1 for instants)
+	int arg1;
+	int arg2;
+} TraceEvent;
+
+struct trace_ring {
+	TraceEvent *events;	// circular array of the most recent events
+	int size;			// how many events fit in 'events'
+	long long nevents;	// how many events have ever been recorded
+	long long epoch;	// when the ring was created, so timestamps start at 0
+};
+
+// the name of each kind of event, and of its arguments
+static const char *event_names[] = { "resize", "split", "cycle", "merge" };
+static const char *arg1_names[] = { "old_size", "address", "chain_length",
+	"keys" };
+static const char *arg2_names[] = { "new_size", "depth", NULL, "new_buckets" };
+
+
+/* * * *
+ * helper functions
+ */
+
+// nanoseconds elapsed on a monotonic clock since some fixed point
+static long long now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// record an event in the next position of 'ring', overwriting the oldest
+static void record(TraceRing *ring, EventKind kind, long long start,
+		long long duration, int arg1, int arg2) {
+	TraceEvent *event = &ring->events[ring->nevents % ring->size];
+	event->kind = kind;
+	event->start = start;
+	event->duration = duration;
+	event->arg1 = arg1;
+	event->arg2 = arg2;
+	ring->nevents++;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// create a ring holding up to 'size' events
+TraceRing *new_trace_ring(int size) {
+	assert(size > 0);
+	TraceRing *ring = malloc(sizeof *ring);
+	assert(ring);
+	ring->events = malloc(sizeof *ring->events * size);
+	assert(ring->events);
+	ring->size = size;
+	ring->nevents = 0;
+	ring->epoch = now_ns();
+	return ring;
+}
+
+// free all memory associated with 'ring'
+void free_trace_ring(TraceRing *ring) {
+	assert(ring);
+	free(ring->events);
+	free(ring);
+}
+
+// get a timestamp to mark the start of an event in 'ring' with
+long long trace_start(TraceRing *ring) {
+	return ring ? now_ns() : 0;
+}
+
+// record an event of kind 'kind' which began at 'start' and has just finished
+void trace_end(TraceRing *ring, EventKind kind, long long start,
+		int arg1, int arg2) {
+	if (ring) {
+		record(ring, kind, start, now_ns() - start, arg1, arg2);
+	}
+}
+
+// record an event of kind 'kind' happening right now
+void trace_instant(TraceRing *ring, EventKind kind, int arg1, int arg2) {
+	if (ring) {
+		record(ring, kind, now_ns(), -1, arg1, arg2);
+	}
+}
+
+// write the events held in 'ring' to 'file' as a Chrome trace JSON object,
+// oldest first
+void trace_write_json(TraceRing *ring, FILE *file) {
+	assert(ring && file);
+
+	// only the last 'size' events are still in the ring
+	long long first = ring->nevents - ring->size;
+	if (first < 0) {
+		first = 0;
+	}
+	fprintf(file, "{\"traceEvents\":[");
+	long long i;
+	for (i = first; i < ring->nevents; i++) {
+		TraceEvent *event = &ring->events[i % ring->size];
+
+		// timestamps are in microseconds; events with a duration are
+		// 'complete' events, and the rest are thread-scoped instants
+		fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"hashtable\",",
+			i == first ? "" : ",", event_names[event->kind]);
+		if (event->duration >= 0) {
+			fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,",
+				event->duration / 1000.0);
+		} else {
+			fprintf(file, "\"ph\":\"i\",\"s\":\"t\",");
+		}
+		fprintf(file, "\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"%s\":%d",
+			(event->start - ring->epoch) / 1000.0, arg1_names[event->kind],
+			event->arg1);
+		if (arg2_names[event->kind]) {
+			fprintf(file, ",\"%s\":%d", arg2_names[event->kind], event->arg2);
+		}
+		fprintf(file, "}}");
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":"
+		"{\"dropped_events\":%lld}}\n", first);
+}
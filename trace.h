@@ -0,0 +1,50 @@
+/* * * * * * * * *
+ * Ring buffer of timestamped structural events in a hash table (resizes,
+ * bucket splits, cuckoo cycles and write buffer merges), which can be written
+ * out as Chrome trace JSON for viewing in chrome://tracing or Perfetto
+ *
+ * the ring keeps only its most recent events, overwriting the oldest ones,
+ * so a table can be traced for as long as it runs with fixed memory. all of
+ * the recording functions do nothing when given a NULL ring, so tables can
+ * call them unconditionally whether or not they are being traced
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+// the kinds of event that can be recorded
+typedef enum event_kind {
+	EVENT_RESIZE,	// a table or directory changed size (old size, new size)
+	EVENT_SPLIT,	// a bucket was split (its address, its new depth)
+	EVENT_CYCLE,	// a cuckoo insertion looped (chain length, unused)
+	EVENT_MERGE		// a write buffer was merged (keys, buckets added)
+} EventKind;
+
+typedef struct trace_ring TraceRing;
+
+// create a ring holding up to 'size' events
+TraceRing *new_trace_ring(int size);
+
+// free all memory associated with 'ring'
+void free_trace_ring(TraceRing *ring);
+
+// get a timestamp to mark the start of an event in 'ring' with
+// (0 if 'ring' is NULL, to avoid reading the clock for nothing)
+long long trace_start(TraceRing *ring);
+
+// record an event of kind 'kind' which began at 'start' (from trace_start)
+// and has just finished, with arguments 'arg1' and 'arg2'
+void trace_end(TraceRing *ring, EventKind kind, long long start,
+	int arg1, int arg2);
+
+// record an event of kind 'kind' happening right now, with arguments 'arg1'
+// and 'arg2'
+void trace_instant(TraceRing *ring, EventKind kind, int arg1, int arg2);
+
+// write the events held in 'ring' to 'file' as a Chrome trace JSON object,
+// oldest first
+void trace_write_json(TraceRing *ring, FILE *file);
+
+#endif